@@ -20,6 +20,7 @@
 
 #include <rmf_traffic/agv/Graph.hpp>
 
+#include <SFML/Graphics/Color.hpp>
 #include <SFML/Graphics/Drawable.hpp>
 #include <SFML/Graphics/Shape.hpp>
 #include <SFML/Graphics/Vertex.hpp>
@@ -28,6 +29,11 @@
 #include <rmf_utils/optional.hpp>
 
 #include <rmf_planner_viz/draw/Fit.hpp>
+#include <rmf_planner_viz/draw/LevelLayout.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace rmf_planner_viz {
 namespace draw {
@@ -39,10 +45,66 @@ public:
 
   Graph(const rmf_traffic::agv::Graph& graph, float lane_width, const sf::Font& font);
 
+  /// Construct the drawable using a render cache file. If cache_file holds
+  /// the render data of this exact graph (same waypoints, lanes, lane width and
+  /// label font), the file stays memory-mapped and the data of each map is
+  /// read from it instead of being tessellated again. Maps that are missing
+  /// from the cache are tessellated, and update_cache() adds them to
+  /// cache_file. An empty cache_file disables caching.
+  ///
+  /// With or without a cache, the render data of a map is only built the
+  /// first time that map is chosen.
+  Graph(
+      const rmf_traffic::agv::Graph& graph,
+      float lane_width,
+      const sf::Font& font,
+      const std::string& cache_file);
+
+  /// Write the render data of every map to a cache file, building any map
+  /// that has not been built yet. Returns false if the file could not be
+  /// written.
+  bool save_cache(const std::string& filename) const;
+
+  /// Rewrite the cache file given to the constructor with the maps that have
+  /// been tessellated since it was read. Maps that were never built are kept
+  /// as they are in the file. Does nothing if no map was tessellated. Returns
+  /// false if the file could not be written.
+  bool update_cache();
+
+  /// True if a valid render cache was found for this graph.
+  bool loaded_from_cache() const;
+
+  /// Build the maps that come before and after the current one in
+  /// get_map_names() on a background thread, so that stepping through the
+  /// levels does not stall. Off by default.
+  void set_prefetch_adjacent_maps(bool enable);
+
+  /// Limit the memory held by render data. When it is exceeded the least
+  /// recently chosen maps are evicted, and rebuilt or reloaded from the render
+  /// cache the next time they are chosen. The current map is never evicted.
+  /// Maps being prefetched count against the limit with an estimate of their
+  /// size, and are only started if they fit. Unlimited by default.
+  void set_memory_budget(std::size_t bytes);
+
+  /// Approximate memory held by the render data of resident and prefetching
+  /// maps, in bytes.
+  std::size_t memory_usage() const;
+
+  /// Draw only the given map. This leaves the multi-map view. If the graph
+  /// has no map with that name, nothing is drawn and false is returned.
   bool choose_map(const std::string& name);
 
   const std::string* current_map() const;
 
+  /// Draw every level of the layout at once, each with its own transform. The
+  /// levels share their render data with the single map view. Lanes that
+  /// connect two levels of the layout are drawn as lines between them. Call
+  /// choose_map() to go back to a single map.
+  void choose_maps(LevelLayout layout);
+
+  /// The layout being drawn, or nullptr when a single map is drawn
+  const LevelLayout* layout() const;
+
   /// Get the scaling factor for this graph that will allow it to fit into the
   /// given view size
   const Fit::Bounds& bounds() const;
@@ -59,6 +121,8 @@ public:
     std::size_t index;
   };
 
+  /// Pick the element under (x, y). In the multi-map view (x, y) are layout
+  /// coordinates, and the topmost level under them is searched first.
   rmf_utils::optional<Pick> pick(float x, float y) const;
 
   void select(Pick chosen);
@@ -67,8 +131,54 @@ public:
 
   rmf_utils::optional<Pick> selected() const;
 
+  /// Live state of a lane, shown by recoloring it
+  enum class LaneState : std::uint8_t
+  {
+    Normal,
+    Closed,
+    SpeedLimited,
+    Occupied
+  };
+
+  /// Live state of a waypoint, shown by recoloring it
+  enum class WaypointState : std::uint8_t
+  {
+    Normal,
+    Closed,
+    Occupied
+  };
+
+  /// Set the state of every lane, indexed by graph lane index. Lanes past the
+  /// end of states are Normal. Only the lanes whose state changed get
+  /// recolored, and only their vertices are sent to the GPU on the next draw,
+  /// so the full array can be streamed at a high rate. The two lanes of a
+  /// bidirectional pair are drawn as one, which shows the greater state.
+  void set_lane_states(const std::vector<LaneState>& states);
+
+  /// Set the state of every waypoint, indexed by graph waypoint index. This
+  /// works like set_lane_states().
+  void set_waypoint_states(const std::vector<WaypointState>& states);
+
+  /// Set every lane and waypoint back to Normal
+  void clear_overlay();
+
+  /// Give one lane a color of its own, such as the value of a heat map, which
+  /// is drawn instead of its state color. nullopt gives the lane its state
+  /// color back. Only that lane is recolored, so many lanes can be changed
+  /// every frame. The two lanes of a bidirectional pair are drawn as one,
+  /// which shows the color of whichever lane has one.
+  void paint_lane(std::size_t lane, rmf_utils::optional<sf::Color> color);
+
+  /// Give one waypoint a color of its own. This works like paint_lane().
+  void paint_waypoint(
+      std::size_t waypoint, rmf_utils::optional<sf::Color> color);
+
+  /// Remove every color given by paint_lane() and paint_waypoint()
+  void clear_paint();
+
   void set_text_size(uint sz);
 
+  /// Names of every map in the graph, sorted
   std::vector<std::string> get_map_names();
 
 protected:
@@ -77,7 +187,7 @@ protected:
 
   class Implementation;
 private:
-  rmf_utils::impl_ptr<Implementation> _pimpl;
+  rmf_utils::unique_impl_ptr<Implementation> _pimpl;
 };
 
 } // namespace draw
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__LEVELLAYOUT_HPP
+#define RMF_PLANNER_VIZ__DRAW__LEVELLAYOUT_HPP
+
+#include <rmf_planner_viz/draw/Fit.hpp>
+
+#include <rmf_utils/impl_ptr.hpp>
+
+#include <SFML/Graphics/Transform.hpp>
+
+#include <string>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+//==============================================================================
+/// Places several levels of a building in one view by giving each of them a
+/// transform from its map coordinates into layout coordinates. Graph and
+/// Schedule draw every level of a layout at once with these transforms.
+class LevelLayout
+{
+public:
+
+  /// Put the levels side by side in a grid, left to right and then top to
+  /// bottom. Every tile is the size of bounds, which should cover all of the
+  /// levels, with gap between neighboring tiles. If columns is 0, a roughly
+  /// square grid is used.
+  static LevelLayout tiles(
+      std::vector<std::string> levels,
+      const Fit::Bounds& bounds,
+      std::size_t columns = 0,
+      float gap = 2.0);
+
+  /// Stack the levels on top of each other in an oblique projection, with the
+  /// first level at the bottom. Each level is squashed vertically by squash,
+  /// sheared sideways by skew, and raised above the one below it by z_offset
+  /// times the height of bounds.
+  static LevelLayout stack(
+      std::vector<std::string> levels,
+      const Fit::Bounds& bounds,
+      float z_offset = 0.6,
+      float squash = 0.5,
+      float skew = 0.5);
+
+  /// The levels in the order that they are drawn
+  const std::vector<std::string>& levels() const;
+
+  /// Get the transform of a level, or nullptr if the level is not part of this
+  /// layout.
+  const sf::Transform* transform(const std::string& level) const;
+
+  /// Get the transform from layout coordinates back into the map coordinates
+  /// of a level, or nullptr if the level is not part of this layout.
+  const sf::Transform* inverse_transform(const std::string& level) const;
+
+  /// Bounds of the whole layout
+  const Fit::Bounds& bounds() const;
+
+  /// Bounds of the given map coordinate bounds once they are placed on a
+  /// level. Returns empty bounds if the level is not part of this layout.
+  Fit::Bounds transform_bounds(
+      const std::string& level,
+      const Fit::Bounds& bounds) const;
+
+  class Implementation;
+private:
+  LevelLayout();
+  rmf_utils::impl_ptr<Implementation> _pimpl;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__LEVELLAYOUT_HPP
@@ -22,6 +22,7 @@
 #include <rmf_traffic/schedule/Writer.hpp>
 
 #include <rmf_planner_viz/draw/Fit.hpp>
+#include <rmf_planner_viz/draw/LevelLayout.hpp>
 
 #include <SFML/Graphics/Drawable.hpp>
 
@@ -47,6 +48,13 @@ public:
 
   Schedule& choose_map(const std::string& name);
 
+  /// Show the routes on every level of the layout, each level drawn with its
+  /// own transform. Call choose_map() to go back to a single map.
+  Schedule& choose_maps(LevelLayout layout);
+
+  /// The layout being drawn, or nullptr when a single map is drawn
+  const LevelLayout* layout() const;
+
   const std::string& current_map() const;
 
   Schedule& timespan(
@@ -16,43 +16,474 @@
 */
 
 #include <rmf_planner_viz/draw/Graph.hpp>
-#include <rmf_planner_viz/draw/Capsule.hpp>
+
+#include "internal_GraphCache.hpp"
 
 #include <rmf_utils/optional.hpp>
 
-#include <SFML/Graphics/CircleShape.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/Text.hpp>
-
+#include <SFML/Graphics/VertexBuffer.hpp>
+#include <SFML/Graphics/View.hpp>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <future>
+#include <map>
 #include <unordered_set>
 #include <iostream>
+#include <cmath>
 
 namespace rmf_planner_viz {
 namespace draw {
 
 static const sf::Vector2f gTextScale(1.f/40.f, -1.f/40.f);
 
+namespace {
+
 //==============================================================================
-class Graph::Implementation
+const unsigned int LabelCharacterSize = 24;
+const sf::Color LabelColor = sf::Color(192, 192, 192);
+const sf::Color ConnectorLabelColor = sf::Color(144, 238, 144);
+
+// Each lane is a capsule made of a center quad and two half-circle caps, all
+// stored as plain triangles so that every lane of a map can be drawn at once.
+const std::size_t LaneCapResolution = 9;
+const std::size_t LaneCapVertexCount = 3*(LaneCapResolution-1);
+const std::size_t LaneVertexCount = 6 + 2*LaneCapVertexCount;
+
+const std::size_t WaypointResolution = 16;
+const std::size_t WaypointVertexCount = 3*WaypointResolution;
+
+// Dirty elements that are at most this far apart are sent to the GPU in one
+// update, since re-sending a few clean elements is cheaper than another call.
+const std::size_t MaxUploadGap = 4;
+
+//==============================================================================
+sf::Vector2f rotate(const sf::Vector2f& p, const sf::Vector2f& cos_sin)
 {
-public:
+  return sf::Vector2f(
+        p.x*cos_sin.x - p.y*cos_sin.y,
+        p.x*cos_sin.y + p.y*cos_sin.x);
+}
 
-  struct MapData
+//==============================================================================
+/// The rotations that build the lane caps and the waypoint circles, so that
+/// generating vertices needs no trigonometry.
+struct Rotations
+{
+  std::array<sf::Vector2f, LaneCapResolution> cap;
+  std::array<sf::Vector2f, WaypointResolution+1> circle;
+
+  Rotations()
   {
-    std::vector<Capsule> bi_lanes;
-    std::vector<std::size_t> bi_indices;
-    std::vector<sf::VertexArray> bi_lane_arrows;
+    const double d_cap = M_PI/static_cast<double>(LaneCapResolution-1);
+    for (std::size_t i=0; i < cap.size(); ++i)
+      cap[i] = sf::Vector2f(std::cos(d_cap*i), std::sin(d_cap*i));
 
-    std::vector<Capsule> mono_lanes;
-    std::vector<std::size_t> mono_indices;
-    std::vector<sf::VertexArray> mono_lane_arrows;
+    const double d_circle = 2.0*M_PI/static_cast<double>(WaypointResolution);
+    for (std::size_t i=0; i < circle.size(); ++i)
+      circle[i] = sf::Vector2f(std::cos(d_circle*i), std::sin(d_circle*i));
+  }
+};
 
-    std::vector<sf::CircleShape> waypoints;
-    std::unordered_map<std::size_t, sf::Text> waypoints_text;
-    std::unordered_map<std::size_t, sf::Text> connector_waypoints_text;
-    std::vector<Eigen::Vector2f> waypoint_p;
-    std::vector<std::size_t> waypoint_indices;
-  };
+//==============================================================================
+const Rotations& rotations()
+{
+  static const Rotations r;
+  return r;
+}
+
+//==============================================================================
+void set_lane_colors(
+    sf::Vertex* lane,
+    const sf::Color& start_color,
+    const sf::Color& end_color)
+{
+  lane[0].color = start_color;
+  lane[1].color = start_color;
+  lane[5].color = start_color;
+
+  lane[2].color = end_color;
+  lane[3].color = end_color;
+  lane[4].color = end_color;
+
+  sf::Vertex* const cap_0 = lane + 6;
+  sf::Vertex* const cap_1 = cap_0 + LaneCapVertexCount;
+  for (std::size_t i=0; i < LaneCapVertexCount; ++i)
+  {
+    cap_0[i].color = start_color;
+    cap_1[i].color = end_color;
+  }
+}
+
+//==============================================================================
+void set_lane_positions(
+    sf::Vertex* lane,
+    const sf::Vector2f& p0,
+    const sf::Vector2f& p1,
+    const float radius)
+{
+  const sf::Vector2f dp = p1 - p0;
+  const float length = std::sqrt(dp.x*dp.x + dp.y*dp.y);
+  const sf::Vector2f cross = length < 1e-8f?
+        sf::Vector2f(radius, 0.0f) : sf::Vector2f(-dp.y, dp.x)/length*radius;
+
+  lane[0].position = p0 + cross;
+  lane[1].position = p0 - cross;
+  lane[2].position = p1 + cross;
+
+  lane[3].position = p1 + cross;
+  lane[4].position = p1 - cross;
+  lane[5].position = p0 - cross;
+
+  const auto& cap = rotations().cap;
+  sf::Vertex* cap_0 = lane + 6;
+  sf::Vertex* cap_1 = cap_0 + LaneCapVertexCount;
+  for (std::size_t i=0; i < LaneCapResolution-1; ++i)
+  {
+    const sf::Vector2f r0 = rotate(cross, cap[i]);
+    const sf::Vector2f r1 = rotate(cross, cap[i+1]);
+
+    cap_0[3*i].position = p0;
+    cap_0[3*i+1].position = p0 + r0;
+    cap_0[3*i+2].position = p0 + r1;
+
+    cap_1[3*i].position = p1;
+    cap_1[3*i+1].position = p1 - r0;
+    cap_1[3*i+2].position = p1 - r1;
+  }
+}
+
+//==============================================================================
+void set_waypoint_color(sf::Vertex* waypoint, const sf::Color& color)
+{
+  for (std::size_t i=0; i < WaypointVertexCount; ++i)
+    waypoint[i].color = color;
+}
+
+//==============================================================================
+void set_waypoint_positions(
+    sf::Vertex* waypoint,
+    const sf::Vector2f& p,
+    const float radius)
+{
+  const auto& circle = rotations().circle;
+  for (std::size_t i=0; i < WaypointResolution; ++i)
+  {
+    waypoint[3*i].position = p;
+    waypoint[3*i+1].position = p + circle[i]*radius;
+    waypoint[3*i+2].position = p + circle[i+1]*radius;
+  }
+}
+
+//==============================================================================
+void append_lane_arrow(
+    std::vector<sf::Vertex>& vertices,
+    const sf::Vector2f& p0,
+    const sf::Vector2f& p1)
+{
+  sf::Vertex v;
+  v.color = sf::Color::Red;
+
+  // center
+  sf::Vector2f center = (p0 + p1) * 0.5f;
+  sf::Vector2f diff = p1 - p0;
+  float lengthsq = diff.x * diff.x + diff.y * diff.y;
+  float length = sqrt(lengthsq);
+  auto diff_norm = diff / length;
+
+  float center_spacing = 0.0625f;
+  sf::Vector2f forward_vec = diff_norm * (0.5f + center_spacing);
+
+  auto diff_perp = sf::Vector2f(-diff_norm.y, diff_norm.x);
+  float side = 0.25f;
+
+  v.position = center + diff_perp * -side + center_spacing * diff_norm;
+  vertices.push_back(v);
+  v.position = center + diff_perp * side + center_spacing * diff_norm;
+  vertices.push_back(v);
+  v.position = center + forward_vec;
+  vertices.push_back(v);
+}
+
+//==============================================================================
+/// Generate every vertex of a map from its waypoint and lane arrays
+void generate_vertices(GraphMapData& map_data, const float lane_width)
+{
+  const auto& lanes = map_data.lanes;
+  map_data.lane_vertices.resize(lanes.size()*LaneVertexCount);
+  map_data.arrow_vertices.clear();
+  for (std::size_t i=0; i < lanes.size(); ++i)
+  {
+    const sf::Vector2f p0(lanes.x0[i], lanes.y0[i]);
+    const sf::Vector2f p1(lanes.x1[i], lanes.y1[i]);
+    sf::Vertex* const lane = map_data.lane_vertices.data() + i*LaneVertexCount;
+    set_lane_positions(lane, p0, p1, lane_width/2.0);
+    set_lane_colors(lane, lanes.entry_color[i], lanes.exit_color[i]);
+
+    if (!lanes.bidirectional[i])
+      append_lane_arrow(map_data.arrow_vertices, p0, p1);
+  }
+
+  const auto& waypoints = map_data.waypoints;
+  const float r_wp = 0.30*lane_width;
+  map_data.waypoint_vertices.resize(waypoints.size()*WaypointVertexCount);
+  for (std::size_t i=0; i < waypoints.size(); ++i)
+  {
+    sf::Vertex* const waypoint =
+        map_data.waypoint_vertices.data() + i*WaypointVertexCount;
+    set_waypoint_positions(
+          waypoint, sf::Vector2f(waypoints.x[i], waypoints.y[i]), r_wp);
+    set_waypoint_color(waypoint, waypoints.color[i]);
+  }
+}
+
+//==============================================================================
+bool create_buffer(
+    sf::VertexBuffer& buffer,
+    const std::vector<sf::Vertex>& vertices)
+{
+  if (vertices.empty())
+    return true;
+
+  return buffer.create(vertices.size()) && buffer.update(vertices.data());
+}
+
+//==============================================================================
+/// Send the vertices of the dirty elements to the GPU. Every element owns
+/// stride vertices.
+void flush_buffer(
+    sf::VertexBuffer& buffer,
+    const std::vector<sf::Vertex>& vertices,
+    std::vector<std::uint32_t>& dirty,
+    const std::size_t stride)
+{
+  if (dirty.empty())
+    return;
+
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+  std::size_t begin = 0;
+  while (begin < dirty.size())
+  {
+    std::size_t end = begin + 1;
+    while (end < dirty.size() && dirty[end] - dirty[end-1] <= MaxUploadGap)
+      ++end;
+
+    const std::size_t first = dirty[begin]*stride;
+    const std::size_t count = (dirty[end-1] + 1)*stride - first;
+    buffer.update(vertices.data() + first, count, first);
+    begin = end;
+  }
+
+  dirty.clear();
+}
+
+//==============================================================================
+bool pick_lane(
+    const float x0, const float y0,
+    const float x1, const float y1,
+    const float x, const float y,
+    const float radius)
+{
+  const float r2 = radius*radius;
+  const float dx0 = x - x0;
+  const float dy0 = y - y0;
+  if (dx0*dx0 + dy0*dy0 <= r2)
+    return true;
+
+  const float dx1 = x - x1;
+  const float dy1 = y - y1;
+  if (dx1*dx1 + dy1*dy1 <= r2)
+    return true;
+
+  const float lx = x1 - x0;
+  const float ly = y1 - y0;
+  const float length_sq = lx*lx + ly*ly;
+  if (length_sq < 1e-16f)
+    return false;
+
+  // Projection of the point onto the lane, as a fraction of the lane length
+  const float s = (dx0*lx + dy0*ly)/length_sq;
+  if (s < 0.0f || 1.0f < s)
+    return false;
+
+  const float px = dx0 - s*lx;
+  const float py = dy0 - s*ly;
+  return px*px + py*py <= r2;
+}
+
+//==============================================================================
+sf::Text make_text(
+    const GraphMapData& map_data,
+    const GraphMapData::Label& label,
+    const sf::Font& font)
+{
+  sf::Text text;
+  text.setFont(font);
+  text.setCharacterSize(LabelCharacterSize);
+  text.setString(
+        map_data.label_text.substr(label.text_offset, label.text_length));
+  text.setScale(gTextScale);
+  text.setOrigin(label.origin_x, label.origin_y);
+  text.setPosition(label.x, label.y);
+
+  if (label.parent == GraphMapData::NoParent)
+    text.setFillColor(LabelColor);
+  else
+    text.setFillColor(ConnectorLabelColor);
+
+  return text;
+}
+
+//==============================================================================
+std::uint32_t add_label(
+    GraphMapData& map_data,
+    const std::size_t waypoint,
+    const sf::Vector2f& position,
+    const std::string& str,
+    const std::uint32_t parent)
+{
+  GraphMapData::Label label;
+  label.waypoint = waypoint;
+  label.x = position.x;
+  label.y = position.y;
+  label.origin_x = 0.0f;
+  label.origin_y = 0.0f;
+  label.text_offset = static_cast<std::uint32_t>(map_data.label_text.size());
+  label.text_length = static_cast<std::uint32_t>(str.size());
+  label.parent = parent;
+  label.padding = 0;
+
+  map_data.label_text += str;
+  map_data.labels.push_back(label);
+  return static_cast<std::uint32_t>(map_data.labels.size() - 1);
+}
+
+//==============================================================================
+void lay_out_labels(GraphMapData& map_data, const sf::Font& font)
+{
+  for (auto& label : map_data.labels)
+  {
+    sf::Text text;
+    text.setFont(font);
+    text.setCharacterSize(LabelCharacterSize);
+    text.setString(
+          map_data.label_text.substr(label.text_offset, label.text_length));
+
+    const sf::FloatRect text_rect = text.getLocalBounds();
+    label.origin_x = text_rect.width * 0.5f;
+    label.origin_y = text_rect.height * 0.5f;
+
+    if (label.parent == GraphMapData::NoParent)
+      continue;
+
+    // Connector labels come after all the waypoint labels, so their parent
+    // has already been laid out.
+    const auto& parent = map_data.labels[label.parent];
+    label.y = parent.y + 2.0*parent.origin_y*gTextScale.y;
+  }
+
+  map_data.labels_laid_out = true;
+}
+
+//==============================================================================
+void resize_texts(GraphMapData& map_data, const unsigned int size)
+{
+  for (std::size_t i=0; i < map_data.texts.size(); ++i)
+  {
+    sf::Text& text = map_data.texts[i];
+    text.setCharacterSize(size);
+
+    sf::FloatRect text_rect = text.getLocalBounds();
+    text.setOrigin(text_rect.width * 0.5f, text_rect.height * 0.5f);
+
+    const auto parent = map_data.labels[i].parent;
+    if (parent == GraphMapData::NoParent)
+      continue;
+
+    const sf::Text& parent_text = map_data.texts[parent];
+    sf::FloatRect parent_rect = parent_text.getLocalBounds();
+    sf::Vector2f pos = parent_text.getPosition();
+    text.setPosition(pos.x, pos.y + parent_rect.height * gTextScale.y);
+  }
+}
+
+//==============================================================================
+std::size_t estimate_memory(const GraphMapData& map_data)
+{
+  std::size_t glyphs = 0;
+  for (const auto& label : map_data.labels)
+    glyphs += label.text_length;
+
+  // sf::Text keeps a UTF-32 copy of its string and two triangles per glyph
+  const auto& w = map_data.waypoints;
+  const auto& l = map_data.lanes;
+  return sizeof(GraphMapData)
+      + (map_data.lane_vertices.capacity()
+         + map_data.arrow_vertices.capacity()
+         + map_data.waypoint_vertices.capacity())*sizeof(sf::Vertex)
+      + w.index.capacity()*sizeof(std::uint64_t)
+      + (w.x.capacity() + w.y.capacity())*sizeof(float)
+      + w.color.capacity()*sizeof(sf::Color)
+      + l.index.capacity()*sizeof(std::uint64_t)
+      + (l.x0.capacity() + l.y0.capacity()
+         + l.x1.capacity() + l.y1.capacity())*sizeof(float)
+      + l.bidirectional.capacity()
+      + (l.entry_color.capacity() + l.exit_color.capacity())*sizeof(sf::Color)
+      + map_data.labels.capacity()*sizeof(GraphMapData::Label)
+      + map_data.label_text.capacity()
+      + map_data.texts.capacity()*sizeof(sf::Text)
+      + glyphs*(sizeof(std::uint32_t) + 6*sizeof(sf::Vertex));
+}
+
+//==============================================================================
+/// The part of the target's view that can be seen, in the coordinates that
+/// transform maps from
+sf::FloatRect visible_area(
+    const sf::RenderTarget& target,
+    const sf::Transform& transform)
+{
+  const sf::View& view = target.getView();
+  const sf::FloatRect area(
+        view.getCenter().x - view.getSize().x/2.0f,
+        view.getCenter().y - view.getSize().y/2.0f,
+        view.getSize().x,
+        view.getSize().y);
+
+  return transform.getInverse().transformRect(area);
+}
+
+//==============================================================================
+bool overlaps(
+    const sf::FloatRect& area,
+    const Eigen::Vector2f& min,
+    const Eigen::Vector2f& max)
+{
+  return area.left <= max.x() && min.x() <= area.left + area.width
+      && area.top <= max.y() && min.y() <= area.top + area.height;
+}
+
+//==============================================================================
+std::string waypoint_label(const rmf_traffic::agv::Graph::Waypoint& waypoint)
+{
+  if (!waypoint.name())
+    return std::to_string(waypoint.index());
+
+  return *waypoint.name() + " (" + std::to_string(waypoint.index()) + ")";
+}
+
+} // anonymous namespace
+
+//==============================================================================
+class Graph::Implementation
+{
+public:
+
+  using MapData = GraphMapData;
 
   static const sf::Color LaneEntryColor;
   static const sf::Color LaneExitColor;
@@ -69,268 +500,950 @@ public:
     return 0.30*lane_width;
   }
 
+  /// The graph elements that belong to one map. These never change after
+  /// construction, so prefetch threads may read them without locking.
+  struct MapContents
+  {
+    std::vector<std::size_t> waypoints;
+    std::vector<std::size_t> lanes;
+  };
+
+  /// GPU copies of the vertices of a map. These are only created and used
+  /// by the thread that draws.
+  struct GpuBuffers
+  {
+    sf::VertexBuffer lanes{sf::Triangles, sf::VertexBuffer::Dynamic};
+    sf::VertexBuffer arrows{sf::Triangles, sf::VertexBuffer::Static};
+    sf::VertexBuffer waypoints{sf::Triangles, sf::VertexBuffer::Dynamic};
+  };
+
+  struct MapSlot
+  {
+    MapContents contents;
+
+    /// Covers every waypoint of the map, plus the lane width
+    Fit::Bounds bounds;
+
+    /// The largest half-extent of a label at LabelCharacterSize, used to grow
+    /// the bounds when culling
+    float label_extent = 0.0;
+
+    /// Only set while the map is resident
+    std::unique_ptr<MapData> data;
+    std::size_t memory = 0;
+    std::size_t last_used = 0;
+
+    /// Only valid while the map is being prefetched
+    std::future<MapData> pending;
+
+    /// What the map took the last time it was resident, or an estimate from
+    /// its contents before that. Prefetches count as this much until they are
+    /// loaded.
+    std::size_t expected_memory = 0;
+
+    /// Created on the first draw. Elements that get recolored after that are
+    /// listed as dirty until the next draw sends them to the GPU.
+    mutable std::unique_ptr<GpuBuffers> gpu;
+    mutable std::vector<std::uint32_t> dirty_lanes;
+    mutable std::vector<std::uint32_t> dirty_waypoints;
+  };
+
+  static constexpr std::uint32_t NoElement =
+      std::numeric_limits<std::uint32_t>::max();
+
+  /// Where a waypoint or lane of the graph is drawn, so that it can be found
+  /// without searching. element is only meaningful while slot is resident.
+  struct ElementLocation
+  {
+    MapSlot* slot = nullptr;
+    std::uint32_t element = NoElement;
+  };
+
+  std::shared_ptr<const rmf_traffic::agv::Graph> graph;
+  const sf::Font* font;
   float lane_width;
-  std::unordered_map<std::string, MapData> data;
-  rmf_utils::optional<std::string> current_map;
   Fit::Bounds bounds;
 
-  float scale;
-  sf::Vector2u left_top_border;
-  sf::Vector2u right_bottom_border;
+  std::string cache_file;
+  std::unique_ptr<GraphRenderCache> cache;
+  std::uint64_t render_hash;
+  bool cache_dirty = false;
+
+  // Sorted by name, which is also the order that decides which maps are
+  // adjacent for prefetching.
+  std::map<std::string, MapSlot> maps;
+  rmf_utils::optional<std::string> current_map;
+
+  // When set, every level of the layout is drawn instead of current_map
+  rmf_utils::optional<LevelLayout> layout;
+
+  // Waypoint pairs of the lanes that go between two maps, and the lines that
+  // show them when both maps are part of the layout
+  std::vector<std::pair<std::size_t, std::size_t>> connectors;
+  std::vector<sf::Vertex> connector_vertices;
+
+  // Indexed by graph waypoint and lane index
+  std::vector<ElementLocation> waypoint_locations;
+  std::vector<ElementLocation> lane_locations;
 
   rmf_utils::optional<Pick> selected;
+  unsigned int text_size = LabelCharacterSize;
+
+  static constexpr std::size_t NoLane = std::numeric_limits<std::size_t>::max();
+
+  // Overlay states, indexed by graph lane and waypoint index. lane_partner
+  // holds the reverse lane of each bidirectional lane that has been loaded.
+  std::vector<LaneState> lane_states;
+  std::vector<WaypointState> waypoint_states;
+  std::vector<std::size_t> lane_partner;
+
+  // Colors given to single elements, which replace their state color.
+  // Indexed by graph lane and waypoint index, and only grown once used.
+  std::vector<rmf_utils::optional<sf::Color>> lane_colors;
+  std::vector<rmf_utils::optional<sf::Color>> waypoint_colors;
+
+  mutable bool use_vertex_buffers = true;
+
+  bool prefetch = false;
+  std::size_t memory_budget = std::numeric_limits<std::size_t>::max();
+  std::size_t use_count = 0;
 
   Implementation(
+      const rmf_traffic::agv::Graph& graph_,
+      const float lane_width_,
+      const sf::Font& font_,
+      const std::string& cache_file_ = "")
+    : graph(std::make_shared<const rmf_traffic::agv::Graph>(graph_)),
+      font(&font_),
+      lane_width(lane_width_),
+      cache_file(cache_file_)
+  {
+    render_hash = compute_graph_render_hash(
+          *graph, lane_width, *font, LabelCharacterSize);
+
+    if (!cache_file.empty())
+      cache = GraphRenderCache::open(cache_file, render_hash);
+
+    sort_by_map();
+
+    if (current_map)
+      load(*current_map);
+  }
+
+  Implementation(const Implementation&) = delete;
+  Implementation& operator=(const Implementation&) = delete;
+
+  ~Implementation()
+  {
+    for (auto& entry : maps)
+    {
+      if (entry.second.pending.valid())
+        entry.second.pending.wait();
+    }
+  }
+
+  /// Find the bounds, the initial map, and which graph elements belong to
+  /// each map. This only needs the waypoint locations, so it is cheap compared
+  /// to building the render data.
+  void sort_by_map()
+  {
+    waypoint_locations.resize(graph->num_waypoints());
+    lane_locations.resize(graph->num_lanes());
+    lane_partner.resize(graph->num_lanes(), NoLane);
+
+    for (std::size_t i=0; i < graph->num_waypoints(); ++i)
+    {
+      const auto& wp = graph->get_waypoint(i);
+      auto& slot = maps[wp.get_map_name()];
+      waypoint_locations[i].slot = &slot;
+      slot.contents.waypoints.push_back(i);
+      slot.bounds.add_point(wp.get_location().cast<float>(), lane_width/2.0);
+    }
+
+    std::unordered_set<std::size_t> used_connectors;
+    for (std::size_t i=0; i < graph->num_lanes(); ++i)
+    {
+      const auto& lane = graph->get_lane(i);
+      const auto j0 = lane.entry().waypoint_index();
+      const auto j1 = lane.exit().waypoint_index();
+      const auto& w0 = graph->get_waypoint(j0);
+      const auto& w1 = graph->get_waypoint(j1);
+
+      auto& slot = maps[w0.get_map_name()];
+      lane_locations[i].slot = &slot;
+      slot.contents.lanes.push_back(i);
+
+      if (w0.get_map_name() != w1.get_map_name())
+      {
+        const auto key = std::min(j0, j1)*graph->num_waypoints()
+            + std::max(j0, j1);
+
+        if (used_connectors.insert(key).second)
+          connectors.push_back({j0, j1});
+
+        continue;
+      }
+
+      if (!current_map)
+        current_map = w0.get_map_name();
+
+      bounds.add_point(w0.get_location().cast<float>());
+      bounds.add_point(w1.get_location().cast<float>());
+    }
+
+    bounds.min -= Eigen::Vector2f::Constant(lane_width/2.0);
+    bounds.max += Eigen::Vector2f::Constant(lane_width/2.0);
+
+    for (auto& entry : maps)
+    {
+      entry.second.expected_memory =
+          estimate_contents_memory(entry.second.contents);
+    }
+  }
+
+  /// Memory that the render data of a map takes at most, assuming that every
+  /// lane has an arrow and every waypoint has a label of LabelGlyphEstimate
+  /// glyphs
+  static std::size_t estimate_contents_memory(const MapContents& contents)
+  {
+    const std::size_t LabelGlyphEstimate = 16;
+    const std::size_t per_lane =
+        (LaneVertexCount + 3)*sizeof(sf::Vertex)
+        + sizeof(std::uint64_t) + 4*sizeof(float) + 1 + 2*sizeof(sf::Color);
+    const std::size_t per_waypoint =
+        WaypointVertexCount*sizeof(sf::Vertex)
+        + sizeof(std::uint64_t) + 2*sizeof(float) + sizeof(sf::Color)
+        + sizeof(MapData::Label) + sizeof(sf::Text)
+        + LabelGlyphEstimate*(1 + sizeof(std::uint32_t) + 6*sizeof(sf::Vertex));
+
+    return sizeof(MapData)
+        + contents.lanes.size()*per_lane
+        + contents.waypoints.size()*per_waypoint;
+  }
+
+  /// Build the render data of one map, reading its arrays from the cache if
+  /// possible. This does not touch the font or any mutable state, so it can
+  /// run on a prefetch thread. The labels still need to be laid out
+  /// afterwards.
+  static MapData build(
       const rmf_traffic::agv::Graph& graph,
+      const MapContents& contents,
       const float lane_width,
-      const sf::Font& font)
+      const GraphRenderCache* cache,
+      const std::string& name)
+  {
+    MapData map_data;
+    if (!cache || !cache->read(
+          name, graph.num_waypoints(), graph.num_lanes(), map_data))
+    {
+      map_data = MapData();
+      tessellate(graph, contents, map_data);
+    }
+
+    reset_colors(map_data);
+    generate_vertices(map_data, lane_width);
+    return map_data;
+  }
+
+  static void reset_colors(MapData& map_data)
+  {
+    auto& lanes = map_data.lanes;
+    lanes.entry_color.assign(lanes.size(), LaneEntryColor);
+    lanes.exit_color.resize(lanes.size());
+    for (std::size_t i=0; i < lanes.size(); ++i)
+      lanes.exit_color[i] = lanes.bidirectional[i]? LaneEntryColor : LaneExitColor;
+
+    auto& waypoints = map_data.waypoints;
+    waypoints.color.assign(waypoints.size(), WaypointColor);
+  }
+
+  static void tessellate(
+      const rmf_traffic::agv::Graph& graph,
+      const MapContents& contents,
+      MapData& map_data)
   {
-    this->lane_width = lane_width;
     std::unordered_map<std::size_t, std::unordered_set<std::size_t>> used_lanes;
     std::unordered_set<std::size_t> used_vertices;
-    
-    for (std::size_t i=0; i < graph.num_waypoints(); ++i)
+    std::unordered_set<std::size_t> used_connectors;
+    std::unordered_map<std::size_t, std::uint32_t> labels;
+
+    for (const std::size_t i : contents.waypoints)
     {
       const auto& waypoint = graph.get_waypoint(i);
-      sf::Text text;
-      text.setFont(font);
-      text.setCharacterSize(24);
-      if (waypoint.name())
+      const auto& p = waypoint.get_location();
+      labels[i] = add_label(
+            map_data, waypoint.index(), sf::Vector2f(p.x(), p.y()),
+            waypoint_label(waypoint), MapData::NoParent);
+    }
+
+    for (const std::size_t i : contents.lanes)
+    {
+      const auto& lane = graph.get_lane(i);
+      const auto j0 = lane.entry().waypoint_index();
+      const auto j1 = lane.exit().waypoint_index();
+
+      const auto& w0 = graph.get_waypoint(j0);
+      const auto& w1 = graph.get_waypoint(j1);
+
+      if (w0.get_map_name() != w1.get_map_name())
+      {
+        if (!used_connectors.insert(j0).second)
+          continue;
+
+        // add text that tells of a connection to another level. It gets moved
+        // under the waypoint label when the labels are laid out.
+        const sf::Vector2f position(
+              w0.get_location().x(), w0.get_location().y());
+
+        add_label(
+              map_data, j0, position,
+              "[" + w1.get_map_name() + "::" + waypoint_label(w1) + "]",
+              labels.at(j0));
+        continue;
+      }
+
+      const bool inserted = used_lanes[j0].insert(j1).second;
+
+      if (!inserted)
+        continue;
+
+      const bool bidirectional = static_cast<bool>(graph.lane_from(j1, j0));
+      if (bidirectional)
+        used_lanes[j1].insert(j0);
+
+      const auto& p0 = w0.get_location();
+      const auto& p1 = w1.get_location();
+
+      auto& lanes = map_data.lanes;
+      lanes.index.push_back(i);
+      lanes.x0.push_back(p0.x());
+      lanes.y0.push_back(p0.y());
+      lanes.x1.push_back(p1.x());
+      lanes.y1.push_back(p1.y());
+      lanes.bidirectional.push_back(bidirectional);
+
+      for (const auto j : {j0, j1})
+      {
+        if (!used_vertices.insert(j).second)
+          continue;
+
+        const auto& p = graph.get_waypoint(j).get_location();
+        auto& waypoints = map_data.waypoints;
+        waypoints.index.push_back(j);
+        waypoints.x.push_back(p.x());
+        waypoints.y.push_back(p.y());
+      }
+    }
+  }
+
+  /// Make sure that the render data of a map is resident and mark it as the
+  /// most recently used.
+  MapData& load(const std::string& name)
+  {
+    MapSlot& slot = maps.at(name);
+    slot.last_used = ++use_count;
+    if (slot.data)
+      return *slot.data;
+
+    if (slot.pending.valid())
+    {
+      slot.data = std::make_unique<MapData>(slot.pending.get());
+    }
+    else
+    {
+      slot.data = std::make_unique<MapData>(
+            build(*graph, slot.contents, lane_width, cache.get(), name));
+    }
+
+    MapData& map_data = *slot.data;
+    index_elements(slot);
+
+    if (!map_data.labels_laid_out)
+    {
+      lay_out_labels(map_data, *font);
+      cache_dirty = !cache_file.empty();
+    }
+
+    map_data.texts.reserve(map_data.labels.size());
+    for (const auto& label : map_data.labels)
+      map_data.texts.push_back(make_text(map_data, label, *font));
+
+    if (text_size != LabelCharacterSize)
+      resize_texts(map_data, text_size);
+
+    slot.memory = estimate_memory(map_data);
+    slot.expected_memory = slot.memory;
+
+    slot.label_extent = 0.0;
+    for (const auto& label : map_data.labels)
+    {
+      slot.label_extent = std::max(
+            {slot.label_extent,
+             label.origin_x*std::abs(gTextScale.x),
+             label.origin_y*std::abs(gTextScale.y)});
+    }
+
+    apply_overlay(slot);
+
+    return map_data;
+  }
+
+  void index_elements(MapSlot& slot)
+  {
+    const auto& waypoints = slot.data->waypoints;
+    for (std::size_t i=0; i < waypoints.size(); ++i)
+      waypoint_locations[waypoints.index[i]].element = i;
+
+    const auto& lanes = slot.data->lanes;
+    for (std::size_t i=0; i < lanes.size(); ++i)
+    {
+      lane_locations[lanes.index[i]].element = i;
+      if (!lanes.bidirectional[i])
+        continue;
+
+      // The reverse lane shares the capsule of this one
+      const auto& lane = graph->get_lane(lanes.index[i]);
+      const auto* reverse = graph->lane_from(
+            lane.exit().waypoint_index(), lane.entry().waypoint_index());
+      if (reverse)
+      {
+        lane_locations[reverse->index()] = ElementLocation{&slot, std::uint32_t(i)};
+        lane_partner[reverse->index()] = lanes.index[i];
+        lane_partner[lanes.index[i]] = reverse->index();
+      }
+    }
+  }
+
+  /// Start building the maps on either side of the current one in the
+  /// background, as long as each of them fits in the memory budget.
+  void prefetch_adjacent()
+  {
+    if (!prefetch || layout || !current_map)
+      return;
+
+    std::size_t usage = memory_usage();
+
+    const auto current = maps.find(*current_map);
+    std::vector<std::map<std::string, MapSlot>::iterator> adjacent;
+    if (current != maps.begin())
+      adjacent.push_back(std::prev(current));
+
+    if (std::next(current) != maps.end())
+      adjacent.push_back(std::next(current));
+
+    for (const auto& it : adjacent)
+    {
+      MapSlot& slot = it->second;
+      if (slot.data || slot.pending.valid())
+        continue;
+
+      if (memory_budget < usage + slot.expected_memory)
+        continue;
+
+      usage += slot.expected_memory;
+      slot.pending = std::async(
+            std::launch::async,
+            &Implementation::build,
+            std::cref(*graph),
+            std::cref(slot.contents),
+            lane_width,
+            cache.get(),
+            it->first);
+    }
+  }
+
+  /// Resident maps, plus the maps that are being prefetched
+  std::size_t memory_usage() const
+  {
+    std::size_t total = 0;
+    for (const auto& entry : maps)
+    {
+      if (entry.second.data)
+        total += entry.second.memory;
+      else if (entry.second.pending.valid())
+        total += entry.second.expected_memory;
+    }
+
+    return total;
+  }
+
+  /// True if the map is currently being drawn
+  bool in_view(const std::string& name) const
+  {
+    if (layout)
+      return layout->transform(name) != nullptr;
+
+    return current_map && *current_map == name;
+  }
+
+  /// Evict the least recently used maps until we are within the memory budget.
+  /// Maps that are in view are never evicted. Prefetches are dropped first,
+  /// since they may never be needed.
+  void enforce_memory_budget()
+  {
+    std::size_t usage = memory_usage();
+    for (auto& entry : maps)
+    {
+      MapSlot& slot = entry.second;
+      if (usage <= memory_budget)
+        return;
+
+      if (slot.data || !slot.pending.valid())
+        continue;
+
+      slot.pending.wait();
+      slot.pending = std::future<MapData>();
+      usage -= slot.expected_memory;
+    }
+
+    while (memory_budget < usage)
+    {
+      MapSlot* coldest = nullptr;
+      for (auto& entry : maps)
       {
-        std::string name = *waypoint.name();
-        name += " (";
-        name += std::to_string(waypoint.index());
-        name += ")";
-        text.setString(name);
+        MapSlot& slot = entry.second;
+        if (!slot.data || in_view(entry.first))
+          continue;
+
+        if (!coldest || slot.last_used < coldest->last_used)
+          coldest = &slot;
       }
-      else
-        text.setString(std::to_string(waypoint.index()));
-      
-      text.setScale(gTextScale);
-      
-      sf::FloatRect text_rect = text.getLocalBounds();
-      text.setOrigin(text_rect.width * 0.5f, text_rect.height * 0.5f);
-      text.setPosition(waypoint.get_location().x(), waypoint.get_location().y());
 
-      text.setFillColor(sf::Color(192, 192, 192));
+      if (!coldest)
+        return;
 
-      auto& map_data = data[waypoint.get_map_name()];
-      map_data.waypoints_text.emplace(waypoint.index(), text);
+      usage -= coldest->memory;
+      coldest->data.reset();
+      coldest->memory = 0;
+      coldest->gpu.reset();
+      coldest->dirty_lanes.clear();
+      coldest->dirty_waypoints.clear();
     }
+  }
 
-    for (std::size_t i=0; i < graph.num_lanes(); ++i)
+  /// Write the render data of each map to filename. Maps that are not
+  /// resident are taken from the current cache file, or built from scratch if
+  /// build_missing is true and skipped otherwise.
+  bool write_cache(const std::string& filename, const bool build_missing) const
+  {
+    std::deque<MapData> scratch;
+    std::map<std::string, const MapData*> output;
+    for (const auto& entry : maps)
     {
-      const auto& lane = graph.get_lane(i);
-      const auto j0 = lane.entry().waypoint_index();
-      const auto j1 = lane.exit().waypoint_index();
-
-      const auto& w0 = graph.get_waypoint(j0);
-      const auto& w1 = graph.get_waypoint(j1);
-
-      if (w0.get_map_name() != w1.get_map_name())
+      const auto& name = entry.first;
+      const auto& slot = entry.second;
+      if (slot.data)
       {
-        // add text that tells of a connection to another level
-        auto& w0_map_data = data[w0.get_map_name()];
-        auto& w0_text = w0_map_data.waypoints_text[j0];
-
-        auto& w1_map_data = data[w1.get_map_name()];
-        auto& w1_text = w1_map_data.waypoints_text[j1];
-        std::string w1_str = w1_text.getString();
-        
-        sf::Text text;
-        text.setFont(font);
-        text.setCharacterSize(w0_text.getCharacterSize());
-        text.setColor(sf::Color(144,238,144));
-        text.setString("[" + w1.get_map_name() + "::" + w1_str + "]");
-
-        sf::FloatRect text_rect = text.getLocalBounds();
-        text.setOrigin(text_rect.width * 0.5f, text_rect.height * 0.5f);
-
-        sf::FloatRect w0_text_rect = w0_text.getLocalBounds();
-        text.setPosition(w0.get_location().x(), 
-          w0.get_location().y() + w0_text_rect.height * gTextScale.y);
-        text.setScale(gTextScale);
-        
-        w0_map_data.connector_waypoints_text.emplace(j0, text);
+        output[name] = slot.data.get();
         continue;
       }
 
-      const bool inserted = used_lanes[j0].insert(j1).second;
-
-      if (!inserted)
+      if (!build_missing && !(cache && cache->contains(name)))
         continue;
 
-      auto& map_data = data[w0.get_map_name()];
+      scratch.push_back(
+            build(*graph, slot.contents, lane_width, cache.get(), name));
 
-      if (!current_map)
-        current_map = w0.get_map_name();
+      if (!scratch.back().labels_laid_out)
+        lay_out_labels(scratch.back(), *font);
 
-      const bool bidirectional = static_cast<bool>(graph.lane_from(j1, j0));
-      if (bidirectional)
-        used_lanes[j1].insert(j0);
+      output[name] = &scratch.back();
+    }
+
+    return write_graph_render_cache(filename, render_hash, output);
+  }
+
+  void update_connector_vertices()
+  {
+    connector_vertices.clear();
+    if (!layout)
+      return;
+
+    for (const auto& c : connectors)
+    {
+      const auto& w0 = graph->get_waypoint(c.first);
+      const auto& w1 = graph->get_waypoint(c.second);
+      const auto* tf0 = layout->transform(w0.get_map_name());
+      const auto* tf1 = layout->transform(w1.get_map_name());
+      if (!tf0 || !tf1)
+        continue;
 
       const auto& p0 = w0.get_location();
       const auto& p1 = w1.get_location();
+      connector_vertices.emplace_back(
+            tf0->transformPoint(p0.x(), p0.y()), ConnectorLabelColor);
+      connector_vertices.emplace_back(
+            tf1->transformPoint(p1.x(), p1.y()), ConnectorLabelColor);
+    }
+  }
 
-      for (const auto& p : {p0, p1})
-      {
-        for (std::size_t i=0; i < 2; ++i)
-        {
-          if (p[i] < bounds.min[i])
-            bounds.min[i] = p[i];
-
-          if (bounds.max[i] < p[i])
-            bounds.max[i] = p[i];
-        }
-      }
+  rmf_utils::optional<Pick> pick(
+      const std::string& name,
+      const Eigen::Vector2f& p_l) const
+  {
+    const auto& slot = maps.at(name);
+    if (!slot.data)
+      return rmf_utils::nullopt;
 
-      sf::Vertex v0;
-      v0.position = sf::Vector2f(p0.x(), p0.y());
-      v0.color = LaneEntryColor;
+    const float r_wp = waypoint_radius();
+    const Fit::Bounds pick_bounds(
+          slot.bounds.min - Eigen::Vector2f::Constant(r_wp),
+          slot.bounds.max + Eigen::Vector2f::Constant(r_wp));
 
-      sf::Vertex v1;
-      v1.position = sf::Vector2f(p1.x(), p1.y());
-      v1.color = bidirectional? LaneEntryColor : LaneExitColor;
+    if (!pick_bounds.inside(p_l))
+      return rmf_utils::nullopt;
 
-      Capsule capsule(v0, v1, lane_width/2.0);
-      if (bidirectional)
+    const float r2 = r_wp*r_wp;
+    const auto& waypoints = slot.data->waypoints;
+    for (std::size_t i=0; i < waypoints.size(); ++i)
+    {
+      const float dx = waypoints.x[i] - p_l.x();
+      const float dy = waypoints.y[i] - p_l.y();
+      if (dx*dx + dy*dy <= r2)
+        return Graph::Pick{ElementType::Waypoint, waypoints.index[i]};
+    }
+
+    const float r_lane = lane_width/2.0;
+    const auto& lanes = slot.data->lanes;
+    for (std::size_t i=0; i < lanes.size(); ++i)
+    {
+      if (pick_lane(lanes.x0[i], lanes.y0[i], lanes.x1[i], lanes.y1[i],
+                    p_l.x(), p_l.y(), r_lane))
+        return Graph::Pick{ElementType::Lane, lanes.index[i]};
+    }
+
+    return rmf_utils::nullopt;
+  }
+
+  /// Draw one map, skipping it entirely if it is out of view and skipping the
+  /// labels that are out of view.
+  void draw(
+      const std::string& name,
+      sf::RenderTarget& target,
+      const sf::RenderStates& states) const
+  {
+    const auto& slot = maps.at(name);
+    if (!slot.data)
+      return;
+
+    const float text_scale =
+        static_cast<float>(text_size)/static_cast<float>(LabelCharacterSize);
+    const float margin = slot.label_extent*text_scale;
+
+    const sf::FloatRect area = visible_area(target, states.transform);
+    if (!overlaps(
+          area,
+          slot.bounds.min - Eigen::Vector2f::Constant(margin),
+          slot.bounds.max + Eigen::Vector2f::Constant(margin)))
+    {
+      return;
+    }
+
+    const auto& map_data = *slot.data;
+    if (upload(slot))
+    {
+      for (const auto* buffer :
+           {&slot.gpu->lanes, &slot.gpu->arrows, &slot.gpu->waypoints})
       {
-        map_data.bi_lanes.push_back(std::move(capsule));
-        map_data.bi_indices.push_back(i);
+        if (buffer->getVertexCount() > 0)
+          target.draw(*buffer, states);
       }
-      else
+    }
+    else
+    {
+      for (const auto* vertices :
+           {&map_data.lane_vertices,
+            &map_data.arrow_vertices,
+            &map_data.waypoint_vertices})
       {
-        map_data.mono_lanes.push_back(std::move(capsule));
-        map_data.mono_indices.push_back(i);
-        map_data.bi_lane_arrows.push_back(add_lane_arrow(v0, v1));
+        if (!vertices->empty())
+          target.draw(vertices->data(), vertices->size(), sf::Triangles, states);
       }
+    }
 
-      const float r_wp = waypoint_radius();
-
-      if (used_vertices.insert(j0).second)
+    const float sx = std::abs(gTextScale.x)*text_scale;
+    const float sy = std::abs(gTextScale.y)*text_scale;
+    for (std::size_t i=0; i < map_data.texts.size(); ++i)
+    {
+      const auto& label = map_data.labels[i];
+      const sf::Text& text = map_data.texts[i];
+      const sf::Vector2f p = text.getPosition();
+      const Eigen::Vector2f extent(label.origin_x*sx, label.origin_y*sy);
+      if (!overlaps(area, Eigen::Vector2f(p.x, p.y) - extent,
+                    Eigen::Vector2f(p.x, p.y) + extent))
       {
-        sf::CircleShape w0_shape(r_wp);
-        w0_shape.setOrigin(r_wp, r_wp);
-        w0_shape.setPosition(p0.x(), p0.y());
-        w0_shape.setFillColor(WaypointColor);
-        map_data.waypoints.emplace_back(std::move(w0_shape));
-        map_data.waypoint_p.push_back({p0.x(), p0.y()});
-        map_data.waypoint_indices.push_back(j0);
+        continue;
       }
 
-      if (used_vertices.insert(j1).second)
+      target.draw(text, states);
+    }
+  }
+
+  /// Bring the GPU buffers of a map up to date. Returns false if vertex
+  /// buffers cannot be used, in which case the vertex arrays get drawn
+  /// directly.
+  bool upload(const MapSlot& slot) const
+  {
+    if (!use_vertex_buffers)
+      return false;
+
+    const auto& map_data = *slot.data;
+    if (!slot.gpu)
+    {
+      auto gpu = std::make_unique<GpuBuffers>();
+      if (!sf::VertexBuffer::isAvailable()
+          || !create_buffer(gpu->lanes, map_data.lane_vertices)
+          || !create_buffer(gpu->arrows, map_data.arrow_vertices)
+          || !create_buffer(gpu->waypoints, map_data.waypoint_vertices))
       {
-        sf::CircleShape w1_shape(r_wp);
-        w1_shape.setOrigin(r_wp, r_wp);
-        w1_shape.setPosition(p1.x(), p1.y());
-        w1_shape.setFillColor(WaypointColor);
-        map_data.waypoints.emplace_back(std::move(w1_shape));
-        map_data.waypoint_p.push_back({p1.x(), p1.y()});
-        map_data.waypoint_indices.push_back(j1);
+        use_vertex_buffers = false;
+        return false;
       }
+
+      slot.gpu = std::move(gpu);
+      slot.dirty_lanes.clear();
+      slot.dirty_waypoints.clear();
+      return true;
     }
 
-    bounds.min -= Eigen::Vector2f::Constant(lane_width/2.0);
-    bounds.max += Eigen::Vector2f::Constant(lane_width/2.0);
+    flush_buffer(
+          slot.gpu->lanes, map_data.lane_vertices,
+          slot.dirty_lanes, LaneVertexCount);
+
+    flush_buffer(
+          slot.gpu->waypoints, map_data.waypoint_vertices,
+          slot.dirty_waypoints, WaypointVertexCount);
+
+    return true;
+  }
+
+  static sf::Color state_color(const LaneState state)
+  {
+    switch (state)
+    {
+      case LaneState::Closed: return sf::Color(200, 40, 40);
+      case LaneState::SpeedLimited: return sf::Color(255, 165, 0);
+      case LaneState::Occupied: return sf::Color(160, 32, 240);
+      default: return LaneEntryColor;
+    }
+  }
+
+  static sf::Color state_color(const WaypointState state)
+  {
+    switch (state)
+    {
+      case WaypointState::Closed: return sf::Color(200, 40, 40);
+      case WaypointState::Occupied: return sf::Color(160, 32, 240);
+      default: return WaypointColor;
+    }
+  }
+
+  template<typename State>
+  static State state_of(const std::vector<State>& states, std::size_t index)
+  {
+    return index < states.size() ? states[index] : State::Normal;
+  }
+
+  /// The two lanes of a bidirectional pair share a capsule, which shows the
+  /// greater of their states and is selected if either of them is.
+  LaneState lane_state(const std::size_t lane) const
+  {
+    LaneState state = state_of(lane_states, lane);
+    const auto partner = lane_partner[lane];
+    if (partner != NoLane)
+      state = std::max(state, state_of(lane_states, partner));
+
+    return state;
+  }
+
+  template<typename T>
+  static const T* color_of(
+      const std::vector<rmf_utils::optional<T>>& colors, std::size_t index)
+  {
+    if (index < colors.size() && colors[index])
+      return &colors[index].value();
+
+    return nullptr;
   }
 
-  void highlight(const Pick chosen)
+  /// The capsule of a bidirectional pair shows the color of either lane
+  const sf::Color* lane_color(const std::size_t lane) const
   {
-    change_color(
-          chosen,
-          sf::Color::Cyan,
-          sf::Color::Yellow,
-          sf::Color::Magenta);
+    if (const auto* color = color_of(lane_colors, lane))
+      return color;
+
+    const auto partner = lane_partner[lane];
+    if (partner != NoLane)
+      return color_of(lane_colors, partner);
+
+    return nullptr;
   }
 
-  void unhighlight(const Pick chosen)
+  bool lane_selected(const std::size_t lane) const
   {
-    change_color(
-          chosen,
-          LaneEntryColor,
-          LaneExitColor,
-          WaypointColor);
+    if (!selected || selected->type != ElementType::Lane)
+      return false;
+
+    return selected->index == lane || selected->index == lane_partner[lane];
   }
 
-  void change_color(
-      Pick chosen,
-      const sf::Color& lane_entry_color,
-      const sf::Color& lane_exit_color,
-      const sf::Color& waypoint_color)
+  void recolor_lane(MapSlot& slot, const std::size_t i)
   {
-    if (chosen.type == ElementType::Waypoint)
+    auto& lanes = slot.data->lanes;
+    const auto lane = lanes.index[i];
+
+    sf::Color entry_color = LaneEntryColor;
+    sf::Color exit_color = LaneExitColor;
+    if (lane_selected(lane))
     {
-      for (auto& entry : data)
-      {
-        auto& map_data = entry.second;
-        for (std::size_t i=0; i < map_data.waypoints.size(); ++i)
-        {
-          if (map_data.waypoint_indices[i] == chosen.index)
-          {
-            map_data.waypoints[i].setFillColor(waypoint_color);
-            return;
-          }
-        }
-      }
+      entry_color = sf::Color::Cyan;
+      exit_color = sf::Color::Yellow;
+    }
+    else if (const auto* color = lane_color(lane))
+    {
+      entry_color = *color;
+      exit_color = *color;
     }
     else
     {
-      for (auto& entry : data)
+      const LaneState state = lane_state(lane);
+      if (state != LaneState::Normal)
       {
-        auto& map_data = entry.second;
-        for (std::size_t i=0; i < map_data.bi_lanes.size(); ++i)
-        {
-          if (map_data.bi_indices[i] == chosen.index)
-          {
-            map_data.bi_lanes[i]
-                .set_start_color(lane_entry_color)
-                .set_end_color(lane_entry_color);
-            return;
-          }
-        }
-
-        for (std::size_t i=0; i < map_data.mono_lanes.size(); ++i)
-        {
-          if (map_data.mono_indices[i] == chosen.index)
-          {
-            map_data.mono_lanes[i]
-                .set_start_color(lane_entry_color)
-                .set_end_color(lane_exit_color);
-            return;
-          }
-        }
+        entry_color = state_color(state);
+        exit_color = entry_color;
       }
     }
+
+    if (lanes.bidirectional[i])
+      exit_color = entry_color;
+
+    lanes.entry_color[i] = entry_color;
+    lanes.exit_color[i] = exit_color;
+    set_lane_colors(
+          slot.data->lane_vertices.data() + i*LaneVertexCount,
+          entry_color, exit_color);
+
+    if (slot.gpu)
+      slot.dirty_lanes.push_back(i);
+  }
+
+  void recolor_waypoint(MapSlot& slot, const std::size_t i)
+  {
+    auto& waypoints = slot.data->waypoints;
+    const auto waypoint = waypoints.index[i];
+
+    sf::Color color = state_color(state_of(waypoint_states, waypoint));
+    if (const auto* own_color = color_of(waypoint_colors, waypoint))
+      color = *own_color;
+
+    if (selected && selected->type == ElementType::Waypoint
+        && selected->index == waypoint)
+      color = sf::Color::Magenta;
+
+    waypoints.color[i] = color;
+    set_waypoint_color(
+          slot.data->waypoint_vertices.data() + i*WaypointVertexCount, color);
+
+    if (slot.gpu)
+      slot.dirty_waypoints.push_back(i);
+  }
+
+  /// Recolor one element of the graph if the map that it is on is resident.
+  /// A map that gets loaded later picks up its colors in apply_overlay().
+  void recolor(const Pick element)
+  {
+    const auto& locations = element.type == ElementType::Waypoint ?
+          waypoint_locations : lane_locations;
+
+    if (locations.size() <= element.index)
+      return;
+
+    const auto& location = locations[element.index];
+    if (!location.slot || !location.slot->data
+        || location.element == NoElement)
+      return;
+
+    if (element.type == ElementType::Waypoint)
+      recolor_waypoint(*location.slot, location.element);
+    else
+      recolor_lane(*location.slot, location.element);
+  }
+
+  /// Color a freshly loaded map according to the overlay and the selection
+  void apply_overlay(MapSlot& slot)
+  {
+    if (!lane_states.empty() || !lane_colors.empty())
+    {
+      for (std::size_t i=0; i < slot.data->lanes.size(); ++i)
+        recolor_lane(slot, i);
+    }
+
+    if (!waypoint_states.empty() || !waypoint_colors.empty())
+    {
+      for (std::size_t i=0; i < slot.data->waypoints.size(); ++i)
+        recolor_waypoint(slot, i);
+    }
+
+    if (selected)
+      recolor(*selected);
   }
 
-  sf::VertexArray add_lane_arrow(const sf::Vertex& v0, const sf::Vertex& v1)
+  template<typename State>
+  void set_states(
+      std::vector<State>& current,
+      const std::vector<State>& states,
+      const ElementType type)
   {
-    sf::VertexArray arr(sf::Triangles);
-    sf::Vertex v;
-    v.color = sf::Color::Red;
+    const std::vector<State> previous = std::move(current);
+    current = states;
 
-    // center
-    sf::Vector2 center = (v0.position + v1.position) * 0.5f;
-    sf::Vector2 diff = v1.position - v0.position;
-    float lengthsq = diff.x * diff.x + diff.y * diff.y;
-    float length = sqrt(lengthsq);
-    auto diff_norm = diff / length;
+    const std::size_t n = std::max(previous.size(), current.size());
+    for (std::size_t i=0; i < n; ++i)
+    {
+      if (state_of(previous, i) != state_of(current, i))
+        recolor(Pick{type, i});
+    }
+  }
+
+  void set_color(
+      std::vector<rmf_utils::optional<sf::Color>>& colors,
+      const std::size_t index,
+      const rmf_utils::optional<sf::Color>& color,
+      const ElementType type)
+  {
+    const std::size_t count = type == ElementType::Waypoint ?
+          graph->num_waypoints() : graph->num_lanes();
+    if (count <= index)
+      return;
 
-    float center_spacing = 0.0625f;
-    sf::Vector2 forward_vec = diff_norm * (0.5f + center_spacing);
-    
-    auto diff_perp = sf::Vector2(-diff_norm.y, diff_norm.x);
-    float side = 0.25f;
+    if (colors.size() <= index)
+    {
+      if (!color)
+        return;
 
-    v.position = center + diff_perp * -side + center_spacing * diff_norm;
-    arr.append(v);
-    v.position = center + diff_perp * side + center_spacing * diff_norm;
-    arr.append(v);
-    v.position = center + forward_vec;
-    arr.append(v);
+      colors.resize(count);
+    }
 
-    return arr;
-  };
+    if (colors[index] == color)
+      return;
+
+    colors[index] = color;
+    recolor(Pick{type, index});
+  }
+
+  void clear_colors(
+      std::vector<rmf_utils::optional<sf::Color>>& colors,
+      const ElementType type)
+  {
+    const auto previous = std::move(colors);
+    colors.clear();
+
+    for (std::size_t i=0; i < previous.size(); ++i)
+    {
+      if (previous[i])
+        recolor(Pick{type, i});
+    }
+  }
 };
 
 const sf::Color Graph::Implementation::LaneEntryColor = sf::Color::White;
@@ -342,25 +1455,113 @@ Graph::Graph(
     const rmf_traffic::agv::Graph& graph,
     const float lane_width,
     const sf::Font& font)
-  : _pimpl(rmf_utils::make_impl<Implementation>(graph, lane_width, font))
+  : _pimpl(rmf_utils::make_unique_impl<Implementation>(graph, lane_width, font))
+{
+  // Do nothing
+}
+
+//==============================================================================
+Graph::Graph(
+    const rmf_traffic::agv::Graph& graph,
+    const float lane_width,
+    const sf::Font& font,
+    const std::string& cache_file)
+  : _pimpl(rmf_utils::make_unique_impl<Implementation>(
+             graph, lane_width, font, cache_file))
 {
   // Do nothing
 }
 
+//==============================================================================
+bool Graph::save_cache(const std::string& filename) const
+{
+  return _pimpl->write_cache(filename, true);
+}
+
+//==============================================================================
+bool Graph::update_cache()
+{
+  // Maps are tessellated as they get viewed, so only the maps that have been
+  // needed so far are added.
+  if (!_pimpl->cache_dirty)
+    return true;
+
+  if (!_pimpl->write_cache(_pimpl->cache_file, false))
+    return false;
+
+  _pimpl->cache_dirty = false;
+  return true;
+}
+
+//==============================================================================
+bool Graph::loaded_from_cache() const
+{
+  return static_cast<bool>(_pimpl->cache);
+}
+
+//==============================================================================
+void Graph::set_prefetch_adjacent_maps(bool enable)
+{
+  _pimpl->prefetch = enable;
+  _pimpl->prefetch_adjacent();
+}
+
+//==============================================================================
+void Graph::set_memory_budget(std::size_t bytes)
+{
+  _pimpl->memory_budget = bytes;
+  _pimpl->enforce_memory_budget();
+}
+
+//==============================================================================
+std::size_t Graph::memory_usage() const
+{
+  return _pimpl->memory_usage();
+}
+
 //==============================================================================
 bool Graph::choose_map(const std::string& name)
 {
-  const auto it = _pimpl->data.find(name);
-  if (it == _pimpl->data.end())
+  _pimpl->layout = rmf_utils::nullopt;
+  _pimpl->connector_vertices.clear();
+
+  const auto it = _pimpl->maps.find(name);
+  if (it == _pimpl->maps.end())
   {
     _pimpl->current_map = rmf_utils::nullopt;
     return false;
   }
 
   _pimpl->current_map = name;
+  _pimpl->load(name);
+  _pimpl->enforce_memory_budget();
+  _pimpl->prefetch_adjacent();
   return true;
 }
 
+//==============================================================================
+void Graph::choose_maps(LevelLayout layout)
+{
+  _pimpl->layout = std::move(layout);
+  for (const auto& level : _pimpl->layout->levels())
+  {
+    if (_pimpl->maps.count(level))
+      _pimpl->load(level);
+  }
+
+  _pimpl->update_connector_vertices();
+  _pimpl->enforce_memory_budget();
+}
+
+//==============================================================================
+const LevelLayout* Graph::layout() const
+{
+  if (_pimpl->layout)
+    return &_pimpl->layout.value();
+
+  return nullptr;
+}
+
 //==============================================================================
 const std::string* Graph::current_map() const
 {
@@ -379,150 +1580,148 @@ const Fit::Bounds& Graph::bounds() const
 //==============================================================================
 rmf_utils::optional<Graph::Pick> Graph::pick(float x, float y) const
 {
-  if (!_pimpl->current_map)
-    return rmf_utils::nullopt;
-
-  const Eigen::Vector2f p_l(x, y);
-
-  const float r_wp = _pimpl->waypoint_radius();
-
-  if (p_l.x() < _pimpl->bounds.min.x() - r_wp)
-    return rmf_utils::nullopt;
-
-  if (p_l.y() < _pimpl->bounds.min.y() - r_wp)
-    return rmf_utils::nullopt;
-
-  if (_pimpl->bounds.max.x() + r_wp < p_l.x())
-    return rmf_utils::nullopt;
-
-  if (_pimpl->bounds.max.y() + r_wp < p_l.y())
-    return rmf_utils::nullopt;
-
-  const auto& map_data = _pimpl->data.at(*_pimpl->current_map);
-  assert(map_data.waypoints.size() == map_data.waypoint_indices.size());
-  assert(map_data.waypoints.size() == map_data.waypoint_p.size());
-  for (std::size_t i=0; i < map_data.waypoints.size(); ++i)
+  if (_pimpl->layout)
   {
-    const Eigen::Vector2f wp_p = map_data.waypoint_p.at(i);
-    if ((wp_p - p_l).norm() <= r_wp)
+    // Levels that are drawn later are on top, so they get picked first
+    const auto& levels = _pimpl->layout->levels();
+    for (auto it = levels.rbegin(); it != levels.rend(); ++it)
     {
-      return Graph::Pick{
-        ElementType::Waypoint,
-        map_data.waypoint_indices.at(i)
-      };
-    }
-  }
+      if (!_pimpl->maps.count(*it))
+        continue;
 
-  for (std::size_t i=0; i < map_data.bi_lanes.size(); ++i)
-  {
-    if (map_data.bi_lanes.at(i).pick(p_l.x(), p_l.y()))
-    {
-      return Graph::Pick{
-        ElementType::Lane,
-        map_data.bi_indices.at(i)
-      };
-    }
-  }
+      const sf::Vector2f p =
+          _pimpl->layout->inverse_transform(*it)->transformPoint(x, y);
 
-  for (std::size_t i=0; i < map_data.mono_lanes.size(); ++i)
-  {
-    if (map_data.mono_lanes.at(i).pick(p_l.x(), p_l.y()))
-    {
-      return Graph::Pick{
-        ElementType::Lane,
-        map_data.mono_indices.at(i)
-      };
+      const auto chosen = _pimpl->pick(*it, Eigen::Vector2f(p.x, p.y));
+      if (chosen)
+        return chosen;
     }
+
+    return rmf_utils::nullopt;
   }
 
-  return rmf_utils::nullopt;
+  if (!_pimpl->current_map)
+    return rmf_utils::nullopt;
+
+  return _pimpl->pick(*_pimpl->current_map, Eigen::Vector2f(x, y));
 }
 
 //==============================================================================
 void Graph::select(Pick chosen)
 {
-  if (_pimpl->selected)
-    _pimpl->unhighlight(*_pimpl->selected);
-
+  const auto previous = _pimpl->selected;
   _pimpl->selected = chosen;
 
-  if (_pimpl->selected)
-    _pimpl->highlight(*_pimpl->selected);
+  if (previous)
+    _pimpl->recolor(*previous);
+
+  _pimpl->recolor(chosen);
 }
 
 
 //==============================================================================
 void Graph::deselect()
 {
+  const auto previous = _pimpl->selected;
   _pimpl->selected = rmf_utils::nullopt;
+
+  if (previous)
+    _pimpl->recolor(*previous);
 }
 
 //==============================================================================
-rmf_utils::optional<Graph::Pick> Graph::selected() const
+void Graph::set_lane_states(const std::vector<LaneState>& states)
 {
-  return _pimpl->selected;
+  _pimpl->set_states(_pimpl->lane_states, states, ElementType::Lane);
 }
 
 //==============================================================================
-void Graph::draw(sf::RenderTarget& target, sf::RenderStates states) const
+void Graph::set_waypoint_states(const std::vector<WaypointState>& states)
 {
-  if (!_pimpl->current_map)
-    return;
-
-  const auto& map_data = _pimpl->data.at(*_pimpl->current_map);
-  for (const auto& s : map_data.mono_lanes)
-    target.draw(s, states);
+  _pimpl->set_states(_pimpl->waypoint_states, states, ElementType::Waypoint);
+}
 
-  for (const auto& s : map_data.bi_lanes)
-    target.draw(s, states);
+//==============================================================================
+void Graph::clear_overlay()
+{
+  set_lane_states({});
+  set_waypoint_states({});
+}
 
-  for (const auto& s : map_data.bi_lane_arrows)
-    target.draw(s, states);
+//==============================================================================
+void Graph::paint_lane(
+    const std::size_t lane, rmf_utils::optional<sf::Color> color)
+{
+  _pimpl->set_color(_pimpl->lane_colors, lane, color, ElementType::Lane);
+}
 
-  for (const auto& s : map_data.waypoints)
-    target.draw(s, states);
+//==============================================================================
+void Graph::paint_waypoint(
+    const std::size_t waypoint, rmf_utils::optional<sf::Color> color)
+{
+  _pimpl->set_color(
+        _pimpl->waypoint_colors, waypoint, color, ElementType::Waypoint);
+}
 
-  for (const auto& s : map_data.waypoints_text)
-    target.draw(s.second, states);
+//==============================================================================
+void Graph::clear_paint()
+{
+  _pimpl->clear_colors(_pimpl->lane_colors, ElementType::Lane);
+  _pimpl->clear_colors(_pimpl->waypoint_colors, ElementType::Waypoint);
+}
 
-  for (const auto& s : map_data.connector_waypoints_text)
-    target.draw(s.second, states);
+//==============================================================================
+rmf_utils::optional<Graph::Pick> Graph::selected() const
+{
+  return _pimpl->selected;
 }
 
-void Graph::set_text_size(uint sz)
+//==============================================================================
+void Graph::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
-  for (auto& iter : _pimpl->data)
+  if (_pimpl->layout)
   {
-    auto& map_data = iter.second;
-    for (auto& s : map_data.waypoints_text)
+    for (const auto& level : _pimpl->layout->levels())
     {
-      sf::Text& text = s.second;
-      text.setCharacterSize(sz);
+      if (!_pimpl->maps.count(level))
+        continue;
 
-      sf::FloatRect text_rect = text.getLocalBounds();
-      text.setOrigin(text_rect.width * 0.5f, text_rect.height * 0.5f);
+      sf::RenderStates level_states = states;
+      level_states.transform *= *_pimpl->layout->transform(level);
+      _pimpl->draw(level, target, level_states);
     }
 
-    for (auto& s : map_data.connector_waypoints_text)
+    if (!_pimpl->connector_vertices.empty())
     {
-      sf::Text& text = s.second;
-      text.setCharacterSize(sz);
-
-      sf::FloatRect text_rect = text.getLocalBounds();
-      text.setOrigin(text_rect.width * 0.5f, text_rect.height * 0.5f);
-      
-      sf::Text& parent_text = map_data.waypoints_text[s.first];
-      sf::FloatRect parent_rect = parent_text.getLocalBounds();
-      sf::Vector2f pos = parent_text.getPosition();
-      text.setPosition(pos.x, pos.y + parent_rect.height * gTextScale.y); 
+      target.draw(
+            _pimpl->connector_vertices.data(),
+            _pimpl->connector_vertices.size(),
+            sf::Lines, states);
     }
+
+    return;
+  }
+
+  if (!_pimpl->current_map)
+    return;
+
+  _pimpl->draw(*_pimpl->current_map, target, states);
+}
+
+void Graph::set_text_size(uint sz)
+{
+  _pimpl->text_size = sz;
+  for (auto& iter : _pimpl->maps)
+  {
+    if (iter.second.data)
+      resize_texts(*iter.second.data, sz);
   }
 }
 
 std::vector<std::string> Graph::get_map_names()
 {
   std::vector<std::string> names;
-  for (auto& s : _pimpl->data)
+  for (auto& s : _pimpl->maps)
     names.push_back(s.first);
   return names;
 }
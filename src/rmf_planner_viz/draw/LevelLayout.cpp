@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <rmf_planner_viz/draw/LevelLayout.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+//==============================================================================
+class LevelLayout::Implementation
+{
+public:
+
+  std::vector<std::string> levels;
+  std::unordered_map<std::string, std::size_t> index;
+  std::vector<sf::Transform> transforms;
+  std::vector<sf::Transform> inverses;
+  Fit::Bounds level_bounds;
+  Fit::Bounds bounds;
+
+  void add_level(std::string level, const sf::Transform& transform)
+  {
+    index[level] = levels.size();
+    levels.push_back(std::move(level));
+    transforms.push_back(transform);
+    inverses.push_back(transform.getInverse());
+    bounds.add_bounds(transform_bounds(transforms.back(), level_bounds));
+  }
+
+  static Fit::Bounds transform_bounds(
+      const sf::Transform& transform,
+      const Fit::Bounds& input)
+  {
+    Fit::Bounds output;
+    if (input.max.x() < input.min.x() || input.max.y() < input.min.y())
+      return output;
+
+    for (const float x : {input.min.x(), input.max.x()})
+    {
+      for (const float y : {input.min.y(), input.max.y()})
+      {
+        const sf::Vector2f p = transform.transformPoint(x, y);
+        output.add_point({p.x, p.y});
+      }
+    }
+
+    return output;
+  }
+};
+
+//==============================================================================
+LevelLayout::LevelLayout()
+  : _pimpl(rmf_utils::make_impl<Implementation>())
+{
+  // Do nothing
+}
+
+//==============================================================================
+LevelLayout LevelLayout::tiles(
+    std::vector<std::string> levels,
+    const Fit::Bounds& bounds,
+    std::size_t columns,
+    const float gap)
+{
+  if (columns == 0)
+  {
+    columns = static_cast<std::size_t>(
+          std::ceil(std::sqrt(static_cast<double>(levels.size()))));
+    columns = std::max<std::size_t>(columns, 1);
+  }
+
+  const Eigen::Vector2f size = bounds.max - bounds.min;
+
+  LevelLayout layout;
+  layout._pimpl->level_bounds = bounds;
+  for (std::size_t i=0; i < levels.size(); ++i)
+  {
+    const float column = static_cast<float>(i % columns);
+    const float row = static_cast<float>(i / columns);
+
+    // The map y axis points up, so later rows go towards negative y
+    sf::Transform transform;
+    transform.translate(column*(size.x() + gap), -row*(size.y() + gap));
+    layout._pimpl->add_level(std::move(levels[i]), transform);
+  }
+
+  return layout;
+}
+
+//==============================================================================
+LevelLayout LevelLayout::stack(
+    std::vector<std::string> levels,
+    const Fit::Bounds& bounds,
+    const float z_offset,
+    const float squash,
+    const float skew)
+{
+  const float height = bounds.max.y() - bounds.min.y();
+  const float y0 = bounds.min.y();
+
+  LevelLayout layout;
+  layout._pimpl->level_bounds = bounds;
+  for (std::size_t i=0; i < levels.size(); ++i)
+  {
+    const float raise = static_cast<float>(i)*z_offset*height;
+
+    // x' = x + skew*(y - y0)
+    // y' = y0 + squash*(y - y0) + raise
+    const sf::Transform transform(
+          1.0, skew, -skew*y0,
+          0.0, squash, y0 - squash*y0 + raise,
+          0.0, 0.0, 1.0);
+
+    layout._pimpl->add_level(std::move(levels[i]), transform);
+  }
+
+  return layout;
+}
+
+//==============================================================================
+const std::vector<std::string>& LevelLayout::levels() const
+{
+  return _pimpl->levels;
+}
+
+//==============================================================================
+const sf::Transform* LevelLayout::transform(const std::string& level) const
+{
+  const auto it = _pimpl->index.find(level);
+  if (it == _pimpl->index.end())
+    return nullptr;
+
+  return &_pimpl->transforms[it->second];
+}
+
+//==============================================================================
+const sf::Transform* LevelLayout::inverse_transform(
+    const std::string& level) const
+{
+  const auto it = _pimpl->index.find(level);
+  if (it == _pimpl->index.end())
+    return nullptr;
+
+  return &_pimpl->inverses[it->second];
+}
+
+//==============================================================================
+const Fit::Bounds& LevelLayout::bounds() const
+{
+  return _pimpl->bounds;
+}
+
+//==============================================================================
+Fit::Bounds LevelLayout::transform_bounds(
+    const std::string& level,
+    const Fit::Bounds& bounds) const
+{
+  const auto* tf = transform(level);
+  if (!tf)
+    return Fit::Bounds();
+
+  return Implementation::transform_bounds(*tf, bounds);
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -40,9 +40,13 @@ public:
   {
     rmf_traffic::schedule::ParticipantId participant;
     rmf_traffic::RouteId route_id;
+    std::string map;
     Trajectory trajectory;
   };
 
+  // When set, the routes of every level of the layout are drawn
+  rmf_utils::optional<LevelLayout> layout;
+
   mutable std::vector<RenderData> data;
   mutable Fit::Bounds bounds;
 
@@ -115,6 +119,7 @@ public:
             RenderData{
               v.participant,
               v.route_id,
+              v.route.map(),
               Trajectory(
                 v.route.trajectory(),
                 v.description.profile(),
@@ -125,7 +130,12 @@ public:
                 width)
             });
 
-      bounds.add_bounds(data.back().trajectory.bounds());
+      const auto& render = data.back();
+      if (layout)
+        bounds.add_bounds(
+              layout->transform_bounds(render.map, render.trajectory.bounds()));
+      else
+        bounds.add_bounds(render.trajectory.bounds());
     }
   }
 };
@@ -163,14 +173,38 @@ Schedule& Schedule::participants(
 //==============================================================================
 Schedule& Schedule::choose_map(const std::string& name)
 {
-  if (_pimpl->spacetime.timespan()->maps().count(name))
+  const auto& maps = _pimpl->spacetime.timespan()->maps();
+  if (!_pimpl->layout && maps.size() == 1 && maps.count(name))
     return *this;
 
+  _pimpl->layout = rmf_utils::nullopt;
   _pimpl->spacetime.timespan()->clear_maps().add_map(name);
   _pimpl->dirty = true;
   return *this;
 }
 
+//==============================================================================
+Schedule& Schedule::choose_maps(LevelLayout layout)
+{
+  auto& timespan = *_pimpl->spacetime.timespan();
+  timespan.clear_maps();
+  for (const auto& level : layout.levels())
+    timespan.add_map(level);
+
+  _pimpl->layout = std::move(layout);
+  _pimpl->dirty = true;
+  return *this;
+}
+
+//==============================================================================
+const LevelLayout* Schedule::layout() const
+{
+  if (_pimpl->layout)
+    return &_pimpl->layout.value();
+
+  return nullptr;
+}
+
 //==============================================================================
 const std::string& Schedule::current_map() const
 {
@@ -206,7 +240,17 @@ rmf_utils::optional<Schedule::Pick> Schedule::pick(float x, float y) const
 {
   for (const auto& t : _pimpl->data)
   {
-    if (t.trajectory.pick(x, y))
+    sf::Vector2f p(x, y);
+    if (_pimpl->layout)
+    {
+      const auto* inverse = _pimpl->layout->inverse_transform(t.map);
+      if (!inverse)
+        continue;
+
+      p = inverse->transformPoint(p);
+    }
+
+    if (t.trajectory.pick(p.x, p.y))
       return Pick{t.participant, t.route_id};
   }
 
@@ -218,7 +262,21 @@ void Schedule::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
   _pimpl->prepare();
   for (const auto& t : _pimpl->data)
-    target.draw(t.trajectory, states);
+  {
+    if (!_pimpl->layout)
+    {
+      target.draw(t.trajectory, states);
+      continue;
+    }
+
+    const auto* transform = _pimpl->layout->transform(t.map);
+    if (!transform)
+      continue;
+
+    sf::RenderStates level_states = states;
+    level_states.transform *= *transform;
+    target.draw(t.trajectory, level_states);
+  }
 }
 
 } // namespace draw
@@ -0,0 +1,535 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "internal_GraphCache.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+//==============================================================================
+// Bump this whenever the layout of the file or of any GraphMapData record
+// changes so that stale caches get rebuilt instead of misread.
+const std::uint32_t CacheFormatVersion = 2;
+const char CacheMagic[8] = {'R', 'M', 'F', 'V', 'G', 'R', 'P', 'H'};
+
+//==============================================================================
+struct Section
+{
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+
+//==============================================================================
+struct FileHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t map_count;
+  std::uint64_t hash;
+  std::uint64_t file_size;
+};
+
+//==============================================================================
+struct MapEntry
+{
+  Section name;
+  Section waypoint_index;
+  Section waypoint_x;
+  Section waypoint_y;
+  Section lane_index;
+  Section lane_x0;
+  Section lane_y0;
+  Section lane_x1;
+  Section lane_y1;
+  Section lane_bidirectional;
+  Section labels;
+  Section label_text;
+};
+
+//==============================================================================
+std::uint64_t align(std::uint64_t offset)
+{
+  return (offset + 7) & ~std::uint64_t(7);
+}
+
+//==============================================================================
+class Hasher
+{
+public:
+
+  // FNV-1a
+  Hasher& add(const void* data, std::size_t size)
+  {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i=0; i < size; ++i)
+    {
+      _value ^= bytes[i];
+      _value *= 1099511628211ull;
+    }
+
+    return *this;
+  }
+
+  template<typename T>
+  Hasher& add(const T& value)
+  {
+    static_assert(std::is_arithmetic<T>::value, "only hash plain numbers");
+    return add(&value, sizeof(T));
+  }
+
+  Hasher& add(const std::string& value)
+  {
+    add<std::uint64_t>(value.size());
+    return add(value.data(), value.size());
+  }
+
+  std::uint64_t value() const
+  {
+    return _value;
+  }
+
+private:
+  std::uint64_t _value = 14695981039346656037ull;
+};
+
+//==============================================================================
+class Writer
+{
+public:
+
+  template<typename T>
+  Section add(const std::vector<T>& data)
+  {
+    return add(data.data(), data.size());
+  }
+
+  template<typename T>
+  Section add(const T* data, std::size_t count)
+  {
+    const std::uint64_t offset = align(_tail);
+    const std::uint64_t size = count*sizeof(T);
+    _blobs.push_back({offset, data, size});
+    _tail = offset + size;
+    return Section{offset, count};
+  }
+
+  void reserve_header(std::size_t size)
+  {
+    _tail = size;
+  }
+
+  std::vector<char> finish(const void* header, std::size_t header_size) const
+  {
+    std::vector<char> buffer(_tail, 0);
+    std::memcpy(buffer.data(), header, header_size);
+    for (const auto& blob : _blobs)
+    {
+      if (blob.size > 0)
+        std::memcpy(buffer.data() + blob.offset, blob.data, blob.size);
+    }
+
+    return buffer;
+  }
+
+  std::uint64_t size() const
+  {
+    return _tail;
+  }
+
+private:
+  struct Blob
+  {
+    std::uint64_t offset;
+    const void* data;
+    std::uint64_t size;
+  };
+
+  std::vector<Blob> _blobs;
+  std::uint64_t _tail = 0;
+};
+
+} // anonymous namespace
+
+//==============================================================================
+class MappedFile
+{
+public:
+
+  explicit MappedFile(const std::string& filename)
+  {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+      void* const ptr = ::mmap(
+            nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (ptr != MAP_FAILED)
+      {
+        _data = static_cast<const char*>(ptr);
+        _size = static_cast<std::uint64_t>(info.st_size);
+      }
+    }
+
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile()
+  {
+    if (_data)
+      ::munmap(const_cast<char*>(_data), _size);
+  }
+
+  const char* data() const
+  {
+    return _data;
+  }
+
+  std::uint64_t size() const
+  {
+    return _size;
+  }
+
+  template<typename T>
+  bool valid(const Section& section) const
+  {
+    if (section.offset % alignof(T) != 0)
+      return false;
+
+    if (section.count > _size / sizeof(T))
+      return false;
+
+    return section.offset <= _size - section.count*sizeof(T);
+  }
+
+  template<typename T>
+  void copy(const Section& section, std::vector<T>& output) const
+  {
+    const T* begin = reinterpret_cast<const T*>(_data + section.offset);
+    output.assign(begin, begin + section.count);
+  }
+
+private:
+  const char* _data = nullptr;
+  std::uint64_t _size = 0;
+};
+
+namespace {
+
+//==============================================================================
+bool valid_entry(const MappedFile& file, const MapEntry& entry)
+{
+  const auto waypoints = entry.waypoint_index.count;
+  const auto lanes = entry.lane_index.count;
+
+  return file.valid<char>(entry.name)
+      && file.valid<std::uint64_t>(entry.waypoint_index)
+      && file.valid<float>(entry.waypoint_x)
+      && file.valid<float>(entry.waypoint_y)
+      && file.valid<std::uint64_t>(entry.lane_index)
+      && file.valid<float>(entry.lane_x0)
+      && file.valid<float>(entry.lane_y0)
+      && file.valid<float>(entry.lane_x1)
+      && file.valid<float>(entry.lane_y1)
+      && file.valid<std::uint8_t>(entry.lane_bidirectional)
+      && file.valid<GraphMapData::Label>(entry.labels)
+      && file.valid<char>(entry.label_text)
+      && entry.waypoint_x.count == waypoints
+      && entry.waypoint_y.count == waypoints
+      && entry.lane_x0.count == lanes
+      && entry.lane_y0.count == lanes
+      && entry.lane_x1.count == lanes
+      && entry.lane_y1.count == lanes
+      && entry.lane_bidirectional.count == lanes;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+std::uint64_t compute_graph_render_hash(
+    const rmf_traffic::agv::Graph& graph,
+    const float lane_width,
+    const sf::Font& font,
+    const unsigned int character_size)
+{
+  Hasher hasher;
+  hasher
+      .add(CacheFormatVersion)
+      .add(lane_width)
+      .add(character_size);
+
+  hasher.add<std::uint64_t>(graph.num_waypoints());
+  for (std::size_t i=0; i < graph.num_waypoints(); ++i)
+  {
+    const auto& wp = graph.get_waypoint(i);
+    hasher
+        .add(wp.get_map_name())
+        .add(wp.get_location().x())
+        .add(wp.get_location().y())
+        .add<std::uint8_t>(wp.name() ? 1 : 0);
+
+    if (wp.name())
+      hasher.add(*wp.name());
+  }
+
+  hasher.add<std::uint64_t>(graph.num_lanes());
+  for (std::size_t i=0; i < graph.num_lanes(); ++i)
+  {
+    const auto& lane = graph.get_lane(i);
+    hasher
+        .add<std::uint64_t>(lane.entry().waypoint_index())
+        .add<std::uint64_t>(lane.exit().waypoint_index());
+  }
+
+  // Labels are made of waypoint names, map names, indices and the
+  // punctuation around them
+  std::set<sf::Uint32> characters;
+  for (const char c : std::string("0123456789 ()[]:"))
+    characters.insert(static_cast<unsigned char>(c));
+
+  for (std::size_t i=0; i < graph.num_waypoints(); ++i)
+  {
+    const auto& wp = graph.get_waypoint(i);
+    for (const char c : wp.get_map_name())
+      characters.insert(static_cast<unsigned char>(c));
+
+    if (wp.name())
+    {
+      for (const char c : *wp.name())
+        characters.insert(static_cast<unsigned char>(c));
+    }
+  }
+
+  hasher.add(font.getLineSpacing(character_size));
+  for (const auto c : characters)
+  {
+    const sf::Glyph& glyph = font.getGlyph(c, character_size, false);
+    hasher
+        .add(c)
+        .add(glyph.advance)
+        .add(glyph.bounds.left)
+        .add(glyph.bounds.top)
+        .add(glyph.bounds.width)
+        .add(glyph.bounds.height);
+
+    for (const auto next : characters)
+      hasher.add(font.getKerning(c, next, character_size));
+  }
+
+  return hasher.value();
+}
+
+//==============================================================================
+bool write_graph_render_cache(
+    const std::string& filename,
+    const std::uint64_t hash,
+    const std::map<std::string, const GraphMapData*>& maps)
+{
+  std::vector<MapEntry> entries;
+  entries.reserve(maps.size());
+
+  Writer writer;
+  writer.reserve_header(sizeof(FileHeader) + maps.size()*sizeof(MapEntry));
+  for (const auto& m : maps)
+  {
+    const auto& name = m.first;
+    const auto& data = *m.second;
+
+    MapEntry entry;
+    entry.name = writer.add(name.data(), name.size());
+    entry.waypoint_index = writer.add(data.waypoints.index);
+    entry.waypoint_x = writer.add(data.waypoints.x);
+    entry.waypoint_y = writer.add(data.waypoints.y);
+    entry.lane_index = writer.add(data.lanes.index);
+    entry.lane_x0 = writer.add(data.lanes.x0);
+    entry.lane_y0 = writer.add(data.lanes.y0);
+    entry.lane_x1 = writer.add(data.lanes.x1);
+    entry.lane_y1 = writer.add(data.lanes.y1);
+    entry.lane_bidirectional = writer.add(data.lanes.bidirectional);
+    entry.labels = writer.add(data.labels);
+    entry.label_text =
+        writer.add(data.label_text.data(), data.label_text.size());
+    entries.push_back(entry);
+  }
+
+  std::vector<char> header(sizeof(FileHeader) + entries.size()*sizeof(MapEntry));
+  FileHeader file_header;
+  std::memcpy(file_header.magic, CacheMagic, sizeof(CacheMagic));
+  file_header.version = CacheFormatVersion;
+  file_header.map_count = static_cast<std::uint32_t>(entries.size());
+  file_header.hash = hash;
+  file_header.file_size = writer.size();
+  std::memcpy(header.data(), &file_header, sizeof(FileHeader));
+  if (!entries.empty())
+  {
+    std::memcpy(header.data() + sizeof(FileHeader), entries.data(),
+      entries.size()*sizeof(MapEntry));
+  }
+
+  const std::vector<char> buffer = writer.finish(header.data(), header.size());
+
+  // Write to a temporary file first so that a reader never maps a partially
+  // written cache.
+  const std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream output(tmp_filename, std::ios::binary | std::ios::trunc);
+    if (!output)
+      return false;
+
+    output.write(buffer.data(), buffer.size());
+    if (!output)
+      return false;
+  }
+
+  return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+}
+
+//==============================================================================
+std::unique_ptr<GraphRenderCache> GraphRenderCache::open(
+    const std::string& filename,
+    const std::uint64_t hash)
+{
+  auto file = std::make_unique<MappedFile>(filename);
+  if (!file->data() || file->size() < sizeof(FileHeader))
+    return nullptr;
+
+  FileHeader header;
+  std::memcpy(&header, file->data(), sizeof(FileHeader));
+  if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0)
+    return nullptr;
+
+  if (header.version != CacheFormatVersion || header.hash != hash)
+    return nullptr;
+
+  if (header.file_size != file->size())
+    return nullptr;
+
+  if ((file->size() - sizeof(FileHeader))/sizeof(MapEntry) < header.map_count)
+    return nullptr;
+
+  std::unique_ptr<GraphRenderCache> cache(
+        new GraphRenderCache(std::move(file)));
+
+  const auto* entries = reinterpret_cast<const MapEntry*>(
+        cache->_file->data() + sizeof(FileHeader));
+  for (std::uint32_t i=0; i < header.map_count; ++i)
+  {
+    const MapEntry& entry = entries[i];
+    if (!valid_entry(*cache->_file, entry))
+      return nullptr;
+
+    cache->_entries[std::string(
+          cache->_file->data() + entry.name.offset, entry.name.count)] = i;
+  }
+
+  return cache;
+}
+
+//==============================================================================
+GraphRenderCache::GraphRenderCache(std::unique_ptr<MappedFile> file)
+  : _file(std::move(file))
+{
+  // Do nothing
+}
+
+//==============================================================================
+GraphRenderCache::~GraphRenderCache() = default;
+
+//==============================================================================
+bool GraphRenderCache::contains(const std::string& map) const
+{
+  return _entries.count(map) > 0;
+}
+
+//==============================================================================
+bool GraphRenderCache::read(
+    const std::string& map,
+    const std::size_t num_waypoints,
+    const std::size_t num_lanes,
+    GraphMapData& data) const
+{
+  const auto it = _entries.find(map);
+  if (it == _entries.end())
+    return false;
+
+  const auto* entries =
+      reinterpret_cast<const MapEntry*>(_file->data() + sizeof(FileHeader));
+  const MapEntry& entry = entries[it->second];
+
+  _file->copy(entry.waypoint_index, data.waypoints.index);
+  _file->copy(entry.waypoint_x, data.waypoints.x);
+  _file->copy(entry.waypoint_y, data.waypoints.y);
+  _file->copy(entry.lane_index, data.lanes.index);
+  _file->copy(entry.lane_x0, data.lanes.x0);
+  _file->copy(entry.lane_y0, data.lanes.y0);
+  _file->copy(entry.lane_x1, data.lanes.x1);
+  _file->copy(entry.lane_y1, data.lanes.y1);
+  _file->copy(entry.lane_bidirectional, data.lanes.bidirectional);
+  _file->copy(entry.labels, data.labels);
+  data.label_text.assign(
+        _file->data() + entry.label_text.offset, entry.label_text.count);
+
+  // The hash only covers the graph, so the indices of a damaged file can
+  // still point past the end of it
+  for (const auto index : data.waypoints.index)
+  {
+    if (num_waypoints <= index)
+      return false;
+  }
+
+  for (const auto index : data.lanes.index)
+  {
+    if (num_lanes <= index)
+      return false;
+  }
+
+  for (const auto& label : data.labels)
+  {
+    const std::uint64_t end =
+        std::uint64_t(label.text_offset) + label.text_length;
+    if (data.label_text.size() < end)
+      return false;
+
+    if (label.parent != GraphMapData::NoParent
+        && data.labels.size() <= label.parent)
+      return false;
+  }
+
+  data.labels_laid_out = true;
+  return true;
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
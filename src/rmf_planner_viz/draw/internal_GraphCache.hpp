@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef SRC__RMF_PLANNER_VIZ__DRAW__INTERNAL_GRAPHCACHE_HPP
+#define SRC__RMF_PLANNER_VIZ__DRAW__INTERNAL_GRAPHCACHE_HPP
+
+#include <rmf_traffic/agv/Graph.hpp>
+
+#include <SFML/Graphics/Font.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/Graphics/Text.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+//==============================================================================
+/// The render data of one map of a Graph. Waypoints and lanes are kept as
+/// structures of arrays so that picking and recoloring run over contiguous
+/// memory. The vertices are generated from those arrays, and only the arrays
+/// and the labels are written to a render cache file.
+struct GraphMapData
+{
+  /// One entry per waypoint that is drawn on this map
+  struct Waypoints
+  {
+    std::vector<std::uint64_t> index;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<sf::Color> color;
+
+    std::size_t size() const
+    {
+      return index.size();
+    }
+  };
+
+  /// One entry per lane that is drawn on this map. A bidirectional pair of
+  /// lanes is drawn once, under the index of the lane that comes first in the
+  /// graph.
+  struct Lanes
+  {
+    std::vector<std::uint64_t> index;
+    std::vector<float> x0;
+    std::vector<float> y0;
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<std::uint8_t> bidirectional;
+    std::vector<sf::Color> entry_color;
+    std::vector<sf::Color> exit_color;
+
+    std::size_t size() const
+    {
+      return index.size();
+    }
+  };
+
+  static constexpr std::uint32_t NoParent =
+      std::numeric_limits<std::uint32_t>::max();
+
+  struct Label
+  {
+    std::uint64_t waypoint;
+    float x;
+    float y;
+    float origin_x;
+    float origin_y;
+    std::uint32_t text_offset;
+    std::uint32_t text_length;
+
+    /// Index of the waypoint label that a connector label is placed under, or
+    /// NoParent if this is a waypoint label.
+    std::uint32_t parent;
+    std::uint32_t padding;
+  };
+
+  Waypoints waypoints;
+  Lanes lanes;
+  std::vector<Label> labels;
+  std::string label_text;
+
+  /// Label origins depend on the font, so they can only be computed on the
+  /// thread that owns it. Tessellation leaves them at zero and clears this
+  /// flag. Data read from a cache always has its labels laid out.
+  bool labels_laid_out = false;
+
+  /// Generated from the arrays above with a fixed number of vertices per lane
+  /// and per waypoint, so element i always starts at the same offset. These
+  /// are never written to the cache: they are about 25 times larger than the
+  /// arrays, and copying them out of the file is no faster than generating
+  /// them, since both write every vertex. Recoloring edits them, so they could
+  /// not be drawn straight out of the read-only mapping either.
+  std::vector<sf::Vertex> lane_vertices;
+  std::vector<sf::Vertex> arrow_vertices;
+  std::vector<sf::Vertex> waypoint_vertices;
+
+  /// Built from labels. sf::Text holds pointers to the font, so these are
+  /// never written to the cache.
+  std::vector<sf::Text> texts;
+};
+
+//==============================================================================
+/// Compute a hash of everything that the render data of a graph depends on.
+/// A render cache is only used if its hash matches. Label layout depends on
+/// the metrics of the font rather than its name, so the glyphs and kerning of
+/// every character that labels can contain are hashed at character_size.
+std::uint64_t compute_graph_render_hash(
+    const rmf_traffic::agv::Graph& graph,
+    float lane_width,
+    const sf::Font& font,
+    unsigned int character_size);
+
+//==============================================================================
+/// Write the render data of each map into filename. Returns false if the file
+/// could not be written.
+bool write_graph_render_cache(
+    const std::string& filename,
+    std::uint64_t hash,
+    const std::map<std::string, const GraphMapData*>& maps);
+
+class MappedFile;
+
+//==============================================================================
+/// A render cache file that stays memory-mapped so that the render data of
+/// each map can be read out of it only when that map is needed. Reading is
+/// const and may be done from several threads at once.
+class GraphRenderCache
+{
+public:
+
+  /// Map filename and validate its header and map directory. Returns nullptr
+  /// if the file is missing, corrupt, of a different format version, or was
+  /// made for a different hash.
+  static std::unique_ptr<GraphRenderCache> open(
+      const std::string& filename,
+      std::uint64_t hash);
+
+  GraphRenderCache(const GraphRenderCache&) = delete;
+  GraphRenderCache& operator=(const GraphRenderCache&) = delete;
+  ~GraphRenderCache();
+
+  /// True if the cache has render data for this map.
+  bool contains(const std::string& map) const;
+
+  /// Copy the waypoint and lane arrays and the labels of one map out of the
+  /// file. Colors and vertices are left for the caller to generate. Returns
+  /// false, leaving data in an unspecified state, if the map is not in the
+  /// cache or its data is corrupt, including when an index is out of range for
+  /// a graph with the given number of waypoints and lanes.
+  bool read(
+      const std::string& map,
+      std::size_t num_waypoints,
+      std::size_t num_lanes,
+      GraphMapData& data) const;
+
+private:
+
+  GraphRenderCache(std::unique_ptr<MappedFile> file);
+
+  std::unique_ptr<MappedFile> _file;
+  std::unordered_map<std::string, std::size_t> _entries;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // SRC__RMF_PLANNER_VIZ__DRAW__INTERNAL_GRAPHCACHE_HPP
@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "batch_ccd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+// The AVX2 kernels are always used when the whole file is built for AVX2.
+// Otherwise GCC and Clang build them for AVX2 and FMA on their own and pick
+// them at run time when the CPU has both, so the rest of the program does not
+// need to be built for AVX2.
+#if defined(__AVX2__)
+#define BATCH_CCD_AVX2
+#define BATCH_CCD_TARGET
+#ifdef __FMA__
+#define BATCH_CCD_FMA
+#endif
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BATCH_CCD_AVX2
+#define BATCH_CCD_DISPATCH
+#define BATCH_CCD_TARGET __attribute__((target("avx2,fma")))
+#define BATCH_CCD_FMA
+#endif
+
+#ifdef BATCH_CCD_AVX2
+#include <immintrin.h>
+#endif
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+// Number of circle pairs that the kernels handle at once
+const std::size_t Lanes = 4;
+
+struct Pose
+{
+  double x;
+  double y;
+  double c;
+  double s;
+};
+
+// Reach of a footprint from its robot origin
+double extent(const CircleFootprint& f)
+{
+  double e = 0.0;
+  for (std::size_t i = 0; i < f.size(); ++i)
+    e = std::max(e, std::sqrt(f.x[i] * f.x[i] + f.y[i] * f.y[i]) + f.radius[i]);
+  return e;
+}
+
+// Evaluate the uniform cubic B-spline the same way fcl::SplineMotion does,
+// including clamping t to 1. For a spline from to_fcl() the rotation vector
+// is (0, 0, yaw), which is just a rotation by yaw around z.
+Pose evaluate(const SplineMotionBatch& m, std::size_t i, double t)
+{
+  if (t > 1.0)
+    t = 1.0;
+
+  const double t2 = t * t;
+  const double t3 = t2 * t;
+  const double it = 1.0 - t;
+  const double w0 = it * it * it / 6.0;
+  const double w1 = (3.0 * t3 - 6.0 * t2 + 4.0) / 6.0;
+  const double w2 = (-3.0 * t3 + 3.0 * t2 + 3.0 * t + 1.0) / 6.0;
+  const double w3 = t3 / 6.0;
+
+  const auto blend = [&](const std::array<std::vector<double>, 4>& k)
+    {
+      return w0 * k[0][i] + w1 * k[1][i] + w2 * k[2][i] + w3 * k[3][i];
+    };
+
+  const double yaw = blend(m.yaw);
+  return Pose{blend(m.x), blend(m.y), std::cos(yaw), std::sin(yaw)};
+}
+
+// Same as compute_swept_bounds for the knots of motion i
+SweptBounds swept_bounds(
+  const SplineMotionBatch& m, std::size_t i, double extent)
+{
+  SweptBounds bounds;
+  bounds.min = Eigen::Vector2d(m.x[0][i], m.y[0][i]);
+  bounds.max = bounds.min;
+  for (std::size_t k = 1; k < 4; ++k)
+  {
+    const Eigen::Vector2d p(m.x[k][i], m.y[k][i]);
+    bounds.min = bounds.min.cwiseMin(p);
+    bounds.max = bounds.max.cwiseMax(p);
+  }
+
+  bounds.min.array() -= extent;
+  bounds.max.array() += extent;
+  return bounds;
+}
+
+#ifdef BATCH_CCD_AVX2
+BATCH_CCD_TARGET inline __m256d madd(__m256d a, __m256d b, __m256d c)
+{
+#ifdef BATCH_CCD_FMA
+  return _mm256_fmadd_pd(a, b, c);
+#else
+  return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+
+BATCH_CCD_TARGET inline __m256d nmadd(__m256d a, __m256d b, __m256d c)
+{
+#ifdef BATCH_CCD_FMA
+  return _mm256_fnmadd_pd(a, b, c);
+#else
+  return _mm256_sub_pd(c, _mm256_mul_pd(a, b));
+#endif
+}
+
+// World space vector from the B circle to the A circle of pairs [p, p+4)
+BATCH_CCD_TARGET inline void center_delta(
+  const Pose& a, const Pose& b, const CirclePairLayout& l, std::size_t p,
+  __m256d& dx, __m256d& dy)
+{
+  const __m256d aox = _mm256_loadu_pd(&l.aox[p]);
+  const __m256d aoy = _mm256_loadu_pd(&l.aoy[p]);
+  const __m256d box = _mm256_loadu_pd(&l.box[p]);
+  const __m256d boy = _mm256_loadu_pd(&l.boy[p]);
+
+  const __m256d ax = madd(_mm256_set1_pd(a.c), aox,
+      nmadd(_mm256_set1_pd(a.s), aoy, _mm256_set1_pd(a.x)));
+  const __m256d ay = madd(_mm256_set1_pd(a.s), aox,
+      madd(_mm256_set1_pd(a.c), aoy, _mm256_set1_pd(a.y)));
+  const __m256d bx = madd(_mm256_set1_pd(b.c), box,
+      nmadd(_mm256_set1_pd(b.s), boy, _mm256_set1_pd(b.x)));
+  const __m256d by = madd(_mm256_set1_pd(b.s), box,
+      madd(_mm256_set1_pd(b.c), boy, _mm256_set1_pd(b.y)));
+
+  dx = _mm256_sub_pd(ax, bx);
+  dy = _mm256_sub_pd(ay, by);
+}
+
+// min_distance for four circle pairs at a time
+BATCH_CCD_TARGET double min_distance_avx2(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double& d_x, double& d_y)
+{
+  double best = DBL_MAX;
+  d_x = 0.0;
+  d_y = 0.0;
+
+  __m256d best_v = _mm256_set1_pd(DBL_MAX);
+  __m256d best_dx = _mm256_setzero_pd();
+  __m256d best_dy = _mm256_setzero_pd();
+  __m256d best_i = _mm256_setzero_pd();
+  for (std::size_t p = 0; p < l.n; p += Lanes)
+  {
+    __m256d dx, dy;
+    center_delta(a, b, l, p, dx, dy);
+    const __m256d dist = _mm256_sub_pd(
+      _mm256_sqrt_pd(madd(dx, dx, _mm256_mul_pd(dy, dy))),
+      _mm256_loadu_pd(&l.rsum[p]));
+
+    const __m256d closer = _mm256_cmp_pd(dist, best_v, _CMP_LT_OQ);
+    const __m256d index = _mm256_set_pd(p + 3.0, p + 2.0, p + 1.0, p + 0.0);
+    best_v = _mm256_blendv_pd(best_v, dist, closer);
+    best_dx = _mm256_blendv_pd(best_dx, dx, closer);
+    best_dy = _mm256_blendv_pd(best_dy, dy, closer);
+    best_i = _mm256_blendv_pd(best_i, index, closer);
+  }
+
+  alignas(32) double v[Lanes], x[Lanes], y[Lanes], i[Lanes];
+  _mm256_store_pd(v, best_v);
+  _mm256_store_pd(x, best_dx);
+  _mm256_store_pd(y, best_dy);
+  _mm256_store_pd(i, best_i);
+  double best_index = DBL_MAX;
+  for (std::size_t k = 0; k < Lanes; ++k)
+  {
+    if (v[k] < best || (v[k] == best && i[k] < best_index))
+    {
+      best = v[k];
+      best_index = i[k];
+      d_x = x[k];
+      d_y = y[k];
+    }
+  }
+
+  return best;
+}
+
+// min_distance_along for four circle pairs at a time
+BATCH_CCD_TARGET double min_distance_along_avx2(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double dn_x, double dn_y)
+{
+  __m256d best_v = _mm256_set1_pd(DBL_MAX);
+  const __m256d nx = _mm256_set1_pd(dn_x);
+  const __m256d ny = _mm256_set1_pd(dn_y);
+  const __m256d eps = _mm256_set1_pd(1e-04);
+  for (std::size_t p = 0; p < l.n; p += Lanes)
+  {
+    __m256d dx, dy;
+    center_delta(a, b, l, p, dx, dy);
+    const __m256d dist = _mm256_sqrt_pd(madd(dx, dx, _mm256_mul_pd(dy, dy)));
+    const __m256d gap = _mm256_sub_pd(dist, _mm256_loadu_pd(&l.rsum[p]));
+    const __m256d proj = madd(dx, nx, _mm256_mul_pd(dy, ny));
+    const __m256d s = _mm256_div_pd(_mm256_mul_pd(gap, proj), dist);
+    const __m256d apart = _mm256_cmp_pd(dist, eps, _CMP_GT_OQ);
+    best_v = _mm256_min_pd(best_v, _mm256_and_pd(apart, s));
+  }
+
+  alignas(32) double v[Lanes];
+  _mm256_store_pd(v, best_v);
+  return std::min(std::min(v[0], v[1]), std::min(v[2], v[3]));
+}
+#endif
+
+// min_distance for one circle pair at a time
+double min_distance_scalar(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double& d_x, double& d_y)
+{
+  double best = DBL_MAX;
+  d_x = 0.0;
+  d_y = 0.0;
+
+  for (std::size_t p = 0; p < l.n; ++p)
+  {
+    const double ax = a.x + a.c * l.aox[p] - a.s * l.aoy[p];
+    const double ay = a.y + a.s * l.aox[p] + a.c * l.aoy[p];
+    const double bx = b.x + b.c * l.box[p] - b.s * l.boy[p];
+    const double by = b.y + b.s * l.box[p] + b.c * l.boy[p];
+    const double dx = ax - bx;
+    const double dy = ay - by;
+    const double dist = std::sqrt(dx * dx + dy * dy) - l.rsum[p];
+    if (dist < best)
+    {
+      best = dist;
+      d_x = dx;
+      d_y = dy;
+    }
+  }
+
+  return best;
+}
+
+// min_distance_along for one circle pair at a time
+double min_distance_along_scalar(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double dn_x, double dn_y)
+{
+  double best = DBL_MAX;
+  for (std::size_t p = 0; p < l.n; ++p)
+  {
+    const double ax = a.x + a.c * l.aox[p] - a.s * l.aoy[p];
+    const double ay = a.y + a.s * l.aox[p] + a.c * l.aoy[p];
+    const double bx = b.x + b.c * l.box[p] - b.s * l.boy[p];
+    const double by = b.y + b.s * l.box[p] + b.c * l.boy[p];
+    const double dx = ax - bx;
+    const double dy = ay - by;
+    const double dist = std::sqrt(dx * dx + dy * dy);
+    double s = 0.0;
+    if (dist > 1e-04)
+      s = (dist - l.rsum[p]) * (dx * dn_x + dy * dn_y) / dist;
+
+    if (s < best)
+      best = s;
+  }
+  return best;
+}
+
+#ifdef BATCH_CCD_DISPATCH
+// Checked once when the program starts
+bool cpu_has_avx2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+const bool use_avx2 = cpu_has_avx2();
+#elif defined(BATCH_CCD_AVX2)
+const bool use_avx2 = true;
+#endif
+
+// Smallest gap between any two circles, and the vector from the B circle to
+// the A circle of the first pair that has it
+double min_distance(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double& d_x, double& d_y)
+{
+#ifdef BATCH_CCD_AVX2
+  if (use_avx2)
+    return min_distance_avx2(a, b, l, d_x, d_y);
+#endif
+  return min_distance_scalar(a, b, l, d_x, d_y);
+}
+
+// Smallest gap between any two circles, measured along the unit direction
+// (dn_x, dn_y). Pairs whose centers coincide count as 0.
+double min_distance_along(
+  const Pose& a, const Pose& b, const CirclePairLayout& l,
+  double dn_x, double dn_y)
+{
+#ifdef BATCH_CCD_AVX2
+  if (use_avx2)
+    return min_distance_along_avx2(a, b, l, dn_x, dn_y);
+#endif
+  return min_distance_along_scalar(a, b, l, dn_x, dn_y);
+}
+
+// Mirrors max_splinemotion_advancement in test_sidecar_utils.cpp
+double max_advancement(
+  double current_t,
+  const CcdPairBatch& batch, std::size_t i, const CirclePairLayout& l,
+  double dn_x, double dn_y, double max_dist,
+  const CcdOptions& options, uint evaluation_limit, CcdResult& result)
+{
+  auto separation = [&](double t)
+  {
+    const Pose a = evaluate(batch.a, i, t);
+    const Pose b = evaluate(batch.b, i, t);
+    return min_distance_along(a, b, l, dn_x, dn_y);
+  };
+
+  return advancement_root(
+    current_t, max_dist, separation, options, evaluation_limit, result);
+}
+
+// Mirrors collide_seperable_circles_impl in test_sidecar_utils.cpp. Pairs
+// whose swept bounds are apart finish without any evaluations.
+void run_pair(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  std::size_t i,
+  const CcdOptions& options,
+  CcdResult& result)
+{
+  const CirclePairLayout& l =
+    layouts.at(batch.a_footprint[i], batch.b_footprint[i]);
+
+  if (l.n == 0)
+    return;
+
+  // Motions that never come within tolerance of each other need no stepping
+  if (!swept_bounds_overlap(
+      swept_bounds(batch.a, i, l.a_extent),
+      swept_bounds(batch.b, i, l.b_extent),
+      options.tolerance))
+    return;
+
+  double d_x = 0.0, d_y = 0.0;
+  double dist_along_d_to_cover = min_distance(
+    evaluate(batch.a, i, 0.0), evaluate(batch.b, i, 0.0), l, d_x, d_y);
+  ++result.evaluations;
+
+  double t = 0.0;
+  while (dist_along_d_to_cover > options.tolerance && t < 1.0)
+  {
+    if (result.evaluations + 2 > options.max_evaluations)
+    {
+      result.stop = CcdStop::Budget;
+      result.safe_time = t;
+      return;
+    }
+
+    double dn_x = d_x, dn_y = d_y;
+    const double norm = std::sqrt(d_x * d_x + d_y * d_y);
+    if (norm > 0.0)
+    {
+      dn_x /= norm;
+      dn_y /= norm;
+    }
+
+    t = max_advancement(t, batch, i, l, dn_x, dn_y,
+        dist_along_d_to_cover, options, options.max_evaluations - 1, result);
+
+    dist_along_d_to_cover = min_distance(
+      evaluate(batch.a, i, t), evaluate(batch.b, i, t), l, d_x, d_y);
+
+    ++result.evaluations;
+    ++result.iterations;
+  }
+
+  if (t >= 0.0 && t < 1.0)
+  {
+    result.collide = true;
+    result.impact_time = t;
+    result.safe_time = t;
+    result.stop = CcdStop::Contact;
+  }
+}
+
+} // anonymous namespace
+
+//==============================================================================
+CircleFootprint::CircleFootprint(const std::vector<ModelSpaceShape>& shapes)
+{
+  for (const auto& shape : shapes)
+  {
+    x.push_back(shape._transform.translation().x());
+    y.push_back(shape._transform.translation().y());
+    radius.push_back(shape._radius);
+  }
+}
+
+//==============================================================================
+void SplineMotionBatch::reserve(std::size_t n)
+{
+  for (std::size_t k = 0; k < 4; ++k)
+  {
+    x[k].reserve(n);
+    y[k].reserve(n);
+    yaw[k].reserve(n);
+  }
+}
+
+//==============================================================================
+void SplineMotionBatch::add(const std::array<Eigen::Vector3d, 4>& knots)
+{
+  for (std::size_t k = 0; k < 4; ++k)
+  {
+    x[k].push_back(knots[k][0]);
+    y[k].push_back(knots[k][1]);
+    yaw[k].push_back(knots[k][2]);
+  }
+}
+
+//==============================================================================
+void CcdPairBatch::reserve(std::size_t n)
+{
+  a.reserve(n);
+  b.reserve(n);
+  a_footprint.reserve(n);
+  b_footprint.reserve(n);
+}
+
+//==============================================================================
+void CcdPairBatch::add(
+  const std::array<Eigen::Vector3d, 4>& a_knots, std::uint32_t a_fp,
+  const std::array<Eigen::Vector3d, 4>& b_knots, std::uint32_t b_fp)
+{
+  a.add(a_knots);
+  b.add(b_knots);
+  a_footprint.push_back(a_fp);
+  b_footprint.push_back(b_fp);
+}
+
+//==============================================================================
+CirclePairLayout::CirclePairLayout(
+  const CircleFootprint& a, const CircleFootprint& b)
+: a_extent(extent(a)),
+  b_extent(extent(b))
+{
+  const std::size_t count = a.size() * b.size();
+  n = count == 0 ? 0 : ((count + Lanes - 1) / Lanes) * Lanes;
+  for (auto* v : {&aox, &aoy, &box, &boy, &rsum})
+    v->resize(n);
+
+  for (std::size_t p = 0; p < n; ++p)
+  {
+    const std::size_t q = p < count ? p : 0;
+    const std::size_t i = q / b.size();
+    const std::size_t j = q % b.size();
+    aox[p] = a.x[i];
+    aoy[p] = a.y[i];
+    box[p] = b.x[j];
+    boy[p] = b.y[j];
+    rsum[p] = a.radius[i] + b.radius[j];
+  }
+}
+
+//==============================================================================
+CcdPairLayouts::CcdPairLayouts(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints)
+{
+  prepare(batch, footprints);
+}
+
+//==============================================================================
+void CcdPairLayouts::prepare(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints)
+{
+  for (std::size_t i = 0; i < batch.size(); ++i)
+  {
+    const std::uint32_t fa = batch.a_footprint[i];
+    const std::uint32_t fb = batch.b_footprint[i];
+    assert(fa < footprints.size() && fb < footprints.size());
+
+    const std::uint64_t k = key(fa, fb);
+    if (_layouts.find(k) == _layouts.end())
+      _layouts.emplace(k, CirclePairLayout(footprints[fa], footprints[fb]));
+  }
+}
+
+//==============================================================================
+const CirclePairLayout& CcdPairLayouts::at(
+  std::uint32_t a, std::uint32_t b) const
+{
+  return _layouts.at(key(a, b));
+}
+
+//==============================================================================
+void CcdBatchResult::resize(std::size_t n)
+{
+  collide.resize(n);
+  impact_time.resize(n);
+  dist_checks.resize(n);
+  iterations.resize(n);
+  stop.resize(n);
+}
+
+//==============================================================================
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  std::size_t begin, std::size_t end,
+  const CcdOptions& options)
+{
+  assert(result.collide.size() >= batch.size());
+  assert(end <= batch.size());
+
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    CcdResult r;
+    r.safe_time = 1.0;
+    run_pair(batch, layouts, i, options, r);
+
+    result.collide[i] = r.collide;
+    result.impact_time[i] = r.impact_time;
+    result.dist_checks[i] = r.evaluations;
+    result.iterations[i] = r.iterations;
+    result.stop[i] = r.stop;
+  }
+}
+
+//==============================================================================
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  const CcdOptions& options)
+{
+  result.resize(batch.size());
+  collide_seperable_circles_batch(batch, layouts, result,
+    0, batch.size(), options);
+}
+
+//==============================================================================
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints,
+  CcdBatchResult& result,
+  const CcdOptions& options)
+{
+  collide_seperable_circles_batch(
+    batch, CcdPairLayouts(batch, footprints), result, options);
+}
+
+//==============================================================================
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  uint safety_maximum_checks, double tolerance)
+{
+  CcdOptions options;
+  options.tolerance = tolerance;
+  options.max_evaluations = safety_maximum_checks;
+  collide_seperable_circles_batch(batch, layouts, result, options);
+}
+
+//==============================================================================
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints,
+  CcdBatchResult& result,
+  uint safety_maximum_checks, double tolerance)
+{
+  collide_seperable_circles_batch(batch, CcdPairLayouts(batch, footprints),
+    result, safety_maximum_checks, tolerance);
+}
+
+//==============================================================================
+bool batch_ccd_uses_avx2()
+{
+#ifdef BATCH_CCD_AVX2
+  return use_avx2;
+#else
+  return false;
+#endif
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__BATCH_CCD_HPP
+#define RMF_PLANNER_VIZ__DRAW__BATCH_CCD_HPP
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "test_sidecar_utils.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Batched version of collide_seperable_circles. The motions are the planar
+// (x, y, yaw) uniform cubic B-splines that to_fcl() builds, but they are kept
+// as knots in structure of arrays layout and evaluated directly instead of
+// going through fcl::SplineMotion::integrate and full Transform3d products.
+
+// Circles of a footprint in the body frame of the robot
+struct CircleFootprint
+{
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> radius;
+
+  CircleFootprint() = default;
+
+  // Only the translation of each shape matters for a circle
+  explicit CircleFootprint(const std::vector<ModelSpaceShape>& shapes);
+
+  std::size_t size() const { return radius.size(); }
+};
+
+// Knots of many spline motions. Knot k of motion i is
+// (x[k][i], y[k][i], yaw[k][i]).
+struct SplineMotionBatch
+{
+  std::array<std::vector<double>, 4> x;
+  std::array<std::vector<double>, 4> y;
+  std::array<std::vector<double>, 4> yaw;
+
+  void reserve(std::size_t n);
+
+  void add(const std::array<Eigen::Vector3d, 4>& knots);
+
+  std::size_t size() const { return x[0].size(); }
+};
+
+// Pair i collides motion a[i] wearing footprints[a_footprint[i]] with motion
+// b[i] wearing footprints[b_footprint[i]]
+struct CcdPairBatch
+{
+  SplineMotionBatch a;
+  SplineMotionBatch b;
+  std::vector<std::uint32_t> a_footprint;
+  std::vector<std::uint32_t> b_footprint;
+
+  void reserve(std::size_t n);
+
+  void add(
+    const std::array<Eigen::Vector3d, 4>& a_knots, std::uint32_t a_fp,
+    const std::array<Eigen::Vector3d, 4>& b_knots, std::uint32_t b_fp);
+
+  std::size_t size() const { return a.size(); }
+};
+
+// Every combination of a circle of footprint A with a circle of footprint B,
+// padded to a multiple of the kernel width by repeating the first
+// combination. Repeats never change a minimum.
+struct CirclePairLayout
+{
+  std::size_t n = 0;
+  std::vector<double> aox;
+  std::vector<double> aoy;
+  std::vector<double> box;
+  std::vector<double> boy;
+  std::vector<double> rsum;
+
+  // Reach of each footprint from its robot origin
+  double a_extent = 0.0;
+  double b_extent = 0.0;
+
+  CirclePairLayout(const CircleFootprint& a, const CircleFootprint& b);
+};
+
+// Circle pair layouts keyed by (a footprint, b footprint). Layouts are only
+// built for the footprint pairs that a batch actually uses, and prepare()
+// skips the ones that already exist, so one instance can be kept for as long
+// as the footprints stay the same. Prepare it before handing out ranges of a
+// batch; the ranges only read it, so they can run on separate threads.
+class CcdPairLayouts
+{
+public:
+
+  CcdPairLayouts() = default;
+
+  CcdPairLayouts(
+    const CcdPairBatch& batch,
+    const std::vector<CircleFootprint>& footprints);
+
+  // Build the layouts of the footprint pairs of batch that are missing
+  void prepare(
+    const CcdPairBatch& batch,
+    const std::vector<CircleFootprint>& footprints);
+
+  // The layout of (a, b) must have been prepared
+  const CirclePairLayout& at(std::uint32_t a, std::uint32_t b) const;
+
+  std::size_t size() const { return _layouts.size(); }
+
+  // Needed whenever the footprints change
+  void clear() { _layouts.clear(); }
+
+private:
+
+  static std::uint64_t key(std::uint32_t a, std::uint32_t b)
+  {
+    return static_cast<std::uint64_t>(a) << 32 | b;
+  }
+
+  std::unordered_map<std::uint64_t, CirclePairLayout> _layouts;
+};
+
+struct CcdBatchResult
+{
+  std::vector<std::uint8_t> collide;
+  std::vector<double> impact_time;
+  std::vector<std::uint32_t> dist_checks;
+  std::vector<std::uint32_t> iterations;
+  std::vector<CcdStop> stop;
+
+  void resize(std::size_t n);
+};
+
+// Runs the same bilateral advancement as collide_seperable_circles on pairs
+// [begin, end) of the batch and writes their entries of result, which must
+// already be sized for the batch. layouts must have been prepared for the
+// batch. dist_checks receives the evaluations of each pair. Pairs whose swept
+// bounds are further than tolerance apart are reported as separated without
+// any stepping. Separate ranges can be run on separate threads with the same
+// result.
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  std::size_t begin, std::size_t end,
+  const CcdOptions& options);
+
+// Runs every pair of the batch, sizing result to match
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  const CcdOptions& options);
+
+// Prepares the layouts of the batch and runs every pair of it
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints,
+  CcdBatchResult& result,
+  const CcdOptions& options);
+
+// Shorthands for the above with only the evaluation budget and tolerance given
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const CcdPairLayouts& layouts,
+  CcdBatchResult& result,
+  uint safety_maximum_checks = 120, double tolerance = 0.001);
+
+void collide_seperable_circles_batch(
+  const CcdPairBatch& batch,
+  const std::vector<CircleFootprint>& footprints,
+  CcdBatchResult& result,
+  uint safety_maximum_checks = 120, double tolerance = 0.001);
+
+// True if the circle distance kernels run with AVX2 on this CPU
+bool batch_ccd_uses_avx2();
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__BATCH_CCD_HPP
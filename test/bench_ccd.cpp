@@ -0,0 +1,781 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+// Headless benchmark of the bilateral advancement CCD in test_sidecar_utils.
+// Every preset from setup_presets() and a set of seeded random spline pairs
+// are run through
+//   sidecar: collide_seperable_circles on fcl::SplineMotion
+//   planar:  collide_seperable_circles on SplineMotion2D
+//   bounds:  collide_seperable_circles behind the swept bounds broad phase
+//   batch:   collide_seperable_circles_batch
+//   fcl:     fcl::collide with continuous collision objects, one per circle
+//   dense:   densely sampled reference, used as the ground truth
+// and the timings, dist_checks and iteration counts are summarized. Per case
+// rows can be written as CSV and the summary as JSON to track them over time.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcl/narrowphase/continuous_collision.h>
+#include <fcl/math/motion/spline_motion.h>
+#include <fcl/geometry/bvh/BVH_model.h>
+#include <fcl/geometry/geometric_shape_to_BVH_model.h>
+#include <fcl/geometry/shape/sphere.h>
+
+#include "test_sidecar_utils.hpp"
+#include "spline_offset_utils.hpp"
+#include "batch_ccd.hpp"
+
+using namespace rmf_planner_viz::draw;
+
+namespace {
+
+using Knots = std::array<Eigen::Vector3d, 4>;
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+  std::size_t random_cases = 1000;
+  unsigned int seed = 42;
+  std::size_t repeat = 10;
+  std::size_t samples = 2000;
+  bool run_fcl = true;
+  std::string csv_file;
+  std::string json_file;
+};
+
+struct Case
+{
+  std::string name;
+  Knots knots_a;
+  Knots knots_b;
+  std::vector<ModelSpaceShape> a_shapes;
+  std::vector<ModelSpaceShape> b_shapes;
+  double tolerance;
+};
+
+struct Outcome
+{
+  bool collide = false;
+  double toi = 0.0;
+  uint dist_checks = 0;
+  uint iterations = 0;
+  double time_ns = 0.0;
+};
+
+struct Method
+{
+  std::string name;
+  bool has_counts;
+  std::vector<Outcome> outcomes;
+};
+
+void print_usage()
+{
+  std::cout
+    << "Usage: bench_ccd [options]\n"
+    << "  --random N   number of random spline pairs (default 1000)\n"
+    << "  --seed S     seed of the random pairs (default 42)\n"
+    << "  --repeat R   timed runs per case, the median is reported (default 10)\n"
+    << "  --samples S  samples of the dense reference (default 2000)\n"
+    << "  --no-fcl     skip the fcl comparison\n"
+    << "  --csv FILE   write one row per case and method\n"
+    << "  --json FILE  write the summary\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--random" && has_value)
+      options.random_cases = std::stoul(argv[++i]);
+    else if (arg == "--seed" && has_value)
+      options.seed = std::stoul(argv[++i]);
+    else if (arg == "--repeat" && has_value)
+      options.repeat = std::max<std::size_t>(1, std::stoul(argv[++i]));
+    else if (arg == "--samples" && has_value)
+      options.samples = std::max<std::size_t>(2, std::stoul(argv[++i]));
+    else if (arg == "--no-fcl")
+      options.run_fcl = false;
+    else if (arg == "--csv" && has_value)
+      options.csv_file = argv[++i];
+    else if (arg == "--json" && has_value)
+      options.json_file = argv[++i];
+    else
+      return false;
+  }
+
+  return true;
+}
+
+std::vector<Case> make_cases(const Options& options)
+{
+  std::vector<Case> cases;
+
+  // same knots as test_sidecar builds for the presets
+  const auto presets = setup_presets();
+  const Eigen::Vector3d zero(0, 0, 0);
+  for (std::size_t i = 0; i < presets.size(); ++i)
+  {
+    const auto& p = presets[i];
+    Case c;
+    c.name = "preset/" + std::to_string(i) + " " + p._description;
+    c.knots_a = compute_knots(p.a_start, p.a_end, zero, zero);
+    c.knots_b = compute_knots(p.b_start, p.b_end, p.b_vel, -p.b_vel);
+    c.a_shapes = p.a_shapes;
+    c.b_shapes = p.b_shapes;
+    c.tolerance = p.tolerance;
+    cases.push_back(std::move(c));
+  }
+
+  std::mt19937 rng(options.seed);
+  std::uniform_real_distribution<double> position(-4.0, 4.0);
+  std::uniform_real_distribution<double> step(-3.0, 3.0);
+  std::uniform_real_distribution<double> yaw(-EIGEN_PI, EIGEN_PI);
+  std::uniform_real_distribution<double> speed(-4.0, 4.0);
+  std::uniform_real_distribution<double> offset(-1.0, 1.0);
+  std::uniform_real_distribution<double> radius(0.3, 0.7);
+  std::uniform_int_distribution<int> circles(1, 3);
+
+  const auto random_shapes = [&]()
+    {
+      std::vector<ModelSpaceShape> shapes;
+      const int n = circles(rng);
+      for (int k = 0; k < n; ++k)
+      {
+        fcl::Transform3d tx;
+        tx.setIdentity();
+        if (k > 0)
+          tx.pretranslate(Eigen::Vector3d(offset(rng), offset(rng), 0));
+        shapes.emplace_back(tx, radius(rng));
+      }
+      return shapes;
+    };
+
+  const auto random_knots = [&]()
+    {
+      const Eigen::Vector3d start(position(rng), position(rng), yaw(rng));
+      const Eigen::Vector3d end =
+        start + Eigen::Vector3d(step(rng), step(rng), 0.5 * yaw(rng));
+      const Eigen::Vector3d v0(speed(rng), speed(rng), 0);
+      const Eigen::Vector3d v1(speed(rng), speed(rng), 0);
+      return compute_knots(start, end, v0, v1);
+    };
+
+  // Random robots wear one of a few footprints, like the robots of a fleet
+  std::vector<std::vector<ModelSpaceShape>> fleet;
+  for (std::size_t i = 0; i < 8; ++i)
+    fleet.push_back(random_shapes());
+
+  std::uniform_int_distribution<std::size_t> robot(0, fleet.size() - 1);
+  for (std::size_t i = 0; i < options.random_cases; ++i)
+  {
+    Case c;
+    c.name = "random/" + std::to_string(i);
+    c.knots_a = random_knots();
+    c.knots_b = random_knots();
+    c.a_shapes = fleet[robot(rng)];
+    c.b_shapes = fleet[robot(rng)];
+    c.tolerance = 0.01;
+    cases.push_back(std::move(c));
+  }
+
+  return cases;
+}
+
+double median(std::vector<double> values)
+{
+  if (values.empty())
+    return 0.0;
+
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+double percentile(std::vector<double> values, double p)
+{
+  if (values.empty())
+    return 0.0;
+
+  std::sort(values.begin(), values.end());
+  const std::size_t index = std::min(values.size() - 1,
+      static_cast<std::size_t>(p * static_cast<double>(values.size())));
+  return values[index];
+}
+
+template<typename F>
+double time_median_ns(std::size_t repeat, F&& f)
+{
+  std::vector<double> times;
+  times.reserve(repeat);
+  for (std::size_t r = 0; r < repeat; ++r)
+  {
+    const auto start = Clock::now();
+    f();
+    const auto end = Clock::now();
+    times.push_back(
+      std::chrono::duration<double, std::nano>(end - start).count());
+  }
+  return median(std::move(times));
+}
+
+//==============================================================================
+Method run_sidecar(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"sidecar", true, {}};
+  for (const auto& c : cases)
+  {
+    auto motion_a = to_fcl(c.knots_a);
+    auto motion_b = to_fcl(c.knots_b);
+
+    Outcome o;
+    o.time_ns = time_median_ns(options.repeat, [&]()
+        {
+          o.toi = 0.0;
+          o.dist_checks = 0;
+          o.collide = collide_seperable_circles(
+            motion_a, motion_b, c.a_shapes, c.b_shapes,
+            o.toi, o.dist_checks, 120, c.tolerance, &o.iterations);
+        });
+
+    if (!o.collide)
+      o.toi = 0.0;
+
+    method.outcomes.push_back(o);
+  }
+
+  return method;
+}
+
+//==============================================================================
+Method run_planar(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"planar", true, {}};
+  for (const auto& c : cases)
+  {
+    const SplineMotion2D motion_a(c.knots_a);
+    const SplineMotion2D motion_b(c.knots_b);
+
+    Outcome o;
+    o.time_ns = time_median_ns(options.repeat, [&]()
+        {
+          o.toi = 0.0;
+          o.dist_checks = 0;
+          o.collide = collide_seperable_circles(
+            motion_a, motion_b, c.a_shapes, c.b_shapes,
+            o.toi, o.dist_checks, 120, c.tolerance, &o.iterations);
+        });
+
+    if (!o.collide)
+      o.toi = 0.0;
+
+    method.outcomes.push_back(o);
+  }
+
+  return method;
+}
+
+//==============================================================================
+Method run_bounds(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"bounds", true, {}};
+  for (const auto& c : cases)
+  {
+    auto motion_a = to_fcl(c.knots_a);
+    auto motion_b = to_fcl(c.knots_b);
+
+    Outcome o;
+    o.time_ns = time_median_ns(options.repeat, [&]()
+        {
+          o.toi = 0.0;
+          o.dist_checks = 0;
+          o.iterations = 0;
+          o.collide = false;
+          const bool overlap = swept_bounds_overlap(
+            compute_swept_bounds(c.knots_a, c.a_shapes),
+            compute_swept_bounds(c.knots_b, c.b_shapes),
+            c.tolerance);
+
+          if (overlap)
+          {
+            o.collide = collide_seperable_circles(
+              motion_a, motion_b, c.a_shapes, c.b_shapes,
+              o.toi, o.dist_checks, 120, c.tolerance, &o.iterations);
+          }
+        });
+
+    if (!o.collide)
+      o.toi = 0.0;
+
+    method.outcomes.push_back(o);
+  }
+
+  return method;
+}
+
+//==============================================================================
+Method run_batch(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"batch", true, {}};
+  method.outcomes.resize(cases.size());
+
+  // The batch has a single tolerance, so cases are grouped by it
+  std::map<double, std::vector<std::size_t>> groups;
+  for (std::size_t i = 0; i < cases.size(); ++i)
+    groups[cases[i].tolerance].push_back(i);
+
+  // Cases with the same circles share a footprint, the same way the robots of
+  // a fleet share their profile
+  std::vector<CircleFootprint> footprints;
+  std::map<std::vector<double>, std::uint32_t> footprint_ids;
+  const auto footprint = [&](const std::vector<ModelSpaceShape>& shapes)
+    {
+      const CircleFootprint fp(shapes);
+      std::vector<double> key = fp.x;
+      key.insert(key.end(), fp.y.begin(), fp.y.end());
+      key.insert(key.end(), fp.radius.begin(), fp.radius.end());
+
+      const auto id = static_cast<std::uint32_t>(footprints.size());
+      const auto inserted = footprint_ids.insert({std::move(key), id});
+      if (inserted.second)
+        footprints.push_back(fp);
+
+      return inserted.first->second;
+    };
+
+  CcdPairLayouts layouts;
+  for (const auto& group : groups)
+  {
+    CcdPairBatch batch;
+    batch.reserve(group.second.size());
+    for (const std::size_t i : group.second)
+    {
+      batch.add(
+        cases[i].knots_a, footprint(cases[i].a_shapes),
+        cases[i].knots_b, footprint(cases[i].b_shapes));
+    }
+
+    // The layouts of a fleet are built once and then reused, so they stay
+    // out of the timing
+    layouts.prepare(batch, footprints);
+
+    CcdBatchResult result;
+    const double total_ns = time_median_ns(options.repeat, [&]()
+        {
+          collide_seperable_circles_batch(
+            batch, layouts, result, 120, group.first);
+        });
+
+    const double per_pair_ns =
+      total_ns / static_cast<double>(group.second.size());
+    for (std::size_t k = 0; k < group.second.size(); ++k)
+    {
+      Outcome& o = method.outcomes[group.second[k]];
+      o.collide = result.collide[k];
+      o.toi = result.impact_time[k];
+      o.dist_checks = result.dist_checks[k];
+      o.iterations = result.iterations[k];
+      o.time_ns = per_pair_ns;
+    }
+  }
+
+  return method;
+}
+
+//==============================================================================
+std::shared_ptr<fcl::CollisionGeometryd> make_fcl_circle(
+  const ModelSpaceShape& shape)
+{
+  fcl::Sphered sphere(shape._radius);
+  if (shape._transform.translation().norm() < 1e-9)
+    return std::make_shared<fcl::Sphered>(sphere);
+
+  // fcl objects are centered on their motion, so offset circles become meshes
+  auto model = std::make_shared<fcl::BVHModel<fcl::OBBRSSd>>();
+  fcl::generateBVHModel(*model, sphere, shape._transform, 16, 16);
+  return model;
+}
+
+Method run_fcl(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"fcl", false, {}};
+  for (const auto& c : cases)
+  {
+    const auto motion_a =
+      std::make_shared<fcl::SplineMotion<double>>(to_fcl(c.knots_a));
+    const auto motion_b =
+      std::make_shared<fcl::SplineMotion<double>>(to_fcl(c.knots_b));
+
+    std::vector<std::shared_ptr<fcl::CollisionGeometryd>> a_geometry;
+    std::vector<std::shared_ptr<fcl::CollisionGeometryd>> b_geometry;
+    for (const auto& shape : c.a_shapes)
+      a_geometry.push_back(make_fcl_circle(shape));
+    for (const auto& shape : c.b_shapes)
+      b_geometry.push_back(make_fcl_circle(shape));
+
+    fcl::ContinuousCollisionRequestd request;
+    request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
+    request.gjk_solver_type = fcl::GST_LIBCCD;
+
+    Outcome o;
+    o.time_ns = time_median_ns(options.repeat, [&]()
+        {
+          o.collide = false;
+          o.toi = 0.0;
+          for (const auto& a : a_geometry)
+          {
+            for (const auto& b : b_geometry)
+            {
+              const fcl::ContinuousCollisionObjectd obj_a(a, motion_a);
+              const fcl::ContinuousCollisionObjectd obj_b(b, motion_b);
+              fcl::ContinuousCollisionResultd result;
+              fcl::collide(&obj_a, &obj_b, request, result);
+              if (result.is_collide && (!o.collide || result.time_of_contact < o.toi))
+              {
+                o.collide = true;
+                o.toi = result.time_of_contact;
+              }
+            }
+          }
+        });
+
+    method.outcomes.push_back(o);
+  }
+
+  return method;
+}
+
+//==============================================================================
+double min_gap(
+  fcl::SplineMotion<double>& motion_a,
+  fcl::SplineMotion<double>& motion_b,
+  const Case& c, double t)
+{
+  fcl::Transform3d a_tf, b_tf;
+  motion_a.integrate(t);
+  motion_b.integrate(t);
+  motion_a.getCurrentTransform(a_tf);
+  motion_b.getCurrentTransform(b_tf);
+
+  double gap = DBL_MAX;
+  for (const auto& a : c.a_shapes)
+  {
+    const Eigen::Vector3d pa = (a_tf * a._transform).translation();
+    for (const auto& b : c.b_shapes)
+    {
+      const Eigen::Vector3d pb = (b_tf * b._transform).translation();
+      gap = std::min(gap, (pa - pb).norm() - (a._radius + b._radius));
+    }
+  }
+  return gap;
+}
+
+// The collision time is the first time that the circles come within the
+// tolerance of each other, which is where collide_seperable_circles stops.
+Method run_dense(const std::vector<Case>& cases, const Options& options)
+{
+  Method method{"dense", false, {}};
+  for (const auto& c : cases)
+  {
+    auto motion_a = to_fcl(c.knots_a);
+    auto motion_b = to_fcl(c.knots_b);
+
+    Outcome o;
+    const auto start = Clock::now();
+    const double dt = 1.0 / static_cast<double>(options.samples);
+    double free_t = 0.0;
+    for (std::size_t s = 0; s < options.samples; ++s)
+    {
+      const double t = dt * static_cast<double>(s);
+      if (min_gap(motion_a, motion_b, c, t) <= c.tolerance)
+      {
+        double hit_t = t;
+        if (s > 0)
+        {
+          while (hit_t - free_t > 1e-9)
+          {
+            const double mid = 0.5 * (free_t + hit_t);
+            if (min_gap(motion_a, motion_b, c, mid) <= c.tolerance)
+              hit_t = mid;
+            else
+              free_t = mid;
+          }
+        }
+
+        o.collide = true;
+        o.toi = hit_t;
+        break;
+      }
+      free_t = t;
+    }
+    o.time_ns = std::chrono::duration<double, std::nano>(
+      Clock::now() - start).count();
+
+    method.outcomes.push_back(o);
+  }
+
+  return method;
+}
+
+//==============================================================================
+struct Summary
+{
+  std::string method;
+  double total_ms = 0.0;
+  double median_ns = 0.0;
+  double p95_ns = 0.0;
+  std::size_t collisions = 0;
+  std::size_t agree = 0;
+  std::size_t missed = 0;
+  std::size_t false_hits = 0;
+  double max_toi_error = 0.0;
+  double mean_toi_error = 0.0;
+  std::map<uint, std::size_t> dist_checks;
+  std::map<uint, std::size_t> iterations;
+};
+
+Summary summarize(const Method& method, const Method& reference)
+{
+  Summary s;
+  s.method = method.name;
+
+  std::vector<double> times;
+  std::size_t toi_count = 0;
+  for (std::size_t i = 0; i < method.outcomes.size(); ++i)
+  {
+    const Outcome& o = method.outcomes[i];
+    const Outcome& r = reference.outcomes[i];
+    times.push_back(o.time_ns);
+    s.total_ms += o.time_ns * 1e-6;
+
+    if (o.collide)
+      ++s.collisions;
+
+    if (o.collide == r.collide)
+      ++s.agree;
+    else if (r.collide)
+      ++s.missed;
+    else
+      ++s.false_hits;
+
+    if (o.collide && r.collide)
+    {
+      const double error = std::abs(o.toi - r.toi);
+      s.max_toi_error = std::max(s.max_toi_error, error);
+      s.mean_toi_error += error;
+      ++toi_count;
+    }
+
+    if (method.has_counts)
+    {
+      ++s.dist_checks[o.dist_checks];
+      ++s.iterations[o.iterations];
+    }
+  }
+
+  if (toi_count > 0)
+    s.mean_toi_error /= static_cast<double>(toi_count);
+
+  s.median_ns = median(times);
+  s.p95_ns = percentile(times, 0.95);
+  return s;
+}
+
+void print_histogram(const char* label, const std::map<uint, std::size_t>& h)
+{
+  if (h.empty())
+    return;
+
+  std::size_t largest = 0;
+  for (const auto& bin : h)
+    largest = std::max(largest, bin.second);
+
+  std::printf("  %s\n", label);
+  for (const auto& bin : h)
+  {
+    const int width = static_cast<int>(40 * bin.second / largest);
+    std::printf("    %4u | %-40s %zu\n",
+      bin.first, std::string(std::max(width, 1), '#').c_str(), bin.second);
+  }
+}
+
+std::string escape_json(const std::string& text)
+{
+  std::string out;
+  for (const char ch : text)
+  {
+    if (ch == '"' || ch == '\\')
+      out.push_back('\\');
+    out.push_back(ch);
+  }
+  return out;
+}
+
+void write_json_histogram(
+  std::ostream& out, const std::map<uint, std::size_t>& h)
+{
+  out << "{";
+  bool first = true;
+  for (const auto& bin : h)
+  {
+    out << (first ? "" : ", ") << "\"" << bin.first << "\": " << bin.second;
+    first = false;
+  }
+  out << "}";
+}
+
+bool write_json(
+  const std::string& filename,
+  const Options& options,
+  std::size_t num_cases,
+  const std::vector<Summary>& summaries)
+{
+  std::ofstream out(filename);
+  if (!out)
+    return false;
+
+  out.precision(10);
+  out << "{\n"
+      << "  \"cases\": " << num_cases << ",\n"
+      << "  \"random_cases\": " << options.random_cases << ",\n"
+      << "  \"seed\": " << options.seed << ",\n"
+      << "  \"repeat\": " << options.repeat << ",\n"
+      << "  \"dense_samples\": " << options.samples << ",\n"
+      << "  \"batch_avx2\": "
+      << (batch_ccd_uses_avx2() ? "true" : "false") << ",\n"
+      << "  \"methods\": {\n";
+
+  for (std::size_t i = 0; i < summaries.size(); ++i)
+  {
+    const Summary& s = summaries[i];
+    out << "    \"" << escape_json(s.method) << "\": {\n"
+        << "      \"total_ms\": " << s.total_ms << ",\n"
+        << "      \"median_ns\": " << s.median_ns << ",\n"
+        << "      \"p95_ns\": " << s.p95_ns << ",\n"
+        << "      \"collisions\": " << s.collisions << ",\n"
+        << "      \"agree_with_dense\": " << s.agree << ",\n"
+        << "      \"missed\": " << s.missed << ",\n"
+        << "      \"false_hits\": " << s.false_hits << ",\n"
+        << "      \"max_toi_error\": " << s.max_toi_error << ",\n"
+        << "      \"mean_toi_error\": " << s.mean_toi_error << ",\n"
+        << "      \"dist_checks\": ";
+    write_json_histogram(out, s.dist_checks);
+    out << ",\n      \"iterations\": ";
+    write_json_histogram(out, s.iterations);
+    out << "\n    }" << (i + 1 < summaries.size() ? "," : "") << "\n";
+  }
+
+  out << "  }\n}\n";
+  return true;
+}
+
+bool write_csv(
+  const std::string& filename,
+  const std::vector<Case>& cases,
+  const std::vector<Method>& methods)
+{
+  std::ofstream out(filename);
+  if (!out)
+    return false;
+
+  out.precision(10);
+  out << "case,method,collide,toi,dist_checks,iterations,time_ns\n";
+  for (const auto& method : methods)
+  {
+    for (std::size_t i = 0; i < cases.size(); ++i)
+    {
+      const Outcome& o = method.outcomes[i];
+      out << "\"" << cases[i].name << "\"," << method.name << ","
+          << o.collide << "," << o.toi << ","
+          << o.dist_checks << "," << o.iterations << "," << o.time_ns << "\n";
+    }
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!parse_options(argc, argv, options))
+  {
+    print_usage();
+    return 1;
+  }
+
+  const auto cases = make_cases(options);
+  std::cout << "Running " << cases.size() << " cases ("
+            << cases.size() - options.random_cases << " presets, "
+            << options.random_cases << " random with seed "
+            << options.seed << ")" << std::endl;
+
+  std::vector<Method> methods;
+  methods.push_back(run_dense(cases, options));
+  methods.push_back(run_sidecar(cases, options));
+  methods.push_back(run_planar(cases, options));
+  methods.push_back(run_bounds(cases, options));
+  methods.push_back(run_batch(cases, options));
+  if (options.run_fcl)
+    methods.push_back(run_fcl(cases, options));
+
+  const Method& reference = methods.front();
+  std::vector<Summary> summaries;
+  for (const auto& method : methods)
+    summaries.push_back(summarize(method, reference));
+
+  for (const auto& s : summaries)
+  {
+    std::printf("\n%s\n", s.method.c_str());
+    std::printf("  total %.3f ms, median %.0f ns, p95 %.0f ns\n",
+      s.total_ms, s.median_ns, s.p95_ns);
+    std::printf("  collisions %zu, agree with dense %zu/%zu"
+      " (missed %zu, false hits %zu)\n",
+      s.collisions, s.agree, cases.size(), s.missed, s.false_hits);
+    std::printf("  toi error max %.3g, mean %.3g\n",
+      s.max_toi_error, s.mean_toi_error);
+    print_histogram("dist_checks:", s.dist_checks);
+    print_histogram("iterations:", s.iterations);
+  }
+
+  if (!options.csv_file.empty() && !write_csv(options.csv_file, cases, methods))
+  {
+    std::cout << "Failed to write " << options.csv_file << std::endl;
+    return 1;
+  }
+
+  if (!options.json_file.empty()
+    && !write_json(options.json_file, options, cases.size(), summaries))
+  {
+    std::cout << "Failed to write " << options.json_file << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "conflict_sweep.hpp"
+
+#include <rmf_planner_viz/draw/IMDraw.hpp>
+
+#include <rmf_traffic/schedule/Query.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <unordered_map>
+
+#include "batch_ccd.hpp"
+#include "dynamic_aabb_tree.hpp"
+#include "footprint_compiler.hpp"
+#include "spline_offset_utils.hpp"
+#include "test_sidecar_utils.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct RouteInfo
+{
+  std::size_t map;
+  rmf_traffic::schedule::ParticipantId participant;
+  rmf_traffic::RouteId route_id;
+  double radius;
+  std::uint32_t footprint;
+};
+
+// Cubic Hermite piece of a trajectory between two of its waypoints, with
+// times in seconds after the start of the sweep
+struct Segment
+{
+  std::uint32_t route;
+  double t0;
+  double t1;
+  Eigen::Vector3d x0;
+  Eigen::Vector3d x1;
+
+  // Velocities scaled by the duration of the segment
+  Eigen::Vector3d v0;
+  Eigen::Vector3d v1;
+
+  SweptBounds bounds;
+
+  Eigen::Vector3d position(double s) const
+  {
+    const double s2 = s * s;
+    const double s3 = s2 * s;
+    return (2.0 * s3 - 3.0 * s2 + 1.0) * x0
+      + (s3 - 2.0 * s2 + s) * v0
+      + (-2.0 * s3 + 3.0 * s2) * x1
+      + (s3 - s2) * v1;
+  }
+
+  Eigen::Vector3d derivative(double s) const
+  {
+    const double s2 = s * s;
+    return (6.0 * s2 - 6.0 * s) * x0
+      + (3.0 * s2 - 4.0 * s + 1.0) * v0
+      + (-6.0 * s2 + 6.0 * s) * x1
+      + (3.0 * s2 - 2.0 * s) * v1;
+  }
+
+  double parameter(double t) const
+  {
+    return (t - t0) / (t1 - t0);
+  }
+
+  // Knots of the piece of this segment between parameters s0 and s1
+  std::array<Eigen::Vector3d, 4> knots(double s0, double s1) const
+  {
+    const double scale = s1 - s0;
+    return compute_knots(
+      position(s0), position(s1),
+      derivative(s0) * scale, derivative(s1) * scale);
+  }
+};
+
+struct CellKey
+{
+  std::size_t map;
+  long bucket;
+  long x;
+  long y;
+
+  bool operator==(const CellKey& other) const
+  {
+    return map == other.map && bucket == other.bucket
+      && x == other.x && y == other.y;
+  }
+};
+
+struct CellKeyHash
+{
+  std::size_t operator()(const CellKey& key) const
+  {
+    std::size_t h = key.map;
+    for (const long v : {key.bucket, key.x, key.y})
+      h = h * 1000003u ^ static_cast<std::size_t>(v);
+    return h;
+  }
+};
+
+using Cells = std::unordered_map<CellKey, std::vector<std::uint32_t>, CellKeyHash>;
+
+} // anonymous namespace
+
+//==============================================================================
+std::vector<SweepConflict> sweep_conflicts(
+  const rmf_traffic::schedule::Viewer& viewer,
+  ThreadPool& pool,
+  const ConflictSweepOptions& options,
+  ConflictSweepStats* stats)
+{
+  ConflictSweepStats local_stats;
+  ConflictSweepStats& st = stats ? *stats : local_stats;
+  st = ConflictSweepStats();
+
+  auto start = Clock::now();
+  const auto view = viewer.query(rmf_traffic::schedule::query_all());
+
+  // Times are measured from the earliest waypoint in the schedule
+  rmf_utils::optional<rmf_traffic::Time> reference;
+  for (const auto& v : view)
+  {
+    const auto& trajectory = v.route.trajectory();
+    if (trajectory.size() < 2)
+      continue;
+
+    const auto t = *trajectory.start_time();
+    if (!reference || t < *reference)
+      reference = t;
+  }
+
+  if (!reference)
+    return {};
+
+  const auto seconds = [&](rmf_traffic::Time t)
+    {
+      return std::chrono::duration<double>(t - *reference).count();
+    };
+
+  // Robots with the same profile share a footprint
+  FootprintCompiler compiler;
+  std::vector<CircleFootprint> footprints;
+  std::map<const CompiledProfile*, std::uint32_t> footprint_ids;
+  std::vector<std::string> maps;
+  std::vector<RouteInfo> routes;
+  std::vector<Segment> segments;
+  for (const auto& v : view)
+  {
+    const auto& trajectory = v.route.trajectory();
+    if (trajectory.size() < 2)
+      continue;
+
+    const auto map_it = std::find(maps.begin(), maps.end(), v.route.map());
+    const std::size_t map = map_it - maps.begin();
+    if (map_it == maps.end())
+      maps.push_back(v.route.map());
+
+    const auto profile = compiler.compile(v.description.profile());
+    const double radius = profile->footprint.bounding_radius;
+    const auto footprint = footprint_ids.insert(
+      {profile.get(), static_cast<std::uint32_t>(footprints.size())});
+    if (footprint.second)
+      footprints.emplace_back(profile->footprint.shapes);
+
+    const auto route = static_cast<std::uint32_t>(routes.size());
+    routes.push_back(
+      RouteInfo{map, v.participant, v.route_id, radius,
+        footprint.first->second});
+
+    auto it = trajectory.begin();
+    auto prev = it++;
+    for (; it != trajectory.end(); prev = it++)
+    {
+      Segment seg;
+      seg.route = route;
+      seg.t0 = seconds(prev->time());
+      seg.t1 = seconds(it->time());
+      const double dt = seg.t1 - seg.t0;
+      if (dt <= 0.0)
+        continue;
+
+      seg.x0 = prev->position();
+      seg.x1 = it->position();
+      seg.v0 = prev->velocity() * dt;
+      seg.v1 = it->velocity() * dt;
+      seg.bounds = compute_swept_bounds(seg.knots(0.0, 1.0), radius);
+      segments.push_back(seg);
+    }
+  }
+
+  st.routes = routes.size();
+  st.segments = segments.size();
+  st.build_ms = elapsed_ms(start);
+
+  // Broad phase: collect the segment pairs of different participants whose
+  // time ranges and swept bounds overlap
+  std::vector<std::uint64_t> candidates;
+  const auto consider = [&](std::uint32_t i, std::uint32_t j)
+    {
+      const Segment& a = segments[i];
+      const Segment& b = segments[j];
+      if (routes[a.route].participant == routes[b.route].participant)
+        return;
+
+      if (routes[a.route].map != routes[b.route].map)
+        return;
+
+      if (std::min(a.t1, b.t1) <= std::max(a.t0, b.t0))
+        return;
+
+      if (!swept_bounds_overlap(a.bounds, b.bounds, options.tolerance))
+        return;
+
+      const std::uint64_t lo = std::min(i, j);
+      const std::uint64_t hi = std::max(i, j);
+      candidates.push_back(lo << 32 | hi);
+    };
+
+  start = Clock::now();
+  const double pad = 0.5 * options.tolerance;
+  if (options.use_aabb_tree)
+  {
+    // The swept bounds never move, so the margin only has to cover the
+    // tolerance
+    DynamicAabbTree tree(pad, 0.0);
+    for (std::size_t i = 0; i < segments.size(); ++i)
+    {
+      const SweptBounds& bounds = segments[i].bounds;
+      tree.insert(Aabb{bounds.min, bounds.max}, i);
+    }
+
+    tree.for_each_overlapping_pair([&](int a, int b)
+      {
+        consider(
+          static_cast<std::uint32_t>(tree.user_data(a)),
+          static_cast<std::uint32_t>(tree.user_data(b)));
+      });
+  }
+  else
+  {
+    // Every segment goes into each time bucket and grid cell that its time
+    // range and swept bounds touch
+    Cells cells;
+    for (std::size_t i = 0; i < segments.size(); ++i)
+    {
+      const Segment& seg = segments[i];
+      const long b0 = static_cast<long>(std::floor(seg.t0 / options.bucket_duration));
+      const long b1 = static_cast<long>(std::floor(seg.t1 / options.bucket_duration));
+      const long x0 = static_cast<long>(
+        std::floor((seg.bounds.min.x() - pad) / options.cell_size));
+      const long x1 = static_cast<long>(
+        std::floor((seg.bounds.max.x() + pad) / options.cell_size));
+      const long y0 = static_cast<long>(
+        std::floor((seg.bounds.min.y() - pad) / options.cell_size));
+      const long y1 = static_cast<long>(
+        std::floor((seg.bounds.max.y() + pad) / options.cell_size));
+
+      const std::size_t map = routes[seg.route].map;
+      for (long b = b0; b <= b1; ++b)
+        for (long x = x0; x <= x1; ++x)
+          for (long y = y0; y <= y1; ++y)
+            cells[CellKey{map, b, x, y}].push_back(static_cast<std::uint32_t>(i));
+    }
+
+    for (const auto& cell : cells)
+    {
+      const auto& entries = cell.second;
+      for (std::size_t m = 0; m < entries.size(); ++m)
+        for (std::size_t n = m + 1; n < entries.size(); ++n)
+          consider(entries[m], entries[n]);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(
+    std::unique(candidates.begin(), candidates.end()), candidates.end());
+  st.candidate_pairs = candidates.size();
+  st.broad_phase_ms = elapsed_ms(start);
+
+  // Narrow phase over the common time window of each candidate pair
+  start = Clock::now();
+  CcdOptions ccd_options;
+  ccd_options.tolerance = options.tolerance;
+  ccd_options.max_evaluations = options.safety_maximum_checks;
+  ccd_options.max_root_iterations = options.max_root_iterations;
+
+  // Common time window of the segments of candidate c
+  const auto window = [&](std::size_t c)
+    {
+      const Segment& a = segments[candidates[c] >> 32];
+      const Segment& b = segments[candidates[c] & 0xffffffff];
+      return std::make_pair(std::max(a.t0, b.t0), std::min(a.t1, b.t1));
+    };
+
+  CcdPairBatch batch;
+  batch.reserve(candidates.size());
+  for (std::size_t c = 0; c < candidates.size(); ++c)
+  {
+    const Segment& a = segments[candidates[c] >> 32];
+    const Segment& b = segments[candidates[c] & 0xffffffff];
+    const auto w = window(c);
+    batch.add(
+      a.knots(a.parameter(w.first), a.parameter(w.second)),
+      routes[a.route].footprint,
+      b.knots(b.parameter(w.first), b.parameter(w.second)),
+      routes[b.route].footprint);
+  }
+
+  const CcdPairLayouts layouts(batch, footprints);
+  CcdBatchResult result;
+  result.resize(batch.size());
+  pool.parallel_for(0, batch.size(), options.grain,
+    [&](std::size_t begin, std::size_t end)
+    {
+      collide_seperable_circles_batch(
+        batch, layouts, result, begin, end, ccd_options);
+    });
+
+  // Checks that ran out of budget could not rule out contact anywhere in
+  // their window, so they count as unresolved from its start
+  std::vector<double> hit_time(candidates.size(), -1.0);
+  std::vector<bool> unresolved(candidates.size(), false);
+  std::size_t budget_stops = 0;
+  for (std::size_t c = 0; c < candidates.size(); ++c)
+  {
+    const auto w = window(c);
+    if (result.collide[c])
+    {
+      hit_time[c] = w.first + result.impact_time[c] * (w.second - w.first);
+    }
+    else if (result.stop[c] == CcdStop::Budget)
+    {
+      hit_time[c] = w.first;
+      unresolved[c] = true;
+      ++budget_stops;
+    }
+  }
+
+  st.ccd_checks = candidates.size();
+  st.ccd_budget_stops = budget_stops;
+
+  // Keep the earliest conflict and the earliest unresolved check of each pair
+  // of routes
+  using RoutePair = std::pair<std::uint32_t, std::uint32_t>;
+  std::map<RoutePair, std::size_t> earliest;
+  std::map<RoutePair, std::size_t> earliest_unresolved;
+  for (std::size_t c = 0; c < candidates.size(); ++c)
+  {
+    if (hit_time[c] < 0.0)
+      continue;
+
+    const Segment& a = segments[candidates[c] >> 32];
+    const Segment& b = segments[candidates[c] & 0xffffffff];
+    const auto key = std::make_pair(
+      std::min(a.route, b.route), std::max(a.route, b.route));
+    auto& kept = unresolved[c] ? earliest_unresolved : earliest;
+    const auto inserted = kept.insert({key, c});
+    if (!inserted.second && hit_time[c] < hit_time[inserted.first->second])
+      inserted.first->second = c;
+  }
+
+  // Unresolved checks after a conflict of the same routes add nothing
+  for (const auto& entry : earliest)
+  {
+    const auto it = earliest_unresolved.find(entry.first);
+    if (it != earliest_unresolved.end()
+      && hit_time[entry.second] <= hit_time[it->second])
+      earliest_unresolved.erase(it);
+  }
+
+  std::vector<SweepConflict> conflicts;
+  conflicts.reserve(earliest.size() + earliest_unresolved.size());
+  for (const auto* kept : {&earliest, &earliest_unresolved})
+  {
+    for (const auto& entry : *kept)
+    {
+      const std::size_t c = entry.second;
+      const Segment& a = segments[candidates[c] >> 32];
+      const Segment& b = segments[candidates[c] & 0xffffffff];
+      const RouteInfo& ra = routes[a.route];
+      const RouteInfo& rb = routes[b.route];
+      const double t = hit_time[c];
+
+      conflicts.push_back(
+        SweepConflict{
+          maps[ra.map],
+          ra.participant, ra.route_id,
+          rb.participant, rb.route_id,
+          *reference + std::chrono::duration_cast<rmf_traffic::Duration>(
+            std::chrono::duration<double>(t)),
+          a.position(a.parameter(t)),
+          b.position(b.parameter(t)),
+          ra.radius,
+          rb.radius,
+          unresolved[c]
+        });
+    }
+  }
+
+  std::sort(conflicts.begin(), conflicts.end(),
+    [](const SweepConflict& x, const SweepConflict& y)
+    {
+      return x.time < y.time;
+    });
+
+  st.narrow_phase_ms = elapsed_ms(start);
+  return conflicts;
+}
+
+//==============================================================================
+void draw_conflicts(
+  const std::vector<SweepConflict>& conflicts,
+  const std::string& map,
+  const sf::Color& color,
+  const sf::Color& unresolved_color)
+{
+  for (const auto& conflict : conflicts)
+  {
+    if (conflict.map != map)
+      continue;
+
+    const sf::Color& c = conflict.unresolved ? unresolved_color : color;
+    const sf::Vector2f a(conflict.position_a.x(), conflict.position_a.y());
+    const sf::Vector2f b(conflict.position_b.x(), conflict.position_b.y());
+    IMDraw::draw_circle(a, conflict.radius_a, c);
+    IMDraw::draw_circle(b, conflict.radius_b, c);
+    IMDraw::draw_line(a, b, c);
+  }
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__CONFLICT_SWEEP_HPP
+#define RMF_PLANNER_VIZ__DRAW__CONFLICT_SWEEP_HPP
+
+#include <rmf_traffic/schedule/Viewer.hpp>
+
+#include <SFML/Graphics/Color.hpp>
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+struct ConflictSweepOptions
+{
+  // Width in seconds of the time buckets of the spatial hash
+  double bucket_duration = 5.0;
+
+  // Width in meters of the cells of the spatial hash
+  double cell_size = 4.0;
+
+  // Gap at which two footprints count as touching
+  double tolerance = 0.01;
+
+  // Passed on to collide_seperable_circles_batch
+  uint safety_maximum_checks = 120;
+  uint max_root_iterations = 25;
+
+  // Candidate pairs per task given to the thread pool
+  std::size_t grain = 64;
+
+  // Find candidate pairs with a DynamicAabbTree of the swept bounds instead
+  // of the spatial hash. The tree ignores time, so overlapping time ranges
+  // are checked per pair.
+  bool use_aabb_tree = false;
+};
+
+struct SweepConflict
+{
+  std::string map;
+  rmf_traffic::schedule::ParticipantId participant_a;
+  rmf_traffic::RouteId route_a;
+  rmf_traffic::schedule::ParticipantId participant_b;
+  rmf_traffic::RouteId route_b;
+
+  // First time of contact between the two routes. For unresolved conflicts
+  // this is the start of the window that could not be checked.
+  rmf_traffic::Time time;
+
+  // (x, y, yaw) of both participants at that time
+  Eigen::Vector3d position_a;
+  Eigen::Vector3d position_b;
+  double radius_a;
+  double radius_b;
+
+  // True if the check ran out of safety_maximum_checks before it could rule
+  // out contact, so the routes may conflict anywhere in the window
+  bool unresolved;
+};
+
+struct ConflictSweepStats
+{
+  std::size_t routes = 0;
+  std::size_t segments = 0;
+  std::size_t candidate_pairs = 0;
+  std::size_t ccd_checks = 0;
+
+  // Checks that ran out of safety_maximum_checks before reaching contact or
+  // the end of both segments. They are reported as unresolved conflicts.
+  std::size_t ccd_budget_stops = 0;
+  double build_ms = 0.0;
+  double broad_phase_ms = 0.0;
+  double narrow_phase_ms = 0.0;
+};
+
+// Check every pair of routes of different participants in the schedule for
+// conflicts. The trajectory segments are put in a spatial hash of time
+// buckets and grid cells using their swept bounds, and only the segment pairs
+// that share a cell are put in one CcdPairBatch, whose ranges are given to
+// collide_seperable_circles_batch over the thread pool. Each footprint is
+// covered by the circles that FootprintCompiler makes for it. Returns the
+// earliest conflict of each pair of routes that has one, and the earliest
+// unresolved check of each pair of routes that comes before it, ordered by
+// time.
+std::vector<SweepConflict> sweep_conflicts(
+  const rmf_traffic::schedule::Viewer& viewer,
+  ThreadPool& pool,
+  const ConflictSweepOptions& options = ConflictSweepOptions(),
+  ConflictSweepStats* stats = nullptr);
+
+// Draw a marker around both participants of every conflict on the given map,
+// with a line between them, through IMDraw. Unresolved conflicts are drawn
+// with unresolved_color.
+void draw_conflicts(
+  const std::vector<SweepConflict>& conflicts,
+  const std::string& map,
+  const sf::Color& color = sf::Color(255, 64, 64),
+  const sf::Color& unresolved_color = sf::Color(255, 160, 0));
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__CONFLICT_SWEEP_HPP
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "dynamic_aabb_tree.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+//==============================================================================
+DynamicAabbTree::DynamicAabbTree(
+  double margin,
+  double displacement_multiplier)
+: _margin(margin),
+  _displacement_multiplier(displacement_multiplier)
+{
+  // Do nothing
+}
+
+//==============================================================================
+int DynamicAabbTree::insert(const Aabb& box, std::size_t user_data)
+{
+  const int proxy = allocate_node();
+  Node& node = _nodes[proxy];
+  node.box = fatten(box, Eigen::Vector2d::Zero());
+  node.user_data = user_data;
+  node.height = 0;
+
+  insert_leaf(proxy);
+  ++_proxies;
+  return proxy;
+}
+
+//==============================================================================
+void DynamicAabbTree::remove(int proxy)
+{
+  assert(0 <= proxy && proxy < static_cast<int>(_nodes.size()));
+  assert(_nodes[proxy].leaf());
+
+  remove_leaf(proxy);
+  free_node(proxy);
+  --_proxies;
+}
+
+//==============================================================================
+bool DynamicAabbTree::update(
+  int proxy,
+  const Aabb& box,
+  const Eigen::Vector2d& displacement)
+{
+  assert(0 <= proxy && proxy < static_cast<int>(_nodes.size()));
+  assert(_nodes[proxy].leaf());
+
+  const Aabb fat = fatten(box, displacement);
+  const Aabb& current = _nodes[proxy].box;
+  if (current.contains(box))
+  {
+    // Keep the current fat box unless it has grown far larger than needed,
+    // e.g. after the proxy slowed down
+    const Aabb loose{
+      fat.min - Eigen::Vector2d::Constant(4.0 * _margin),
+      fat.max + Eigen::Vector2d::Constant(4.0 * _margin)};
+    if (loose.contains(current))
+      return false;
+  }
+
+  remove_leaf(proxy);
+  _nodes[proxy].box = fat;
+  insert_leaf(proxy);
+  return true;
+}
+
+//==============================================================================
+void DynamicAabbTree::clear()
+{
+  _nodes.clear();
+  _root = Null;
+  _free = Null;
+  _proxies = 0;
+}
+
+//==============================================================================
+std::size_t DynamicAabbTree::user_data(int proxy) const
+{
+  return _nodes[proxy].user_data;
+}
+
+//==============================================================================
+const Aabb& DynamicAabbTree::fat_aabb(int proxy) const
+{
+  return _nodes[proxy].box;
+}
+
+//==============================================================================
+std::size_t DynamicAabbTree::size() const
+{
+  return _proxies;
+}
+
+//==============================================================================
+int DynamicAabbTree::height() const
+{
+  return _root == Null ? 0 : _nodes[_root].height;
+}
+
+//==============================================================================
+double DynamicAabbTree::area_ratio() const
+{
+  if (_root == Null)
+    return 0.0;
+
+  const double root_perimeter = _nodes[_root].box.perimeter();
+  if (root_perimeter <= 0.0)
+    return 0.0;
+
+  double total = 0.0;
+  for (const Node& node : _nodes)
+  {
+    if (node.height >= 0)
+      total += node.box.perimeter();
+  }
+
+  return total / root_perimeter;
+}
+
+//==============================================================================
+bool DynamicAabbTree::validate() const
+{
+  if (_root == Null)
+    return _proxies == 0;
+
+  if (_nodes[_root].parent != Null)
+    return false;
+
+  if (validate_subtree(_root, Null) < 0)
+    return false;
+
+  std::size_t leaves = 0;
+  std::size_t used = 0;
+  for (const Node& node : _nodes)
+  {
+    if (node.height == 0)
+      ++leaves;
+    if (node.height >= 0)
+      ++used;
+  }
+
+  std::size_t unused = 0;
+  for (int i = _free; i != Null; i = _nodes[i].parent)
+    ++unused;
+
+  return leaves == _proxies && used + unused == _nodes.size();
+}
+
+//==============================================================================
+int DynamicAabbTree::allocate_node()
+{
+  if (_free == Null)
+  {
+    _nodes.emplace_back();
+    return static_cast<int>(_nodes.size()) - 1;
+  }
+
+  const int index = _free;
+  _free = _nodes[index].parent;
+  _nodes[index] = Node();
+  return index;
+}
+
+//==============================================================================
+void DynamicAabbTree::free_node(int index)
+{
+  _nodes[index] = Node();
+  _nodes[index].parent = _free;
+  _free = index;
+}
+
+//==============================================================================
+void DynamicAabbTree::insert_leaf(int leaf)
+{
+  if (_root == Null)
+  {
+    _root = leaf;
+    _nodes[leaf].parent = Null;
+    return;
+  }
+
+  // Walk down towards the sibling that adds the least perimeter to the tree
+  const Aabb leaf_box = _nodes[leaf].box;
+  int index = _root;
+  while (!_nodes[index].leaf())
+  {
+    const Node& node = _nodes[index];
+    const double perimeter = node.box.perimeter();
+    const double combined = node.box.merged(leaf_box).perimeter();
+
+    // Cost of making a new parent for this node and the leaf
+    const double cost = 2.0 * combined;
+
+    // Minimum cost of pushing the leaf further down
+    const double inheritance = 2.0 * (combined - perimeter);
+
+    const auto descend_cost = [&](int child)
+      {
+        const Node& c = _nodes[child];
+        const double merged = c.box.merged(leaf_box).perimeter();
+        if (c.leaf())
+          return merged + inheritance;
+        return merged - c.box.perimeter() + inheritance;
+      };
+
+    const double cost1 = descend_cost(node.child1);
+    const double cost2 = descend_cost(node.child2);
+    if (cost < cost1 && cost < cost2)
+      break;
+
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  const int sibling = index;
+  const int old_parent = _nodes[sibling].parent;
+  const int new_parent = allocate_node();
+
+  Node& parent = _nodes[new_parent];
+  parent.parent = old_parent;
+  parent.box = _nodes[sibling].box.merged(leaf_box);
+  parent.height = _nodes[sibling].height + 1;
+  parent.child1 = sibling;
+  parent.child2 = leaf;
+
+  if (old_parent == Null)
+  {
+    _root = new_parent;
+  }
+  else
+  {
+    Node& grandparent = _nodes[old_parent];
+    if (grandparent.child1 == sibling)
+      grandparent.child1 = new_parent;
+    else
+      grandparent.child2 = new_parent;
+  }
+
+  _nodes[sibling].parent = new_parent;
+  _nodes[leaf].parent = new_parent;
+
+  refit_upwards(new_parent);
+}
+
+//==============================================================================
+void DynamicAabbTree::remove_leaf(int leaf)
+{
+  if (leaf == _root)
+  {
+    _root = Null;
+    return;
+  }
+
+  const int parent = _nodes[leaf].parent;
+  const int grandparent = _nodes[parent].parent;
+  const int sibling = _nodes[parent].child1 == leaf ?
+    _nodes[parent].child2 : _nodes[parent].child1;
+
+  // The sibling takes the place of the parent
+  free_node(parent);
+  _nodes[sibling].parent = grandparent;
+  _nodes[leaf].parent = Null;
+
+  if (grandparent == Null)
+  {
+    _root = sibling;
+    return;
+  }
+
+  Node& g = _nodes[grandparent];
+  if (g.child1 == parent)
+    g.child1 = sibling;
+  else
+    g.child2 = sibling;
+
+  refit_upwards(grandparent);
+}
+
+//==============================================================================
+void DynamicAabbTree::refit_upwards(int index)
+{
+  while (index != Null)
+  {
+    index = balance(index);
+
+    Node& node = _nodes[index];
+    const Node& child1 = _nodes[node.child1];
+    const Node& child2 = _nodes[node.child2];
+    node.box = child1.box.merged(child2.box);
+    node.height = 1 + std::max(child1.height, child2.height);
+
+    index = node.parent;
+  }
+}
+
+//==============================================================================
+int DynamicAabbTree::balance(int index_a)
+{
+  Node& a = _nodes[index_a];
+  if (a.leaf() || a.height < 2)
+    return index_a;
+
+  const int index_b = a.child1;
+  const int index_c = a.child2;
+  Node& b = _nodes[index_b];
+  Node& c = _nodes[index_c];
+
+  const int difference = c.height - b.height;
+
+  // Rotate the taller child up into the place of a. Its taller child stays
+  // under it and its shorter child moves under a.
+  const auto rotate = [&](int index_up, Node& up, Node& other, bool up_is_child1)
+    {
+      const int index_f = up.child1;
+      const int index_g = up.child2;
+      Node& f = _nodes[index_f];
+      Node& g = _nodes[index_g];
+
+      up.child1 = index_a;
+      up.parent = a.parent;
+      a.parent = index_up;
+
+      if (up.parent == Null)
+      {
+        _root = index_up;
+      }
+      else
+      {
+        Node& p = _nodes[up.parent];
+        if (p.child1 == index_a)
+          p.child1 = index_up;
+        else
+          p.child2 = index_up;
+      }
+
+      const bool keep_f = f.height > g.height;
+      const int index_keep = keep_f ? index_f : index_g;
+      const int index_move = keep_f ? index_g : index_f;
+      Node& keep = keep_f ? f : g;
+      Node& move = keep_f ? g : f;
+
+      up.child2 = index_keep;
+      if (up_is_child1)
+        a.child1 = index_move;
+      else
+        a.child2 = index_move;
+      move.parent = index_a;
+
+      a.box = other.box.merged(move.box);
+      a.height = 1 + std::max(other.height, move.height);
+      up.box = a.box.merged(keep.box);
+      up.height = 1 + std::max(a.height, keep.height);
+      return index_up;
+    };
+
+  if (difference > 1)
+    return rotate(index_c, c, b, false);
+
+  if (difference < -1)
+    return rotate(index_b, b, c, true);
+
+  return index_a;
+}
+
+//==============================================================================
+int DynamicAabbTree::validate_subtree(int index, int parent) const
+{
+  const Node& node = _nodes[index];
+  if (node.parent != parent || node.height < 0)
+    return -1;
+
+  if (node.leaf())
+    return node.child2 == Null && node.height == 0 ? 0 : -1;
+
+  const int h1 = validate_subtree(node.child1, index);
+  const int h2 = validate_subtree(node.child2, index);
+  if (h1 < 0 || h2 < 0)
+    return -1;
+
+  const int h = 1 + std::max(h1, h2);
+  if (node.height != h)
+    return -1;
+
+  const Aabb box = _nodes[node.child1].box.merged(_nodes[node.child2].box);
+  if (!node.box.contains(box) || !box.contains(node.box))
+    return -1;
+
+  return h;
+}
+
+//==============================================================================
+Aabb DynamicAabbTree::fatten(
+  const Aabb& box,
+  const Eigen::Vector2d& displacement) const
+{
+  Aabb fat{
+    box.min - Eigen::Vector2d::Constant(_margin),
+    box.max + Eigen::Vector2d::Constant(_margin)};
+
+  // Stretch along the direction of travel only
+  const Eigen::Vector2d d = _displacement_multiplier * displacement;
+  fat.min += d.cwiseMin(Eigen::Vector2d::Zero());
+  fat.max += d.cwiseMax(Eigen::Vector2d::Zero());
+  return fat;
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__DYNAMIC_AABB_TREE_HPP
+#define RMF_PLANNER_VIZ__DRAW__DYNAMIC_AABB_TREE_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+struct Aabb
+{
+  Eigen::Vector2d min;
+  Eigen::Vector2d max;
+
+  bool overlaps(const Aabb& other) const
+  {
+    return min.x() <= other.max.x() && other.min.x() <= max.x()
+      && min.y() <= other.max.y() && other.min.y() <= max.y();
+  }
+
+  bool contains(const Aabb& other) const
+  {
+    return min.x() <= other.min.x() && min.y() <= other.min.y()
+      && other.max.x() <= max.x() && other.max.y() <= max.y();
+  }
+
+  Aabb merged(const Aabb& other) const
+  {
+    return Aabb{min.cwiseMin(other.min), max.cwiseMax(other.max)};
+  }
+
+  // Used as the cost of a node when choosing where to insert a leaf
+  double perimeter() const
+  {
+    return 2.0 * ((max.x() - min.x()) + (max.y() - min.y()));
+  }
+};
+
+// Incrementally balanced bounding volume hierarchy of 2D boxes, meant for
+// broad phase checks between robot footprints that move every frame.
+//
+// Leaves store a fat box: the box given to insert() grown by a margin, and
+// stretched along the expected displacement of the proxy. update() does
+// nothing while the new box still fits inside the fat box, and otherwise
+// removes and reinserts that single leaf, rebalancing with tree rotations on
+// the way up, so moving a proxy costs O(log n) instead of a rebuild.
+//
+// Proxies are identified by the int returned from insert(), which stays valid
+// until the proxy is removed.
+class DynamicAabbTree
+{
+public:
+
+  static constexpr int Null = -1;
+
+  // margin: how far the fat box reaches past the box on every side
+  // displacement_multiplier: how many frames of the displacement given to
+  //   update() the fat box is stretched by
+  explicit DynamicAabbTree(
+    double margin = 0.1,
+    double displacement_multiplier = 2.0);
+
+  int insert(const Aabb& box, std::size_t user_data);
+
+  void remove(int proxy);
+
+  // Move a proxy to box. Returns true if the leaf had to be reinserted.
+  bool update(
+    int proxy,
+    const Aabb& box,
+    const Eigen::Vector2d& displacement = Eigen::Vector2d::Zero());
+
+  void clear();
+
+  std::size_t user_data(int proxy) const;
+
+  const Aabb& fat_aabb(int proxy) const;
+
+  // Number of proxies in the tree
+  std::size_t size() const;
+
+  // Height of the root, with leaves at height 0
+  int height() const;
+
+  // Total perimeter of every node over the perimeter of the root. Lower
+  // values mean fewer wasted overlap tests during queries.
+  double area_ratio() const;
+
+  // Check the links, boxes and heights of every node
+  bool validate() const;
+
+  // Call callback(proxy) for every proxy whose fat box overlaps box. The
+  // query stops early if the callback returns false.
+  template<typename F>
+  void query(const Aabb& box, F callback) const
+  {
+    if (_root == Null)
+      return;
+
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(_root);
+    while (!stack.empty())
+    {
+      const int index = stack.back();
+      stack.pop_back();
+
+      const Node& node = _nodes[index];
+
+      if (!node.box.overlaps(box))
+        continue;
+
+      if (node.leaf())
+      {
+        if (!callback(index))
+          return;
+      }
+      else
+      {
+        stack.push_back(node.child1);
+        stack.push_back(node.child2);
+      }
+    }
+  }
+
+  // Call callback(proxy_a, proxy_b) once for every pair of proxies whose fat
+  // boxes overlap, with proxy_a < proxy_b
+  template<typename F>
+  void for_each_overlapping_pair(F callback) const
+  {
+    for (int i = 0; i < static_cast<int>(_nodes.size()); ++i)
+    {
+      const Node& node = _nodes[i];
+      if (node.height != 0)
+        continue;
+
+      query(node.box, [&](int other)
+        {
+          if (i < other)
+            callback(i, other);
+          return true;
+        });
+    }
+  }
+
+  // Call f(box, height, is_leaf) for every node in the tree, for drawing
+  template<typename F>
+  void for_each_node(F f) const
+  {
+    for (const Node& node : _nodes)
+    {
+      if (node.height >= 0)
+        f(node.box, node.height, node.leaf());
+    }
+  }
+
+private:
+
+  struct Node
+  {
+    Aabb box{Eigen::Vector2d::Zero(), Eigen::Vector2d::Zero()};
+
+    // Doubles as the next link of the free list while the node is unused
+    int parent = Null;
+    int child1 = Null;
+    int child2 = Null;
+
+    // 0 for leaves, -1 for unused nodes
+    int height = -1;
+    std::size_t user_data = 0;
+
+    bool leaf() const
+    {
+      return child1 == Null;
+    }
+  };
+
+  int allocate_node();
+  void free_node(int index);
+
+  void insert_leaf(int leaf);
+  void remove_leaf(int leaf);
+
+  // Refit boxes and heights from index up to the root, rotating any node
+  // whose children differ in height by more than one
+  void refit_upwards(int index);
+  int balance(int index);
+
+  int validate_subtree(int index, int parent) const;
+
+  Aabb fatten(const Aabb& box, const Eigen::Vector2d& displacement) const;
+
+  std::vector<Node> _nodes;
+  int _root = Null;
+  int _free = Null;
+  std::size_t _proxies = 0;
+
+  double _margin;
+  double _displacement_multiplier;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__DYNAMIC_AABB_TREE_HPP
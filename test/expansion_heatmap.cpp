@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "expansion_heatmap.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+constexpr std::size_t NoLane = std::numeric_limits<std::size_t>::max();
+
+// Arrival time of the last route from the parent that has one
+rmf_utils::optional<rmf_traffic::Time> arrival_time(
+  const rmf_traffic::agv::Planner::Debug::Node& node)
+{
+  const auto& routes = node.route_from_parent;
+  for (auto it = routes.rbegin(); it != routes.rend(); ++it)
+  {
+    if (const auto* finish = it->trajectory().finish_time())
+      return *finish;
+  }
+
+  return rmf_utils::nullopt;
+}
+
+std::uint8_t lerp(std::uint8_t a, std::uint8_t b, double t)
+{
+  return static_cast<std::uint8_t>(a + (b - a) * t + 0.5);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+ExpansionHeatmap::ExpansionHeatmap(const rmf_traffic::agv::Graph& graph)
+: _waypoint_counts(graph.num_waypoints(), 0),
+  _lane_counts(graph.num_lanes(), 0),
+  _reverse_lane(graph.num_lanes(), NoLane),
+  _waypoint_levels(graph.num_waypoints(), Unpainted),
+  _lane_levels(graph.num_lanes(), Unpainted),
+  _waypoint_dirty(graph.num_waypoints(), false),
+  _lane_dirty(graph.num_lanes(), false),
+  _num_waypoints(graph.num_waypoints())
+{
+  _lane_lookup.reserve(graph.num_lanes());
+  for (std::size_t i = 0; i < graph.num_lanes(); ++i)
+  {
+    const auto& lane = graph.get_lane(i);
+    const std::uint64_t key =
+      std::uint64_t(lane.entry().waypoint_index()) * _num_waypoints
+      + lane.exit().waypoint_index();
+    _lane_lookup.push_back({key, i});
+  }
+  std::sort(_lane_lookup.begin(), _lane_lookup.end());
+
+  for (std::size_t i = 0; i < graph.num_lanes(); ++i)
+  {
+    const auto& lane = graph.get_lane(i);
+    const std::uint64_t key =
+      std::uint64_t(lane.exit().waypoint_index()) * _num_waypoints
+      + lane.entry().waypoint_index();
+    const auto it = std::lower_bound(_lane_lookup.begin(), _lane_lookup.end(),
+        std::make_pair(key, std::size_t(0)));
+    if (it != _lane_lookup.end() && it->first == key)
+      _reverse_lane[i] = it->second;
+  }
+}
+
+//==============================================================================
+void ExpansionHeatmap::record(const ConstNodePtr& node, int step)
+{
+  Expansion expansion;
+  if (node)
+  {
+    expansion.waypoint = node->waypoint;
+    expansion.time = arrival_time(*node);
+
+    if (node->waypoint && node->parent && node->parent->waypoint
+      && *node->parent->waypoint != *node->waypoint)
+    {
+      const std::uint64_t key =
+        std::uint64_t(*node->parent->waypoint) * _num_waypoints
+        + *node->waypoint;
+      const auto it = std::lower_bound(
+        _lane_lookup.begin(), _lane_lookup.end(),
+        std::make_pair(key, std::size_t(0)));
+      if (it != _lane_lookup.end() && it->first == key)
+        expansion.lane = it->second;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  const std::size_t index = static_cast<std::size_t>(std::max(1, step) - 1);
+  if (index < _expansions.size())
+  {
+    while (_expansions.size() > index)
+    {
+      count(_expansions.back(), -1);
+      _expansions.pop_back();
+    }
+    update_scale();
+  }
+
+  // Steps that were taken without being recorded keep their place empty
+  _expansions.resize(index);
+  _expansions.push_back(expansion);
+  count(expansion, 1);
+}
+
+//==============================================================================
+void ExpansionHeatmap::rewind(int steps)
+{
+  const std::size_t size = static_cast<std::size_t>(std::max(0, steps));
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_expansions.size() <= size)
+    return;
+
+  while (_expansions.size() > size)
+  {
+    count(_expansions.back(), -1);
+    _expansions.pop_back();
+  }
+  update_scale();
+}
+
+//==============================================================================
+void ExpansionHeatmap::clear()
+{
+  rewind(0);
+}
+
+//==============================================================================
+void ExpansionHeatmap::apply(Graph& drawable)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_scale != _painted_scale)
+  {
+    // Every level depends on the scale
+    for (std::size_t i = 0; i < _waypoint_counts.size(); ++i)
+      mark_waypoint(i);
+
+    for (std::size_t i = 0; i < _lane_counts.size(); ++i)
+      mark_lane(i);
+
+    _painted_scale = _scale;
+  }
+
+  for (const auto i : _dirty_waypoints)
+  {
+    _waypoint_dirty[i] = false;
+    const auto new_level = level(_waypoint_counts[i]);
+    if (new_level == _waypoint_levels[i])
+      continue;
+
+    _waypoint_levels[i] = new_level;
+    drawable.paint_waypoint(i, color(new_level));
+  }
+  _dirty_waypoints.clear();
+
+  for (const auto i : _dirty_lanes)
+  {
+    _lane_dirty[i] = false;
+    const auto new_level = level(lane_total(i));
+    if (new_level == _lane_levels[i])
+      continue;
+
+    _lane_levels[i] = new_level;
+    drawable.paint_lane(i, color(new_level));
+  }
+  _dirty_lanes.clear();
+}
+
+//==============================================================================
+void ExpansionHeatmap::remove(Graph& drawable)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (std::size_t i = 0; i < _waypoint_levels.size(); ++i)
+  {
+    if (_waypoint_levels[i] == Unpainted)
+      continue;
+
+    drawable.paint_waypoint(i, rmf_utils::nullopt);
+    _waypoint_levels[i] = Unpainted;
+  }
+
+  for (std::size_t i = 0; i < _lane_levels.size(); ++i)
+  {
+    if (_lane_levels[i] == Unpainted)
+      continue;
+
+    drawable.paint_lane(i, rmf_utils::nullopt);
+    _lane_levels[i] = Unpainted;
+  }
+
+  _painted_scale = 0;
+}
+
+//==============================================================================
+std::size_t ExpansionHeatmap::expansion_count() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _expansions.size();
+}
+
+//==============================================================================
+auto ExpansionHeatmap::expansion(int step) const
+-> rmf_utils::optional<Expansion>
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (step < 1 || _expansions.size() < static_cast<std::size_t>(step))
+    return rmf_utils::nullopt;
+
+  return _expansions[step - 1];
+}
+
+//==============================================================================
+std::size_t ExpansionHeatmap::waypoint_count(std::size_t waypoint) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_waypoint_counts.size() <= waypoint)
+    return 0;
+
+  return _waypoint_counts[waypoint];
+}
+
+//==============================================================================
+std::size_t ExpansionHeatmap::lane_count(std::size_t lane) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_lane_counts.size() <= lane)
+    return 0;
+
+  return lane_total(lane);
+}
+
+//==============================================================================
+std::size_t ExpansionHeatmap::max_count() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _max_count;
+}
+
+//==============================================================================
+auto ExpansionHeatmap::time_span() const
+-> rmf_utils::optional<std::pair<rmf_traffic::Time, rmf_traffic::Time>>
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  rmf_utils::optional<std::pair<rmf_traffic::Time, rmf_traffic::Time>> span;
+  for (const auto& expansion : _expansions)
+  {
+    if (!expansion.time)
+      continue;
+
+    const auto t = *expansion.time;
+    if (!span)
+      span = std::make_pair(t, t);
+    else
+      span = std::make_pair(std::min(span->first, t), std::max(span->second, t));
+  }
+
+  return span;
+}
+
+//==============================================================================
+sf::Color ExpansionHeatmap::ramp(double fraction)
+{
+  // Blue through green and yellow to red
+  struct Stop
+  {
+    std::uint8_t r, g, b;
+  };
+  static const Stop stops[] = {
+    {40, 60, 200}, {40, 200, 80}, {240, 220, 40}, {220, 40, 40}};
+  constexpr std::size_t num_stops = sizeof(stops) / sizeof(stops[0]);
+
+  const double x = std::min(1.0, std::max(0.0, fraction)) * (num_stops - 1);
+  const std::size_t i = std::min(num_stops - 2, static_cast<std::size_t>(x));
+  const double t = x - i;
+  const Stop& a = stops[i];
+  const Stop& b = stops[i+1];
+  return sf::Color(lerp(a.r, b.r, t), lerp(a.g, b.g, t), lerp(a.b, b.b, t));
+}
+
+//==============================================================================
+void ExpansionHeatmap::count(const Expansion& expansion, int delta)
+{
+  if (expansion.waypoint && *expansion.waypoint < _waypoint_counts.size())
+  {
+    const auto w = *expansion.waypoint;
+    _waypoint_counts[w] += delta;
+    _max_count = std::max(_max_count, _waypoint_counts[w]);
+    mark_waypoint(w);
+  }
+
+  if (expansion.lane && *expansion.lane < _lane_counts.size())
+  {
+    const auto l = *expansion.lane;
+    _lane_counts[l] += delta;
+    _max_count = std::max(_max_count, lane_total(l));
+    mark_lane(l);
+    if (_reverse_lane[l] != NoLane)
+      mark_lane(_reverse_lane[l]);
+  }
+
+  while (_scale < _max_count)
+    _scale *= 2;
+}
+
+//==============================================================================
+void ExpansionHeatmap::mark_waypoint(std::size_t waypoint)
+{
+  if (_waypoint_dirty[waypoint])
+    return;
+
+  _waypoint_dirty[waypoint] = true;
+  _dirty_waypoints.push_back(waypoint);
+}
+
+//==============================================================================
+void ExpansionHeatmap::mark_lane(std::size_t lane)
+{
+  if (_lane_dirty[lane])
+    return;
+
+  _lane_dirty[lane] = true;
+  _dirty_lanes.push_back(lane);
+}
+
+//==============================================================================
+std::size_t ExpansionHeatmap::lane_total(std::size_t lane) const
+{
+  std::size_t total = _lane_counts[lane];
+  if (_reverse_lane[lane] != NoLane)
+    total += _lane_counts[_reverse_lane[lane]];
+
+  return total;
+}
+
+//==============================================================================
+std::uint8_t ExpansionHeatmap::level(std::size_t count) const
+{
+  if (count == 0)
+    return Unpainted;
+
+  return static_cast<std::uint8_t>(
+    1 + std::min<std::size_t>(Levels - 1, count * (Levels - 1) / _scale));
+}
+
+//==============================================================================
+void ExpansionHeatmap::update_scale()
+{
+  // Counts drop while rewinding, so the highest one is searched again and the
+  // scale may shrink
+  _max_count = 0;
+  for (const auto c : _waypoint_counts)
+    _max_count = std::max(_max_count, c);
+
+  for (std::size_t i = 0; i < _lane_counts.size(); ++i)
+    _max_count = std::max(_max_count, lane_total(i));
+
+  _scale = 1;
+  while (_scale < _max_count)
+    _scale *= 2;
+}
+
+//==============================================================================
+rmf_utils::optional<sf::Color> ExpansionHeatmap::color(std::uint8_t level)
+{
+  if (level == Unpainted)
+    return rmf_utils::nullopt;
+
+  return ramp(double(level - 1) / (Levels - 1));
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__EXPANSION_HEATMAP_HPP
+#define RMF_PLANNER_VIZ__DRAW__EXPANSION_HEATMAP_HPP
+
+#include <rmf_traffic/Time.hpp>
+#include <rmf_traffic/agv/Graph.hpp>
+#include <rmf_traffic/agv/debug/debug_Planner.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <rmf_planner_viz/draw/Graph.hpp>
+
+#include <SFML/Graphics/Color.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Counts where an A* search spends its expansions, per waypoint and per lane
+// of the graph, and paints the counts onto a Graph drawable as a color ramp.
+//
+// Each expansion only touches its own counters and marks their elements, so
+// apply() repaints the few lanes and waypoints that changed instead of the
+// whole graph. The ramp is scaled by the power of two at or above the
+// highest count, so the graph only gets repainted in full when that scale
+// changes, which happens a handful of times per search.
+//
+// record() may be called from the thread that steps the search while the
+// window thread calls apply().
+class ExpansionHeatmap
+{
+public:
+
+  using ConstNodePtr = rmf_traffic::agv::Planner::Debug::ConstNodePtr;
+
+  struct Expansion
+  {
+    rmf_utils::optional<std::size_t> waypoint;
+
+    // The lane that led to the waypoint from the waypoint of the parent node
+    rmf_utils::optional<std::size_t> lane;
+
+    // When the robot reaches the node
+    rmf_utils::optional<rmf_traffic::Time> time;
+  };
+
+  explicit ExpansionHeatmap(const rmf_traffic::agv::Graph& graph);
+
+  // Count the node expanded by the given step, counted from 1. A step at or
+  // before the last recorded one rewinds the heatmap to just before it
+  // first, so a search that jumps back and steps forward again is not
+  // counted twice.
+  void record(const ConstNodePtr& node, int step);
+
+  // Forget every expansion after the given number of steps
+  void rewind(int steps);
+
+  void clear();
+
+  // Paint the lanes and waypoints whose color changed since the last call
+  void apply(Graph& drawable);
+
+  // Take the paint of the heatmap off the drawable. The next apply() paints
+  // every counted element again.
+  void remove(Graph& drawable);
+
+  std::size_t expansion_count() const;
+
+  // The expansions of the given step, counted from 1
+  rmf_utils::optional<Expansion> expansion(int step) const;
+
+  std::size_t waypoint_count(std::size_t waypoint) const;
+
+  // Expansions through a lane, together with its reverse lane since both are
+  // drawn as one
+  std::size_t lane_count(std::size_t lane) const;
+
+  std::size_t max_count() const;
+
+  // Earliest and latest time of the counted expansions
+  rmf_utils::optional<std::pair<rmf_traffic::Time, rmf_traffic::Time>>
+  time_span() const;
+
+  // Color of a count that is the given fraction of the highest one
+  static sf::Color ramp(double fraction);
+
+private:
+
+  static constexpr std::uint8_t Unpainted = 0;
+  static constexpr std::uint8_t Levels = 32;
+
+  // Also marks the elements of the expansion as dirty
+  void count(const Expansion& expansion, int delta);
+
+  void mark_waypoint(std::size_t waypoint);
+  void mark_lane(std::size_t lane);
+
+  std::size_t lane_total(std::size_t lane) const;
+
+  // Ramp level of a count under the current scale, or Unpainted
+  std::uint8_t level(std::size_t count) const;
+
+  static rmf_utils::optional<sf::Color> color(std::uint8_t level);
+
+  void update_scale();
+
+  mutable std::mutex _mutex;
+
+  std::vector<Expansion> _expansions;
+
+  // Indexed by graph waypoint and lane index
+  std::vector<std::size_t> _waypoint_counts;
+  std::vector<std::size_t> _lane_counts;
+  std::vector<std::size_t> _reverse_lane;
+
+  // The ramp level each element was last painted with, and the elements that
+  // may need a new one
+  std::vector<std::uint8_t> _waypoint_levels;
+  std::vector<std::uint8_t> _lane_levels;
+  std::vector<std::size_t> _dirty_waypoints;
+  std::vector<std::size_t> _dirty_lanes;
+  std::vector<bool> _waypoint_dirty;
+  std::vector<bool> _lane_dirty;
+
+  std::size_t _max_count = 0;
+  std::size_t _scale = 1;
+  std::size_t _painted_scale = 0;
+
+  // Lookup of a lane from its entry and exit waypoints
+  std::size_t _num_waypoints;
+  std::vector<std::pair<std::uint64_t, std::size_t>> _lane_lookup;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__EXPANSION_HEATMAP_HPP
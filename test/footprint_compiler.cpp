@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "footprint_compiler.hpp"
+
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+void add_circle(CompiledFootprint& out, double x, double y, double radius)
+{
+  fcl::Transform3d tx;
+  tx.setIdentity();
+  tx.translation() = Eigen::Vector3d(x, y, 0.0);
+  out.shapes.emplace_back(tx, radius);
+  out.bounding_radius = std::max(
+    out.bounding_radius, std::sqrt(x * x + y * y) + radius);
+}
+
+// Grid of nx by ny circles over a box centered on the origin, each circle
+// passing through the corners of its cell
+CompiledFootprint cover_box(double x_length, double y_length,
+  std::size_t nx, std::size_t ny)
+{
+  const double w = x_length / nx;
+  const double h = y_length / ny;
+  const double radius = 0.5 * std::sqrt(w * w + h * h);
+
+  CompiledFootprint out;
+  for (std::size_t i = 0; i < nx; ++i)
+  {
+    for (std::size_t j = 0; j < ny; ++j)
+    {
+      add_circle(out,
+        -0.5 * x_length + (i + 0.5) * w,
+        -0.5 * y_length + (j + 0.5) * h,
+        radius);
+    }
+  }
+
+  // The circles bulge out furthest across the shorter side of a cell
+  out.cover_error = radius - 0.5 * std::min(w, h);
+  return out;
+}
+
+// Circle around the knots, which holds the whole spline
+void knot_circle(const std::array<Eigen::Vector3d, 4>& knots,
+  Eigen::Vector2d& center, double& radius)
+{
+  center = Eigen::Vector2d::Zero();
+  for (const auto& k : knots)
+    center += k.head<2>();
+  center /= 4.0;
+
+  radius = 0.0;
+  for (const auto& k : knots)
+    radius = std::max(radius, (k.head<2>() - center).norm());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+FootprintCompiler::FootprintCompiler(const FootprintCompilerOptions& options)
+: _options(options)
+{
+  // Do nothing
+}
+
+//==============================================================================
+CompiledFootprint FootprintCompiler::compile(
+  const rmf_traffic::geometry::FinalConvexShape& shape) const
+{
+  const auto& source = shape.source();
+
+  if (const auto* circle =
+    dynamic_cast<const rmf_traffic::geometry::Circle*>(&source))
+  {
+    CompiledFootprint out;
+    add_circle(out, 0.0, 0.0, circle->get_radius());
+    return out;
+  }
+
+  if (const auto* box =
+    dynamic_cast<const rmf_traffic::geometry::Box*>(&source))
+  {
+    const double x_length = box->get_x_length();
+    const double y_length = box->get_y_length();
+    const std::size_t max_circles = std::max<std::size_t>(1, _options.max_circles);
+
+    std::size_t best_nx = 1;
+    std::size_t best_ny = 1;
+    double best_error = std::numeric_limits<double>::infinity();
+    bool best_fits = false;
+    for (std::size_t n = 1; n <= max_circles && !best_fits; ++n)
+    {
+      for (std::size_t nx = 1; nx <= n; ++nx)
+      {
+        if (n % nx != 0)
+          continue;
+
+        const std::size_t ny = n / nx;
+        const double error = cover_box(x_length, y_length, nx, ny).cover_error;
+        if (error < best_error)
+        {
+          best_error = error;
+          best_nx = nx;
+          best_ny = ny;
+          best_fits = error <= _options.max_error;
+        }
+      }
+    }
+
+    return cover_box(x_length, y_length, best_nx, best_ny);
+  }
+
+  CompiledFootprint out;
+  add_circle(out, 0.0, 0.0, shape.get_characteristic_length());
+  return out;
+}
+
+//==============================================================================
+std::shared_ptr<const CompiledProfile> FootprintCompiler::compile(
+  const rmf_traffic::Profile& profile)
+{
+  const auto& footprint = profile.footprint();
+  const auto& vicinity = profile.vicinity();
+  const ProfileKey key{footprint.get(), vicinity.get()};
+
+  const auto it = _profiles.find(key);
+  if (it != _profiles.end())
+    return it->second.compiled;
+
+  auto compiled = std::make_shared<CompiledProfile>();
+  if (footprint)
+    compiled->footprint = compile(*footprint);
+
+  if (vicinity && vicinity != footprint)
+    compiled->vicinity = compile(*vicinity);
+  else
+    compiled->vicinity = compiled->footprint;
+
+  _profiles.insert({key, Entry{footprint, vicinity, compiled}});
+  return compiled;
+}
+
+//==============================================================================
+std::shared_ptr<const FootprintPair> FootprintCompiler::pair(
+  const CompiledFootprint& a,
+  const CompiledFootprint& b)
+{
+  const PairKey key{&a, &b};
+  const auto it = _pairs.find(key);
+  if (it != _pairs.end())
+    return it->second;
+
+  auto pair = std::make_shared<FootprintPair>();
+  pair->radius_sums.reserve(a.shapes.size() * b.shapes.size());
+  for (const auto& a_shape : a.shapes)
+  {
+    for (const auto& b_shape : b.shapes)
+      pair->radius_sums.push_back(a_shape._radius + b_shape._radius);
+  }
+  pair->bounding_radius_sum = a.bounding_radius + b.bounding_radius;
+
+  _pairs.insert({key, pair});
+  return pair;
+}
+
+//==============================================================================
+std::size_t FootprintCompiler::cached_profiles() const
+{
+  return _profiles.size();
+}
+
+//==============================================================================
+void FootprintCompiler::clear()
+{
+  _profiles.clear();
+  _pairs.clear();
+}
+
+//==============================================================================
+CcdResult collide_footprints(
+  const std::array<Eigen::Vector3d, 4>& a_knots,
+  const std::array<Eigen::Vector3d, 4>& b_knots,
+  const CompiledFootprint& a,
+  const CompiledFootprint& b,
+  const FootprintPair& pair,
+  const CcdOptions& options)
+{
+  Eigen::Vector2d a_center, b_center;
+  double a_reach = 0.0, b_reach = 0.0;
+  knot_circle(a_knots, a_center, a_reach);
+  knot_circle(b_knots, b_center, b_reach);
+
+  const double gap = (a_center - b_center).norm()
+    - (a_reach + b_reach + pair.bounding_radius_sum);
+  if (gap > options.tolerance)
+  {
+    CcdResult result;
+    result.safe_time = 1.0;
+    return result;
+  }
+
+  return collide_seperable_circles(
+    SplineMotion2D(a_knots), SplineMotion2D(b_knots),
+    a.shapes, b.shapes, pair.radius_sums, options);
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
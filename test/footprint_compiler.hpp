@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__FOOTPRINT_COMPILER_HPP
+#define RMF_PLANNER_VIZ__DRAW__FOOTPRINT_COMPILER_HPP
+
+#include <rmf_traffic/Profile.hpp>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "test_sidecar_utils.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Circle cover of a footprint shape, in the body frame of the robot
+struct CompiledFootprint
+{
+  std::vector<ModelSpaceShape> shapes;
+
+  // Radius of the circle around the robot origin that holds every shape
+  double bounding_radius = 0.0;
+
+  // How far the cover reaches outside the original shape at most. Zero for
+  // circles and for shapes that fall back to their characteristic length.
+  double cover_error = 0.0;
+};
+
+struct CompiledProfile
+{
+  CompiledFootprint footprint;
+  CompiledFootprint vicinity;
+};
+
+// Values shared by every check between two compiled footprints
+struct FootprintPair
+{
+  // Radius sum of every pair of circles, with the circles of a as rows
+  std::vector<double> radius_sums;
+
+  double bounding_radius_sum = 0.0;
+};
+
+struct FootprintCompilerOptions
+{
+  // Meters
+  double max_error = 0.15;
+  std::size_t max_circles = 6;
+};
+
+// Turns the shapes of rmf_traffic profiles into the circle sets that
+// collide_seperable_circles works on. Circles are kept as they are. Boxes
+// get the grid of circles with the fewest circles that reaches no further
+// than max_error outside the box, or the tightest grid of at most max_circles
+// if none does. Other shapes fall back to the circle of their characteristic
+// length.
+//
+// Compiled profiles and pairs are cached by the shapes they were made from,
+// so every robot of a fleet shares them. The cache is not thread safe.
+class FootprintCompiler
+{
+public:
+
+  explicit FootprintCompiler(
+    const FootprintCompilerOptions& options = FootprintCompilerOptions());
+
+  CompiledFootprint compile(
+    const rmf_traffic::geometry::FinalConvexShape& shape) const;
+
+  std::shared_ptr<const CompiledProfile> compile(
+    const rmf_traffic::Profile& profile);
+
+  // a and b must come from this compiler
+  std::shared_ptr<const FootprintPair> pair(
+    const CompiledFootprint& a,
+    const CompiledFootprint& b);
+
+  std::size_t cached_profiles() const;
+
+  void clear();
+
+private:
+
+  struct Entry
+  {
+    // Kept so the shapes used as keys cannot be freed and reused
+    rmf_traffic::geometry::ConstFinalConvexShapePtr footprint;
+    rmf_traffic::geometry::ConstFinalConvexShapePtr vicinity;
+    std::shared_ptr<const CompiledProfile> compiled;
+  };
+
+  using ProfileKey = std::pair<const void*, const void*>;
+  using PairKey = std::pair<const CompiledFootprint*, const CompiledFootprint*>;
+
+  FootprintCompilerOptions _options;
+  std::map<ProfileKey, Entry> _profiles;
+  std::map<PairKey, std::shared_ptr<const FootprintPair>> _pairs;
+};
+
+// Check two robots with compiled footprints that follow the splines of the
+// given knots. Motions whose bounding circles stay further than tolerance
+// apart are rejected before any stepping: each spline stays inside the
+// circle around its knots, so the robot stays inside that circle grown by its
+// bounding radius.
+CcdResult collide_footprints(
+  const std::array<Eigen::Vector3d, 4>& a_knots,
+  const std::array<Eigen::Vector3d, 4>& b_knots,
+  const CompiledFootprint& a,
+  const CompiledFootprint& b,
+  const FootprintPair& pair,
+  const CcdOptions& options = CcdOptions());
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__FOOTPRINT_COMPILER_HPP
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "offset_trajectory.hpp"
+
+#include <rmf_planner_viz/draw/IMDraw.hpp>
+
+#include <algorithm>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+// Upper bound of |d/ds (x, y)| and |d/ds yaw| over s in [0, 1], from the
+// power basis coefficients of the spline that SplineMotion2D also uses
+void max_speeds(const std::array<Eigen::Vector3d, 4>& k,
+  double& linear, double& angular)
+{
+  const Eigen::Vector3d c1 = (k[2] - k[0]) / 2.0;
+  const Eigen::Vector3d c2 = (k[0] - 2.0 * k[1] + k[2]) / 2.0;
+  const Eigen::Vector3d c3 = (-k[0] + 3.0 * k[1] - 3.0 * k[2] + k[3]) / 6.0;
+
+  linear = c1.head<2>().norm() + 2.0 * c2.head<2>().norm()
+    + 3.0 * c3.head<2>().norm();
+  angular = std::abs(c1[2]) + 2.0 * std::abs(c2[2]) + 3.0 * std::abs(c3[2]);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+OffsetTrajectory::OffsetTrajectory(
+  const std::array<Eigen::Vector3d, 4>& knots,
+  const fcl::Transform3d& offset,
+  std::size_t segments)
+: _knots(knots),
+  _motion(knots),
+  _offset(offset.translation().head<2>())
+{
+  segments = std::max<std::size_t>(1, segments);
+
+  _points.reserve(segments + 1);
+  for (std::size_t i = 0; i <= segments; ++i)
+    _points.push_back(position(static_cast<double>(i) / segments));
+
+  // Every parameter is within half a step of a sample, and the point moves
+  // no faster than the robot plus its turning rate times the offset
+  double linear = 0.0, angular = 0.0;
+  max_speeds(_knots, linear, angular);
+  _max_deviation = 0.5 * (linear + angular * _offset.norm()) / segments;
+
+  _bounds.min = _points.front();
+  _bounds.max = _points.front();
+  for (const auto& p : _points)
+  {
+    _bounds.min = _bounds.min.cwiseMin(p);
+    _bounds.max = _bounds.max.cwiseMax(p);
+  }
+
+  _bounds.min.array() -= _max_deviation;
+  _bounds.max.array() += _max_deviation;
+}
+
+//==============================================================================
+const std::array<Eigen::Vector3d, 4>& OffsetTrajectory::knots() const
+{
+  return _knots;
+}
+
+//==============================================================================
+const SplineMotion2D& OffsetTrajectory::motion() const
+{
+  return _motion;
+}
+
+//==============================================================================
+const Eigen::Vector2d& OffsetTrajectory::offset() const
+{
+  return _offset;
+}
+
+//==============================================================================
+Eigen::Vector2d OffsetTrajectory::position(double s) const
+{
+  return _motion.pose(s).apply(_offset.x(), _offset.y());
+}
+
+//==============================================================================
+const std::vector<Eigen::Vector2d>& OffsetTrajectory::points() const
+{
+  return _points;
+}
+
+//==============================================================================
+double OffsetTrajectory::max_deviation() const
+{
+  return _max_deviation;
+}
+
+//==============================================================================
+const SweptBounds& OffsetTrajectory::bounds() const
+{
+  return _bounds;
+}
+
+//==============================================================================
+SweptBounds OffsetTrajectory::swept_bounds(double radius) const
+{
+  SweptBounds bounds = _bounds;
+  bounds.min.array() -= radius;
+  bounds.max.array() += radius;
+  return bounds;
+}
+
+//==============================================================================
+ModelSpaceShape OffsetTrajectory::shape(double radius) const
+{
+  fcl::Transform3d tx;
+  tx.setIdentity();
+  tx.translation() = Eigen::Vector3d(_offset.x(), _offset.y(), 0.0);
+  return ModelSpaceShape(tx, radius);
+}
+
+//==============================================================================
+void OffsetTrajectory::draw(const sf::Color& color) const
+{
+  for (std::size_t i = 1; i < _points.size(); ++i)
+  {
+    const auto& p0 = _points[i - 1];
+    const auto& p1 = _points[i];
+    IMDraw::draw_line(
+      sf::Vector2f(p0.x(), p0.y()), sf::Vector2f(p1.x(), p1.y()), color);
+  }
+}
+
+//==============================================================================
+void OffsetTrajectory::draw_at(
+  double s,
+  double radius,
+  const sf::Color& color) const
+{
+  const Eigen::Vector2d p = position(s);
+  IMDraw::draw_circle(sf::Vector2f(p.x(), p.y()), radius, color);
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__OFFSET_TRAJECTORY_HPP
+#define RMF_PLANNER_VIZ__DRAW__OFFSET_TRAJECTORY_HPP
+
+#include <array>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <SFML/Graphics/Color.hpp>
+
+#include "spline_motion_2d.hpp"
+#include "test_sidecar_utils.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Path traced by a point attached to a robot, such as the center of a
+// sidecar circle, while the robot follows the spline of the given knots.
+//
+// The path is sampled once on construction. The polyline and its bounds are
+// kept, so drawing the offset footprints of a whole fleet every frame only
+// walks cached points instead of integrating every spline again.
+//
+// Only the planar translation of the offset is used, as with the circles of
+// ModelSpaceShape.
+class OffsetTrajectory
+{
+public:
+
+  // An empty path with no points
+  OffsetTrajectory() = default;
+
+  // segments: how many pieces the polyline is made of
+  OffsetTrajectory(
+    const std::array<Eigen::Vector3d, 4>& knots,
+    const fcl::Transform3d& offset,
+    std::size_t segments = 100);
+
+  const std::array<Eigen::Vector3d, 4>& knots() const;
+
+  const SplineMotion2D& motion() const;
+
+  const Eigen::Vector2d& offset() const;
+
+  // Exact position of the point at parameter s of the motion
+  Eigen::Vector2d position(double s) const;
+
+  // The point at segments + 1 evenly spaced parameters from 0 to 1
+  const std::vector<Eigen::Vector2d>& points() const;
+
+  // How far the path can stray from the nearest sample between samples,
+  // from a bound on the speed of the point over the whole motion
+  double max_deviation() const;
+
+  // Box that holds the whole path, not only the samples: the box around the
+  // samples grown by max_deviation()
+  const SweptBounds& bounds() const;
+
+  // CCD input for a circle of the given radius centered on the point. The
+  // swept bounds go with swept_bounds_overlap as a broad phase, and the
+  // shape goes with motion() into collide_seperable_circles, which checks
+  // the offset exactly.
+  SweptBounds swept_bounds(double radius) const;
+
+  ModelSpaceShape shape(double radius) const;
+
+  void draw(const sf::Color& color = sf::Color(255, 255, 255, 255)) const;
+
+  // Draw the circle of the given radius at parameter s
+  void draw_at(
+    double s,
+    double radius,
+    const sf::Color& color = sf::Color(255, 255, 255, 255)) const;
+
+private:
+  std::array<Eigen::Vector3d, 4> _knots{{
+    Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(),
+    Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()}};
+  SplineMotion2D _motion;
+  Eigen::Vector2d _offset = Eigen::Vector2d::Zero();
+  std::vector<Eigen::Vector2d> _points;
+  double _max_deviation = 0.0;
+  SweptBounds _bounds{Eigen::Vector2d::Zero(), Eigen::Vector2d::Zero()};
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__OFFSET_TRAJECTORY_HPP
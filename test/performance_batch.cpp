@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <SFML/Graphics.hpp>
+
+#include <rmf_planner_viz/draw/Fit.hpp>
+#include <rmf_planner_viz/draw/Graph.hpp>
+#include <rmf_planner_viz/draw/Schedule.hpp>
+#include <rmf_planner_viz/draw/Trajectory.hpp>
+
+#include <rmf_traffic/agv/debug/debug_Planner.hpp>
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "scenario_loading.hpp"
+#include "thread_pool.hpp"
+
+// Plans every scenario of a directory without opening a window, several
+// scenarios at a time, and writes the timings, plan costs and node counts to
+// a CSV file. Snapshots of the result can be rendered offscreen.
+
+const std::size_t NotObstacleID = std::numeric_limits<std::size_t>::max();
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+  std::string directory;
+  std::string csv = "performance_batch.csv";
+  std::size_t threads = 0;
+
+  // Steps the search is allowed to expand when counting nodes. 0 skips the
+  // count.
+  std::size_t max_steps = 1000000;
+
+  // Empty to skip snapshots
+  std::string snapshot_directory;
+  unsigned int snapshot_size = 1024;
+};
+
+struct Result
+{
+  std::string file;
+  std::string error;
+
+  double parse_time = 0.0;
+  double schedule_time = 0.0;
+  double plan_time = 0.0;
+  std::size_t obstacles = 0;
+
+  bool success = false;
+  double cost = 0.0;
+
+  // Progress::step() calls until a plan was found, and the size of the queue
+  // by then
+  std::size_t expansions = 0;
+  std::size_t queue_size = 0;
+  bool search_finished = false;
+
+  bool snapshot = false;
+};
+
+double seconds_since(const Clock::time_point& start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+  return s.size() >= suffix.size()
+    && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<std::string> find_scenarios(const std::string& directory)
+{
+  std::vector<std::string> files;
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+    return files;
+
+  while (const dirent* entry = readdir(dir))
+  {
+    const std::string name = entry->d_name;
+    if (ends_with(name, ".yaml") || ends_with(name, ".yml"))
+      files.push_back(directory + "/" + name);
+  }
+  closedir(dir);
+
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+std::string snapshot_name(const std::string& file)
+{
+  std::string name = file.substr(file.find_last_of('/') + 1);
+  name = name.substr(0, name.find_last_of('.'));
+  return name + ".png";
+}
+
+// Render the graph, the obstacles and the plan of a scenario into an image.
+// The font is shared by every scenario and its glyphs are loaded as they are
+// drawn, so only one snapshot is rendered at a time.
+bool save_snapshot(
+  const std::string& filename,
+  unsigned int size,
+  const sf::Font& font,
+  const rmf_traffic::agv::Graph& graph,
+  const rmf_traffic::Profile& profile,
+  const std::shared_ptr<rmf_traffic::schedule::Database>& database,
+  const std::string& map,
+  const rmf_traffic::Time start_time,
+  const std::vector<rmf_traffic::Route>& itinerary)
+{
+  static std::mutex render_mutex;
+  std::lock_guard<std::mutex> lock(render_mutex);
+
+  sf::RenderTexture texture;
+  if (!texture.create(size, size))
+    return false;
+
+  rmf_planner_viz::draw::Graph graph_drawable(graph, 1.0, font);
+  graph_drawable.choose_map(map);
+
+  rmf_planner_viz::draw::Schedule schedule_drawable(
+    database, 0.25, map, start_time);
+
+  rmf_planner_viz::draw::Fit fit({graph_drawable.bounds()}, 0.02);
+
+  sf::RenderStates states;
+  fit.apply_transform(states.transform, texture.getSize());
+
+  texture.clear();
+  texture.draw(graph_drawable, states);
+  texture.draw(schedule_drawable, states);
+  for (const auto& route : itinerary)
+  {
+    if (route.map() != map || route.trajectory().size() < 2)
+      continue;
+
+    const rmf_planner_viz::draw::Trajectory trajectory(
+      route.trajectory(), profile, *route.trajectory().start_time(),
+      rmf_utils::nullopt, sf::Color::Green, {0.0, 0.0}, 0.5f);
+    texture.draw(trajectory, states);
+  }
+  texture.display();
+
+  return texture.getTexture().copyToImage().saveToFile(filename);
+}
+
+void run_scenario(const Options& options, const sf::Font* font, Result& result)
+{
+  auto t0 = Clock::now();
+  const auto scenario = rmf_planner_viz::draw::Scenario::load(result.file);
+  result.parse_time = seconds_since(t0);
+
+  const auto start_time = rmf_traffic::Time(rmf_traffic::Duration(0));
+
+  // Scenarios already run in parallel, so each one plans its obstacles with a
+  // single worker
+  t0 = Clock::now();
+  const auto database = std::make_shared<rmf_traffic::schedule::Database>();
+  const auto obstacles = scenario->add_obstacles(database, start_time, 1);
+  result.schedule_time = seconds_since(t0);
+  result.obstacles = obstacles.size();
+
+  const auto& graph = scenario->plan_robot().graph();
+  const auto& profile = scenario->plan_robot().vehicle_traits().profile();
+
+  const auto obstacle_validator =
+    rmf_traffic::agv::ScheduleRouteValidator::make(
+    database, NotObstacleID, profile);
+
+  // A planner of its own, rather than one that shares the caches warmed up
+  // by the obstacle plans, so that plan_s is timed from a cold start
+  rmf_traffic::agv::Planner planner(
+    scenario->plan_robot(),
+    rmf_traffic::agv::Planner::Options(obstacle_validator));
+
+  const auto starts = scenario->starts(start_time);
+  const auto goal = scenario->goal();
+
+  t0 = Clock::now();
+  const auto planned = planner.plan(starts, goal);
+  result.plan_time = seconds_since(t0);
+  result.success = planned.success();
+  if (planned)
+    result.cost = planned->get_cost();
+
+  // The same search again through the debugger, which exposes its queue
+  if (options.max_steps > 0)
+  {
+    rmf_traffic::agv::Planner::Debug debug(planner);
+    auto progress = debug.begin(starts, goal, planner.get_default_options());
+
+    rmf_utils::optional<rmf_traffic::agv::Plan> found;
+    while (!found && !progress.queue().empty()
+      && result.expansions < options.max_steps)
+    {
+      found = progress.step();
+      ++result.expansions;
+    }
+    result.queue_size = progress.queue().size();
+    result.search_finished = found || progress.queue().empty();
+  }
+
+  if (font && !options.snapshot_directory.empty())
+  {
+    std::vector<rmf_traffic::Route> itinerary;
+    if (planned)
+      itinerary = planned->get_itinerary();
+
+    result.snapshot = save_snapshot(
+      options.snapshot_directory + "/" + snapshot_name(result.file),
+      options.snapshot_size, *font, graph, profile, database,
+      graph.get_waypoint(starts.front().waypoint()).get_map_name(),
+      starts.front().time(), itinerary);
+  }
+}
+
+// Quote a field that may hold commas or quotes
+std::string csv_field(const std::string& s)
+{
+  if (s.find_first_of(",\"\n") == std::string::npos)
+    return s;
+
+  std::string quoted = "\"";
+  for (const char c : s)
+  {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+bool write_csv(const std::string& filename, const std::vector<Result>& results)
+{
+  std::ofstream file(filename);
+  if (!file)
+    return false;
+
+  file << "scenario,parse_s,schedule_s,plan_s,obstacles,success,cost,"
+       << "expansions,queue_size,search_finished,snapshot,error\n";
+  for (const auto& r : results)
+  {
+    file << csv_field(r.file) << "," << r.parse_time << ","
+         << r.schedule_time << "," << r.plan_time << "," << r.obstacles << ","
+         << r.success << "," << r.cost << "," << r.expansions << ","
+         << r.queue_size << "," << r.search_finished << "," << r.snapshot << ","
+         << csv_field(r.error) << "\n";
+  }
+
+  return static_cast<bool>(file);
+}
+
+void print_usage(const char* name)
+{
+  std::cout << "Usage: " << name << " <scenario directory> [options]\n"
+            << "  --csv <file>           results file [performance_batch.csv]\n"
+            << "  --threads <n>          scenarios planned at once [all cores]\n"
+            << "  --max-steps <n>        expansions counted per search, 0 to "
+            << "skip [1000000]\n"
+            << "  --snapshots <dir>      render an image of every scenario\n"
+            << "  --snapshot-size <px>   width and height of the images [1024]"
+            << std::endl;
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+  if (argc < 2)
+    return false;
+
+  options.directory = argv[1];
+  for (int i = 2; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+      return false;
+
+    const std::string value = argv[++i];
+    if (arg == "--csv")
+      options.csv = value;
+    else if (arg == "--threads")
+      options.threads = std::stoul(value);
+    else if (arg == "--max-steps")
+      options.max_steps = std::stoul(value);
+    else if (arg == "--snapshots")
+      options.snapshot_directory = value;
+    else if (arg == "--snapshot-size")
+      options.snapshot_size = std::stoul(value);
+    else
+      return false;
+  }
+
+  return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  try
+  {
+    if (!parse_options(argc, argv, options))
+    {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  catch (const std::exception&)
+  {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  const auto files = find_scenarios(options.directory);
+  if (files.empty())
+  {
+    std::cout << "No scenario files in [" << options.directory << "]"
+              << std::endl;
+    return 1;
+  }
+
+  sf::Font font;
+  const sf::Font* snapshot_font = nullptr;
+  if (!options.snapshot_directory.empty())
+  {
+    if (rmf_planner_viz::draw::load_font(font))
+      snapshot_font = &font;
+    else
+      std::cout << "Snapshots are skipped" << std::endl;
+  }
+
+  std::vector<Result> results(files.size());
+  std::mutex print_mutex;
+  std::size_t done = 0;
+
+  const auto start = Clock::now();
+  {
+    rmf_planner_viz::draw::ThreadPool pool(options.threads);
+    std::cout << "Running " << files.size() << " scenarios on "
+              << pool.size() << " threads" << std::endl;
+
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      pool.submit([&, i]()
+        {
+          Result& result = results[i];
+          result.file = files[i];
+          try
+          {
+            run_scenario(options, snapshot_font, result);
+          }
+          catch (const std::exception& e)
+          {
+            result.error = e.what();
+          }
+
+          std::lock_guard<std::mutex> lock(print_mutex);
+          ++done;
+          std::cout << "[" << done << "/" << files.size() << "] "
+                    << result.file << ": ";
+          if (!result.error.empty())
+            std::cout << "error: " << result.error;
+          else
+            std::cout << (result.success ? "planned" : "no plan") << " in "
+                      << result.plan_time << " s";
+          std::cout << std::endl;
+        });
+    }
+    pool.wait();
+  }
+
+  std::size_t errors = 0;
+  std::size_t planned = 0;
+  for (const auto& r : results)
+  {
+    errors += r.error.empty() ? 0 : 1;
+    planned += r.success ? 1 : 0;
+  }
+
+  std::cout << "Planned " << planned << " of " << files.size()
+            << " scenarios in " << seconds_since(start) << " s, " << errors
+            << " failed to run" << std::endl;
+
+  if (!write_csv(options.csv, results))
+  {
+    std::cout << "Failed to write [" << options.csv << "]" << std::endl;
+    return 1;
+  }
+
+  return errors == 0 ? 0 : 1;
+}
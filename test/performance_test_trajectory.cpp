@@ -34,19 +34,15 @@
 
 #include "imgui-SFML.h"
 #include "planner_debug.hpp"
+#include "scenario_loading.hpp"
 
 const std::size_t NotObstacleID = std::numeric_limits<std::size_t>::max();
 
 int main(int argc, char* argv[])
 {
   sf::Font font;
-  if (!font.loadFromFile("./build/rmf_planner_viz/fonts/OpenSans-Bold.ttf"))
-  {
-    std::cout <<
-              "Failed to load font. Make sure you run the executable from the colcon directory"
-              << std::endl;
+  if (!rmf_planner_viz::draw::load_font(font))
     return -1;
-  }
 
   if (argc < 2)
   {
@@ -54,11 +50,10 @@ int main(int argc, char* argv[])
     return 0;
   }
 
-
-  rmf_performance_tests::scenario::Description scenario;
+  std::shared_ptr<const rmf_planner_viz::draw::Scenario> scenario;
   try
   {
-    parse(argv[1], scenario);
+    scenario = rmf_planner_viz::draw::Scenario::load(argv[1]);
   }
   catch (std::runtime_error& e)
   {
@@ -68,89 +63,16 @@ int main(int argc, char* argv[])
 
   using namespace std::chrono_literals;
 
-  const auto& plan_robot = scenario.robots.find(scenario.plan.robot);
-  if (plan_robot == scenario.robots.end())
-  {
-    std::cout << "Plan robot [" << scenario.plan.robot <<
-              "]'s traits and profile missing" << std::endl;
-    return 0;
-  }
-
-  const auto get_wp =
-      [&](const rmf_traffic::agv::Graph& graph, const std::string& name)
-      {
-        return graph.find_waypoint(name)->index();
-      };
+  const auto& plan_robot = scenario->plan_robot();
 
   const auto start_time = rmf_traffic::Time(rmf_traffic::Duration(0));
 
   const auto database = std::make_shared<rmf_traffic::schedule::Database>();
 
-  std::vector<rmf_traffic::schedule::Participant> obstacles;
-
-  for (const auto& obstacle : scenario.obstacle_plans)
-  {
-    const auto& robot = scenario.robots.find(obstacle.robot);
-
-    if (robot == scenario.robots.end())
-    {
-      std::cout << "Robot [" << obstacle.robot <<
-                "] is missing traits and profile. Using traits and profile of plan_robot."
-                << std::endl;
-
-      rmf_traffic::agv::Planner planner = rmf_traffic::agv::Planner{
-          plan_robot->second,
-          {nullptr}
-      };
-
-      obstacles.emplace_back(
-          rmf_performance_tests::add_obstacle(
-              planner, database,
-              {
-                  start_time + std::chrono::seconds(obstacle.initial_time),
-                  get_wp(plan_robot->second.graph(), obstacle.initial_waypoint),
-                  obstacle.initial_orientation * M_PI / 180.0
-              },
-              get_wp(plan_robot->second.graph(), obstacle.goal)
-          )
-      );
-    }
-    else
-    {
-      rmf_traffic::agv::Planner planner = rmf_traffic::agv::Planner{
-          robot->second,
-          {nullptr}
-      };
-
-      obstacles.emplace_back(
-          rmf_performance_tests::add_obstacle(
-              planner, database,
-              {
-                  start_time + std::chrono::seconds(obstacle.initial_time),
-                  get_wp(robot->second.graph(), obstacle.initial_waypoint),
-                  obstacle.initial_orientation * M_PI / 180.0
-              },
-              get_wp(robot->second.graph(), obstacle.goal)
-          )
-      );
-    }
-  }
-
-  for (const auto& obstacle : scenario.obstacle_routes)
-  {
-    const auto& robot = scenario.robots.at(obstacle.robot);
-
-    obstacles.emplace_back(
-        rmf_performance_tests::add_obstacle(
-            database,
-            robot.vehicle_traits().profile(),
-            obstacle.route));
-  }
-
-  const auto& plan = scenario.plan;
+  const auto obstacles = scenario->add_obstacles(database, start_time);
 
   rmf_planner_viz::draw::Graph graph_0_drawable(
-      plan_robot->second.graph(), 1.0, font);
+      plan_robot.graph(), 1.0, font);
   std::vector<std::string> map_names = graph_0_drawable.get_map_names();
   std::string chosen_map = argv[2];
   if (graph_0_drawable.current_map())
@@ -159,34 +81,23 @@ int main(int argc, char* argv[])
 
   const auto obstacle_validator =
       rmf_traffic::agv::ScheduleRouteValidator::make(
-          database, NotObstacleID, plan_robot->second.vehicle_traits().profile());
+          database, NotObstacleID, plan_robot.vehicle_traits().profile());
 
-  rmf_traffic::agv::Planner planner_0(
-      plan_robot->second,
+  rmf_traffic::agv::Planner planner_0 =
+      scenario->planner(scenario->plan().robot);
+  planner_0.set_default_options(
       rmf_traffic::agv::Planner::Options(obstacle_validator));
 
-  auto traits = planner_0.get_configuration().vehicle_traits();
-  auto plan_participant = rmf_traffic::schedule::make_participant(
-      rmf_traffic::schedule::ParticipantDescription{
-          "participant_0",
-          "test_trajectory",
-          rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
-          traits.profile()
-      },
-      database);
+  auto plan_participant = scenario->make_plan_participant(database);
   /// Setup participants
 
   // set plans for the participants
   using namespace std::chrono_literals;
 
-  std::vector<rmf_traffic::agv::Planner::Start> starts;
-  starts.emplace_back(start_time + std::chrono::seconds(
-      plan.initial_time),
-                      get_wp(plan_robot->second.graph(), plan.initial_waypoint),
-                      plan.initial_orientation);
+  std::vector<rmf_traffic::agv::Planner::Start> starts =
+      scenario->starts(start_time);
 
-  rmf_traffic::agv::Planner::Goal goal(get_wp(
-      plan_robot->second.graph(), plan.goal));
+  rmf_traffic::agv::Planner::Goal goal = scenario->goal();
 
   rmf_planner_viz::draw::Schedule schedule_drawable(
         database, 0.25, chosen_map, start_time + 0s);
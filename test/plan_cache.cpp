@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "plan_cache.hpp"
+
+#include <tuple>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+//==============================================================================
+PlanCache::Key::Key(
+  const Planner& planner,
+  const std::vector<Planner::Start>& starts,
+  const Planner::Goal& goal,
+  const rmf_traffic::schedule::Version schedule_version,
+  const std::size_t planner_version)
+: _goal(goal.waypoint()),
+  _planner_version(planner_version),
+  _minimum_holding_time(
+    planner.get_default_options().minimum_holding_time()),
+  _interrupt_flag(planner.get_default_options().interrupt_flag()),
+  _saturation_limit(planner.get_default_options().saturation_limit()),
+  _maximum_cost_estimate(
+    planner.get_default_options().maximum_cost_estimate()),
+  _schedule_version(schedule_version)
+{
+  _starts.reserve(starts.size());
+  for (const auto& start : starts)
+  {
+    StartKey key{
+      start.time(), start.waypoint(), start.orientation(), start.lane(),
+      rmf_utils::nullopt};
+
+    if (const auto& location = start.location())
+      key.location = std::make_pair(location->x(), location->y());
+
+    _starts.push_back(key);
+  }
+
+  if (goal.orientation())
+    _goal_orientation = *goal.orientation();
+}
+
+//==============================================================================
+bool PlanCache::Key::operator<(const Key& other) const
+{
+  const void* const interrupt_flag = _interrupt_flag.get();
+  const void* const other_interrupt_flag = other._interrupt_flag.get();
+  return std::tie(_starts, _goal, _goal_orientation, _planner_version,
+      _minimum_holding_time, interrupt_flag, _saturation_limit,
+      _maximum_cost_estimate, _schedule_version)
+    < std::tie(other._starts, other._goal, other._goal_orientation,
+      other._planner_version, other._minimum_holding_time,
+      other_interrupt_flag, other._saturation_limit,
+      other._maximum_cost_estimate, other._schedule_version);
+}
+
+//==============================================================================
+bool PlanCache::Key::StartKey::operator<(const StartKey& other) const
+{
+  return std::tie(time, waypoint, orientation, lane, location)
+    < std::tie(other.time, other.waypoint, other.orientation, other.lane,
+      other.location);
+}
+
+//==============================================================================
+PlanCache::PlanCache(std::size_t capacity)
+: _capacity(capacity)
+{
+  // Do nothing
+}
+
+//==============================================================================
+auto PlanCache::take(const Key& key) -> rmf_utils::optional<Entry>
+{
+  const auto it = _index.find(key);
+  if (it == _index.end())
+  {
+    ++_misses;
+    return rmf_utils::nullopt;
+  }
+
+  ++_hits;
+  rmf_utils::optional<Entry> entry(std::move(it->second->second));
+  _entries.erase(it->second);
+  _index.erase(it);
+  return entry;
+}
+
+//==============================================================================
+void PlanCache::store(const Key& key, Entry entry)
+{
+  const auto it = _index.find(key);
+  if (it != _index.end())
+  {
+    _entries.erase(it->second);
+    _index.erase(it);
+  }
+
+  _entries.emplace_front(key, std::move(entry));
+  _index.emplace(key, _entries.begin());
+  evict();
+}
+
+//==============================================================================
+void PlanCache::clear()
+{
+  _entries.clear();
+  _index.clear();
+}
+
+//==============================================================================
+std::size_t PlanCache::size() const
+{
+  return _entries.size();
+}
+
+//==============================================================================
+std::size_t PlanCache::capacity() const
+{
+  return _capacity;
+}
+
+//==============================================================================
+void PlanCache::capacity(std::size_t capacity)
+{
+  _capacity = capacity;
+  evict();
+}
+
+//==============================================================================
+std::size_t PlanCache::hits() const
+{
+  return _hits;
+}
+
+//==============================================================================
+std::size_t PlanCache::misses() const
+{
+  return _misses;
+}
+
+//==============================================================================
+void PlanCache::evict()
+{
+  while (_entries.size() > _capacity)
+  {
+    _index.erase(_entries.back().first);
+    _entries.pop_back();
+  }
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
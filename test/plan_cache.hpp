@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__PLAN_CACHE_HPP
+#define RMF_PLANNER_VIZ__DRAW__PLAN_CACHE_HPP
+
+#include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/agv/debug/debug_Planner.hpp>
+#include <rmf_traffic/schedule/Version.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "expansion_heatmap.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Searches of the planner debugger that were left behind, so that going back
+// to a start and goal that were searched before picks the search up where it
+// was instead of beginning it again. A search is only reused while the
+// planner, its options and the schedule are the same as when it was left.
+//
+// The graph and the validator cannot be told apart by their address, which
+// may be reused once they are freed, and the planner only hands out clones of
+// its validator. The caller numbers them instead with a planner version that
+// it changes whenever it gives the planner another graph or validator.
+//
+// The least recently used search is dropped once there are more than the
+// capacity.
+class PlanCache
+{
+public:
+
+  using Planner = rmf_traffic::agv::Planner;
+  using Progress = Planner::Debug::Progress;
+  using OptionalPlan = rmf_utils::optional<rmf_traffic::agv::Plan>;
+
+  // Everything a search depends on
+  class Key
+  {
+  public:
+
+    Key(
+      const Planner& planner,
+      const std::vector<Planner::Start>& starts,
+      const Planner::Goal& goal,
+      rmf_traffic::schedule::Version schedule_version,
+      std::size_t planner_version);
+
+    bool operator<(const Key& other) const;
+
+  private:
+
+    struct StartKey
+    {
+      rmf_traffic::Time time;
+      std::size_t waypoint;
+      double orientation;
+      rmf_utils::optional<std::size_t> lane;
+      rmf_utils::optional<std::pair<double, double>> location;
+
+      bool operator<(const StartKey& other) const;
+    };
+
+    std::vector<StartKey> _starts;
+    std::size_t _goal;
+    rmf_utils::optional<double> _goal_orientation;
+
+    // Stands for the graph and the validator of the planner
+    std::size_t _planner_version;
+
+    // Every other option of the planner. The interrupt flag is held on to,
+    // so that no other flag can take its address while the key exists.
+    rmf_traffic::Duration _minimum_holding_time;
+    std::shared_ptr<const void> _interrupt_flag;
+    rmf_utils::optional<std::size_t> _saturation_limit;
+    rmf_utils::optional<double> _maximum_cost_estimate;
+
+    rmf_traffic::schedule::Version _schedule_version;
+  };
+
+  struct Entry
+  {
+    // The search as Debug::begin() left it, for jumping back to the start
+    Progress start;
+
+    Progress progress;
+    OptionalPlan plan;
+    int steps;
+    std::unique_ptr<ExpansionHeatmap> heatmap;
+  };
+
+  explicit PlanCache(std::size_t capacity = 16);
+
+  // Take the search of the key out of the cache, if it is there
+  rmf_utils::optional<Entry> take(const Key& key);
+
+  // Keep a search, dropping the least recently used one if the cache is full
+  void store(const Key& key, Entry entry);
+
+  void clear();
+
+  std::size_t size() const;
+
+  std::size_t capacity() const;
+
+  // Drops the least recently used searches that no longer fit
+  void capacity(std::size_t capacity);
+
+  // How often take() found a search, since the cache was made
+  std::size_t hits() const;
+  std::size_t misses() const;
+
+private:
+
+  using Entries = std::list<std::pair<Key, Entry>>;
+
+  void evict();
+
+  // Most recently used first
+  Entries _entries;
+  std::map<Key, Entries::iterator> _index;
+  std::size_t _capacity;
+  std::size_t _hits = 0;
+  std::size_t _misses = 0;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__PLAN_CACHE_HPP
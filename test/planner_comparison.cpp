@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "planner_comparison.hpp"
+#include "thread_pool.hpp"
+
+#include <rmf_freespace_planner/posq.hpp>
+#include <rmf_freespace_planner/rmf_probabilistic_road_map.hpp>
+
+#include <rmf_traffic/Time.hpp>
+#include <rmf_traffic/agv/RouteValidator.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <string>
+#include <unordered_set>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using ProbabilisticRoadMap =
+  rmf_freespace_planner::rmf_probabilistic_road_map::ProbabilisticRoadMap;
+
+// A piece of the graph plan for a freespace planner to refine
+struct Segment
+{
+  Eigen::Vector3d from;
+  rmf_traffic::Time time;
+  Eigen::Vector3d to;
+  std::string map;
+};
+
+// Split the graph plan the same way the freespace apps do: one segment per
+// pair of consecutive waypoints, skipping the ones closer than a meter
+std::vector<Segment> segments_of(
+  const std::vector<rmf_traffic::Route>& itinerary)
+{
+  std::vector<Segment> segments;
+  for (const auto& route : itinerary)
+  {
+    const auto& trajectory = route.trajectory();
+    for (std::size_t i = 0; i + 1 < trajectory.size(); ++i)
+    {
+      const auto& from = trajectory[i].position();
+      const auto& to = trajectory[i + 1].position();
+      if ((from - to).norm() < 1)
+        continue;
+
+      if (from.x() == to.x() && from.y() == to.y())
+        continue;
+
+      segments.push_back(Segment{from, trajectory[i].time(), to, route.map()});
+    }
+  }
+
+  return segments;
+}
+
+double seconds_since(const Clock::time_point& start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void measure(
+  PlannerComparison::Result& result,
+  const rmf_traffic::agv::RouteValidator& validator)
+{
+  rmf_utils::optional<rmf_traffic::Time> start;
+  rmf_utils::optional<rmf_traffic::Time> finish;
+  for (const auto& route : result.itinerary)
+  {
+    const auto& trajectory = route.trajectory();
+    for (std::size_t i = 1; i < trajectory.size(); ++i)
+    {
+      result.length += (trajectory[i].position().head<2>()
+        - trajectory[i - 1].position().head<2>()).norm();
+    }
+
+    if (const auto* t = trajectory.start_time())
+      start = start ? std::min(*start, *t) : *t;
+
+    if (const auto* t = trajectory.finish_time())
+      finish = finish ? std::max(*finish, *t) : *t;
+
+    if (validator.find_conflict(route))
+      ++result.conflicts;
+  }
+
+  if (start && finish)
+    result.duration = rmf_traffic::time::to_seconds(*finish - *start);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+const char* PlannerComparison::name(Kind kind)
+{
+  switch (kind)
+  {
+    case Kind::Graph:
+      return "rmf_traffic Planner";
+    case Kind::Posq:
+      return "Posq";
+    case Kind::ProbabilisticRoadMap:
+      return "ProbabilisticRoadMap";
+  }
+
+  return "Unknown";
+}
+
+//==============================================================================
+PlannerComparison::PlannerComparison(
+  std::shared_ptr<const Scenario> scenario,
+  std::shared_ptr<rmf_traffic::schedule::Database> database,
+  rmf_traffic::schedule::ParticipantId participant)
+: _scenario(std::move(scenario)),
+  _database(std::move(database)),
+  _participant(participant),
+  _interrupt(std::make_shared<std::atomic_bool>(false))
+{
+  // Do nothing
+}
+
+//==============================================================================
+PlannerComparison::~PlannerComparison()
+{
+  stop();
+}
+
+//==============================================================================
+bool PlannerComparison::start(
+  const std::vector<Kind>& kinds,
+  const std::vector<Planner::Start>& starts,
+  const Planner::Goal& goal)
+{
+  if (_running)
+    return false;
+
+  if (_thread.joinable())
+    _thread.join();
+
+  *_interrupt = false;
+  _running = true;
+  _thread = std::thread(
+    [this, kinds, starts, goal]()
+    {
+      run(kinds, starts, goal);
+    });
+
+  return true;
+}
+
+//==============================================================================
+bool PlannerComparison::running() const
+{
+  return _running;
+}
+
+//==============================================================================
+void PlannerComparison::stop()
+{
+  *_interrupt = true;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+//==============================================================================
+auto PlannerComparison::take_results()
+-> rmf_utils::optional<std::vector<Result>>
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto results = std::move(_results);
+  _results = rmf_utils::nullopt;
+  return results;
+}
+
+//==============================================================================
+void PlannerComparison::run(
+  std::vector<Kind> kinds,
+  std::vector<Planner::Start> starts,
+  Planner::Goal goal)
+{
+  const auto& traits = _scenario->plan_robot().vehicle_traits();
+  const auto make_validator = [&]()
+    {
+      return rmf_traffic::agv::ScheduleRouteValidator::make(
+        _database, _participant, traits.profile());
+    };
+
+  // Every other planner refines the graph plan, so it is found whether or
+  // not the graph planner is compared
+  Result graph;
+  graph.kind = Kind::Graph;
+  {
+    const auto validator = make_validator();
+    auto planner = _scenario->planner(_scenario->plan().robot);
+    Planner::Options options(validator);
+    options.interrupt_flag(_interrupt);
+    planner.set_default_options(std::move(options));
+
+    try
+    {
+      const auto t0 = Clock::now();
+      const auto plan = planner.plan(starts, goal);
+      graph.planning_time = seconds_since(t0);
+
+      if (plan)
+      {
+        graph.success = true;
+        graph.itinerary = plan->get_itinerary();
+        measure(graph, *validator);
+      }
+      else if (*_interrupt)
+      {
+        graph.error = "Interrupted";
+      }
+      else
+      {
+        graph.error = "No plan found";
+      }
+    }
+    catch (const std::exception& e)
+    {
+      graph.success = false;
+      graph.itinerary.clear();
+      graph.error = e.what();
+    }
+  }
+
+  std::vector<Result> results(kinds.size());
+  const auto segments = segments_of(graph.itinerary);
+  const std::vector<ProbabilisticRoadMap::Obstacle> static_obstacles =
+    [&]()
+    {
+      const auto& description = _scenario->description();
+      std::vector<ProbabilisticRoadMap::Obstacle> obstacles;
+      for (const auto& obstacle : description.obstacle_routes)
+      {
+        const auto& robot = description.robots.at(obstacle.robot);
+        obstacles.push_back(
+          {obstacle.route.trajectory().at(0).position().head<2>(),
+            robot.vehicle_traits().profile().footprint()
+            ->get_characteristic_length()});
+      }
+      return obstacles;
+    }();
+
+  const auto refine = [&](Result& result)
+    {
+      // Each planner checks against a validator of its own, since they run
+      // at the same time
+      const auto validator = make_validator();
+      const std::unordered_set<rmf_traffic::schedule::ParticipantId> ignore(
+        {_participant});
+
+      // Every segment is planned even after one has failed, so that the
+      // planning time covers the whole plan
+      std::vector<std::size_t> failed;
+      const auto add = [&](
+        std::size_t segment, const std::vector<rmf_traffic::Route>& routes)
+        {
+          if (routes.empty())
+            failed.push_back(segment);
+
+          result.itinerary.insert(
+            result.itinerary.end(), routes.begin(), routes.end());
+        };
+
+      const auto t0 = Clock::now();
+      if (result.kind == Kind::Posq)
+      {
+        rmf_freespace_planner::kinodynamic_rrt_star::Posq posq(
+          validator, _database, ignore, 0.1);
+
+        for (std::size_t i = 0; i < segments.size() && !*_interrupt; ++i)
+        {
+          const auto& segment = segments[i];
+          add(i, posq.plan(
+              {segment.from, segment.time}, {segment.to}, traits,
+              std::nullopt, segment.map));
+        }
+      }
+      else
+      {
+        for (std::size_t i = 0; i < segments.size() && !*_interrupt; ++i)
+        {
+          const auto& segment = segments[i];
+          ProbabilisticRoadMap probabilistic_road_map(
+            validator, 3, 1000.0, _database, ignore);
+
+          add(i, probabilistic_road_map.plan(
+              {segment.from, segment.time}, {segment.to}, traits,
+              static_obstacles, segment.map));
+        }
+      }
+      result.planning_time = seconds_since(t0);
+
+      if (*_interrupt)
+      {
+        result.error = "Interrupted";
+      }
+      else if (segments.empty())
+      {
+        result.error = "No segments to refine";
+      }
+      else if (!failed.empty())
+      {
+        // A partial plan would show a shorter length and duration than a
+        // complete one, so it is not measured
+        result.error = "No route for segment " + std::to_string(failed.front())
+          + " of " + std::to_string(segments.size());
+        if (failed.size() > 1)
+          result.error += " and " + std::to_string(failed.size() - 1) + " more";
+      }
+      else
+      {
+        result.success = true;
+        measure(result, *validator);
+      }
+    };
+
+  ThreadPool pool(std::max<std::size_t>(kinds.size(), 1));
+  pool.parallel_for(0, kinds.size(), 1,
+    [&](std::size_t begin, std::size_t end)
+    {
+      for (std::size_t i = begin; i < end; ++i)
+      {
+        auto& result = results[i];
+        result.kind = kinds[i];
+        if (result.kind == Kind::Graph)
+        {
+          result = graph;
+          continue;
+        }
+
+        if (!graph.success)
+        {
+          result.error = "No graph plan to refine";
+          continue;
+        }
+
+        // Caught here rather than by the pool, so that one planner failing
+        // keeps the results of the others
+        try
+        {
+          refine(result);
+        }
+        catch (const std::exception& e)
+        {
+          result.success = false;
+          result.itinerary.clear();
+          result.error = e.what();
+        }
+      }
+    });
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _results = std::move(results);
+  _running = false;
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__PLANNER_COMPARISON_HPP
+#define RMF_PLANNER_VIZ__DRAW__PLANNER_COMPARISON_HPP
+
+#include <rmf_traffic/Route.hpp>
+#include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scenario_loading.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Runs several planners on the plan of a scenario and measures what they
+// find, for the comparison app.
+//
+// Posq and the probabilistic road map do not search the graph. As in their
+// own apps, they refine each segment of the itinerary that the graph planner
+// found, so they start once the graph plan is there and then run side by
+// side. Their planning time only counts the refinement.
+class PlannerComparison
+{
+public:
+
+  using Planner = rmf_traffic::agv::Planner;
+
+  enum class Kind
+  {
+    Graph,
+    Posq,
+    ProbabilisticRoadMap
+  };
+
+  static constexpr std::size_t KindCount = 3;
+
+  static const char* name(Kind kind);
+
+  struct Result
+  {
+    Kind kind;
+    bool success = false;
+
+    // Why the planner failed, if it did. A refinement that failed on some
+    // segments keeps the routes of the others, but is not measured.
+    std::string error;
+
+    // Seconds spent planning
+    double planning_time = 0.0;
+
+    // Distance travelled over every route, in meters
+    double length = 0.0;
+
+    // From the earliest start to the latest finish of the routes, seconds
+    double duration = 0.0;
+
+    // Routes that conflict with the obstacles of the schedule
+    std::size_t conflicts = 0;
+
+    std::vector<rmf_traffic::Route> itinerary;
+  };
+
+  // The participant is the one whose plan is compared. The schedule is
+  // checked for conflicts without it.
+  PlannerComparison(
+    std::shared_ptr<const Scenario> scenario,
+    std::shared_ptr<rmf_traffic::schedule::Database> database,
+    rmf_traffic::schedule::ParticipantId participant);
+
+  PlannerComparison(const PlannerComparison&) = delete;
+  PlannerComparison& operator=(const PlannerComparison&) = delete;
+
+  ~PlannerComparison();
+
+  // Plan from the starts to the goal with each of the given planners, on a
+  // worker thread. Returns false if a comparison is still running.
+  bool start(
+    const std::vector<Kind>& kinds,
+    const std::vector<Planner::Start>& starts,
+    const Planner::Goal& goal);
+
+  bool running() const;
+
+  // Interrupt the running comparison, if any, and wait for it to end. The
+  // graph planner stops through its interrupt flag, while Posq and the road
+  // map can only stop between segments. Called by the destructor.
+  void stop();
+
+  // The results of the last comparison in the order the planners were given,
+  // once it is done. Each set of results is only returned once.
+  rmf_utils::optional<std::vector<Result>> take_results();
+
+private:
+
+  void run(
+    std::vector<Kind> kinds,
+    std::vector<Planner::Start> starts,
+    Planner::Goal goal);
+
+  std::shared_ptr<const Scenario> _scenario;
+  std::shared_ptr<rmf_traffic::schedule::Database> _database;
+  rmf_traffic::schedule::ParticipantId _participant;
+
+  std::thread _thread;
+  std::atomic_bool _running{false};
+  std::shared_ptr<std::atomic_bool> _interrupt;
+  mutable std::mutex _mutex;
+  rmf_utils::optional<std::vector<Result>> _results;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__PLANNER_COMPARISON_HPP
@@ -16,6 +16,9 @@
 */
 
 #include "planner_debug.hpp"
+#include "expansion_heatmap.hpp"
+#include "plan_cache.hpp"
+#include "planner_profiler.hpp"
 
 #include <SFML/Graphics.hpp>
 #include <imgui.h>
@@ -28,9 +31,296 @@
 
 #include "imgui-SFML.h"
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+
 namespace rmf_planner_viz {
 namespace draw {
 
+namespace {
+
+double score(const SearchQueueNodePtr& node)
+{
+  return node->current_cost + node->remaining_cost_estimate;
+}
+
+// Ties are broken by address so the order of the index is stable
+bool lower_score(const SearchQueueNodePtr& a, const SearchQueueNodePtr& b)
+{
+  const double score_a = score(a);
+  const double score_b = score(b);
+  if (score_a != score_b)
+    return score_a < score_b;
+
+  return std::less<const void*>()(a.get(), b.get());
+}
+
+} // anonymous namespace
+
+//==============================================================================
+void SearchQueueIndex::update(const SearchQueueContainer& nodes)
+{
+  const std::uint64_t generation = ++_generation;
+
+  std::vector<SearchQueueNodePtr> added;
+  for (const auto& node : nodes)
+  {
+    const auto inserted = _seen.insert({node.get(), generation});
+    if (inserted.second)
+      added.push_back(node);
+    else
+      inserted.first->second = generation;
+  }
+
+  // Drop the nodes that were not seen in this update. The index holds on to
+  // them until here, so their addresses cannot have been reused by the nodes
+  // that were just added.
+  if (_sorted.size() + added.size() > nodes.size())
+  {
+    const auto removed = std::remove_if(_sorted.begin(), _sorted.end(),
+      [&](const SearchQueueNodePtr& node)
+      {
+        const auto it = _seen.find(node.get());
+        if (it->second == generation)
+          return false;
+
+        _seen.erase(it);
+        return true;
+      });
+    _sorted.erase(removed, _sorted.end());
+  }
+
+  std::sort(added.begin(), added.end(), lower_score);
+  const std::size_t middle = _sorted.size();
+  _sorted.insert(_sorted.end(), added.begin(), added.end());
+  std::inplace_merge(
+    _sorted.begin(), _sorted.begin() + middle, _sorted.end(), lower_score);
+}
+
+//==============================================================================
+void SearchQueueIndex::clear()
+{
+  _sorted.clear();
+  _seen.clear();
+}
+
+//==============================================================================
+const std::vector<SearchQueueNodePtr>& SearchQueueIndex::sorted() const
+{
+  return _sorted;
+}
+
+//==============================================================================
+PlannerStepper::PlannerStepper(int checkpoint_interval)
+: _interval(std::max(1, checkpoint_interval))
+{
+  // Do nothing
+}
+
+//==============================================================================
+PlannerStepper::~PlannerStepper()
+{
+  cancel();
+  join();
+}
+
+//==============================================================================
+void PlannerStepper::reset(const Progress& start)
+{
+  stop();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _checkpoints.clear();
+  _checkpoints.insert({0, Checkpoint{start, rmf_utils::nullopt}});
+}
+
+//==============================================================================
+void PlannerStepper::record(
+  const Progress& progress, int steps, const OptionalPlan& plan)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (steps % _interval == 0)
+    _checkpoints.insert({steps, Checkpoint{progress, plan}});
+}
+
+//==============================================================================
+void PlannerStepper::step_until_plan(const Progress& progress, int steps)
+{
+  start(progress, rmf_utils::nullopt, steps, -1);
+}
+
+//==============================================================================
+void PlannerStepper::jump_to(int target)
+{
+  target = std::max(0, target);
+
+  rmf_utils::optional<Checkpoint> from;
+  int steps = 0;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _checkpoints.upper_bound(target);
+    if (it == _checkpoints.begin())
+      return;
+
+    --it;
+    from = it->second;
+    steps = it->first;
+  }
+
+  start(std::move(from->progress), std::move(from->plan), steps, target);
+}
+
+//==============================================================================
+auto PlannerStepper::step(Progress& progress, OptionalPlan& plan, int steps)
+-> StepInfo
+{
+  StepInfo info;
+  info.expanded = progress.queue().empty() ? nullptr : progress.queue().top();
+
+  const auto start = std::chrono::steady_clock::now();
+  plan = progress.step();
+  info.duration = std::chrono::steady_clock::now() - start;
+
+  info.steps = steps + 1;
+  info.queue_size = progress.queue().size();
+  return info;
+}
+
+//==============================================================================
+void PlannerStepper::set_step_observer(StepObserver observer)
+{
+  cancel();
+  join();
+  _observer = std::move(observer);
+}
+
+//==============================================================================
+void PlannerStepper::cancel()
+{
+  _cancel = true;
+}
+
+//==============================================================================
+void PlannerStepper::stop()
+{
+  cancel();
+  join();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _result = rmf_utils::nullopt;
+}
+
+//==============================================================================
+bool PlannerStepper::running() const
+{
+  return _running;
+}
+
+//==============================================================================
+auto PlannerStepper::status() const -> Status
+{
+  Status status;
+  status.running = _running;
+  status.steps = _steps;
+  status.queue_size = _queue_size;
+  status.target = _target;
+  return status;
+}
+
+//==============================================================================
+auto PlannerStepper::take_result() -> rmf_utils::optional<Result>
+{
+  if (_running)
+    return rmf_utils::nullopt;
+
+  join();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  rmf_utils::optional<Result> result;
+  std::swap(result, _result);
+  return result;
+}
+
+//==============================================================================
+std::size_t PlannerStepper::checkpoint_count() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _checkpoints.size();
+}
+
+//==============================================================================
+int PlannerStepper::checkpoint_interval() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _interval;
+}
+
+//==============================================================================
+void PlannerStepper::checkpoint_interval(int interval)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  _interval = std::max(1, interval);
+}
+
+//==============================================================================
+void PlannerStepper::start(
+  Progress progress, OptionalPlan plan, int steps, int target)
+{
+  cancel();
+  join();
+
+  _cancel = false;
+  _running = true;
+  _steps = steps;
+  _target = target;
+  _queue_size = progress.queue().size();
+  _thread = std::thread(
+    [this, progress = std::move(progress), plan = std::move(plan),
+      steps, target]() mutable
+    {
+      run(std::move(progress), std::move(plan), steps, target);
+    });
+}
+
+//==============================================================================
+void PlannerStepper::run(
+  Progress progress, OptionalPlan plan, int steps, int target)
+{
+  const auto done = [&]()
+    {
+      if (target >= 0)
+        return steps >= target;
+
+      return static_cast<bool>(plan) || progress.queue().empty();
+    };
+
+  while (!done() && !_cancel)
+  {
+    const StepInfo info = step(progress, plan, steps);
+    steps = info.steps;
+
+    if (_observer)
+      _observer(info);
+
+    _steps = steps;
+    _queue_size = progress.queue().size();
+    record(progress, steps, plan);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _result = Result{std::move(progress), std::move(plan), steps, _cancel};
+  _running = false;
+}
+
+//==============================================================================
+void PlannerStepper::join()
+{
+  if (_thread.joinable())
+    _thread.join();
+}
+
+//==============================================================================
 void do_planner_debug(
   const rmf_traffic::Profile& profile, 
   const std::string& chosen_map,
@@ -42,14 +332,55 @@ void do_planner_debug(
   rmf_traffic::agv::Planner::Debug::Progress& progress,
   const std::chrono::steady_clock::time_point& plan_start_timing,
   bool force_replan,
+  rmf_traffic::schedule::Version schedule_version,
+  std::size_t planner_version,
   bool& show_node_trajectories,
-  std::vector<rmf_planner_viz::draw::Trajectory>& trajectories_to_render)
+  std::vector<rmf_planner_viz::draw::Trajectory>& trajectories_to_render,
+  rmf_planner_viz::draw::Graph* graph_drawable)
 {
   static rmf_utils::optional<rmf_traffic::agv::Plan> current_plan;
   static float node_inspection_timeline_control = 0.0f;
   static float solved_plan_timeline_control = 0.0f;
   static int steps = 0;
-  static int selected_node_idx = -1;
+  static SearchQueueNodePtr selected_node;
+
+  // Sorting is only done when the sorted view is shown, and only for the
+  // nodes that changed since the last time
+  static SearchQueueIndex queue_index;
+  static bool queue_changed = true;
+
+  // Counts the node expanded by every step, including the steps taken on the
+  // worker thread, so the heatmap keeps up with the search
+  static std::unique_ptr<ExpansionHeatmap> heatmap;
+  static bool show_heatmap = false;
+  static bool heatmap_shown = false;
+
+  // Times every step the same way
+  static PlannerProfiler profiler;
+
+  // Searches that were left for another start or goal, and the key and the
+  // beginning of the current one to leave it under
+  static PlanCache plan_cache;
+  static rmf_utils::optional<PlanCache::Key> search_key;
+  static rmf_utils::optional<PlannerStepper::Progress> search_start;
+
+  // Long runs of steps happen on a worker thread. Statics are destroyed in
+  // the reverse order of their construction, so the stepper is declared last
+  // to join its worker before anything that its observer touches goes away.
+  static PlannerStepper stepper;
+
+  const auto observe = [](const PlannerStepper::StepInfo& info)
+    {
+      heatmap->record(info.expanded, info.steps);
+      profiler.record_step(info.steps, info.duration, info.queue_size);
+    };
+
+  if (!heatmap)
+  {
+    heatmap = std::make_unique<ExpansionHeatmap>(
+      planner.get_configuration().graph());
+    stepper.set_step_observer(observe);
+  }
 
   ImGui::SetNextWindowPos(ImVec2(800, 100), ImGuiCond_FirstUseEver);
   ImGui::SetNextWindowSize(ImVec2(600, 600), ImGuiCond_FirstUseEver);
@@ -181,31 +512,109 @@ void do_planner_debug(
 
   if (reset_planning || force_replan)
   {
-    progress = debug.begin(starts, goal, planner.get_default_options());
-    current_plan.reset();
-    steps = 0;
-    selected_node_idx = -1;
+    // Nothing records into the heatmap once the stepper has stopped
+    stepper.stop();
+    if (graph_drawable)
+      heatmap->remove(*graph_drawable);
+
+    // Leave the current search in the cache, and take the new one out of it
+    // if it was searched before. Replanning the same search just carries on.
+    if (search_key && search_start)
+    {
+      // A cancelled job may have counted steps past the ones it returned
+      heatmap->rewind(steps);
+      plan_cache.store(
+        *search_key,
+        PlanCache::Entry{
+          std::move(*search_start), progress, std::move(current_plan), steps,
+          std::move(heatmap)});
+    }
+
+    const PlanCache::Key key(
+      planner, starts, goal, schedule_version, planner_version);
+    if (auto cached = plan_cache.take(key))
+    {
+      progress = std::move(cached->progress);
+      current_plan = std::move(cached->plan);
+      steps = cached->steps;
+      search_start = std::move(cached->start);
+      heatmap = std::move(cached->heatmap);
+      stepper.reset(*search_start);
+      stepper.record(progress, steps, current_plan);
+    }
+    else
+    {
+      progress = debug.begin(starts, goal, planner.get_default_options());
+      current_plan.reset();
+      steps = 0;
+      search_start = progress;
+      stepper.reset(progress);
+
+      // The planner may have been given another graph
+      heatmap = std::make_unique<ExpansionHeatmap>(
+        planner.get_configuration().graph());
+    }
+
+    search_key = key;
+    selected_node.reset();
+    queue_changed = true;
+  }
+  else if (stepper.checkpoint_count() == 0 && steps == 0)
+  {
+    // The progress was begun by the caller
+    stepper.reset(progress);
+    search_key = PlanCache::Key(
+      planner, starts, goal, schedule_version, planner_version);
+    search_start = progress;
   }
-  
+
+  // Pick up the search once the worker is done with it
+  if (auto result = stepper.take_result())
+  {
+    progress = std::move(result->progress);
+    current_plan = std::move(result->plan);
+    steps = result->steps;
+    queue_changed = true;
+
+    // A jump back to a checkpoint takes no steps to rewind the heatmap
+    heatmap->rewind(steps);
+  }
+
   /// AStar plan control
   ImGui::TextColored(ImVec4(0, 1, 0, 1), "AStar plan generation");
   ImGui::TextColored(ImVec4(0, 1, 0, 1), "Steps taken: %d", steps);
-  if (ImGui::Button("Step forward"))
+
+  const auto status = stepper.status();
+  if (status.running)
   {
-    current_plan = progress.step();
-    ++steps;
+    if (status.target >= 0)
+    {
+      ImGui::Text("Jumping to step %d: at step %d, %lu queued",
+        status.target, status.steps, status.queue_size);
+    }
+    else
+    {
+      ImGui::Text("Stepping until a valid plan: at step %d, %lu queued",
+        status.steps, status.queue_size);
+    }
+
+    if (ImGui::Button("Cancel"))
+      stepper.cancel();
   }
-  if (ImGui::Button("Step forward until valid plan.."))
+  else
   {
-    current_plan = progress.step();
-    ++steps;
-    while (!current_plan)
+    if (ImGui::Button("Step forward"))
     {
-      current_plan = progress.step();
-      ++steps;
+      const auto info = PlannerStepper::step(progress, current_plan, steps);
+      steps = info.steps;
+      observe(info);
+      stepper.record(progress, steps, current_plan);
+      queue_changed = true;
     }
+    if (ImGui::Button("Step forward until valid plan.."))
+      stepper.step_until_plan(progress, steps);
   }
-  
+
   if (ImGui::TreeNode("Reset/Jump to.."))
   {
     static int steps_jump = 0;
@@ -214,38 +623,95 @@ void do_planner_debug(
       steps_jump = 0;
     char reset_label[32] = { 0 };
     snprintf(reset_label, sizeof(reset_label), "Reset to %d steps", steps_jump);
-    if (ImGui::Button(reset_label))
-    {
-      progress = debug.begin(starts, goal, planner.get_default_options());
+    if (!status.running && ImGui::Button(reset_label))
+      stepper.jump_to(steps_jump);
 
-      current_plan.reset();
-      for (int i=0; i<steps_jump; ++i)
-        current_plan = progress.step();
-      steps = steps_jump;
+    int checkpoint_interval = stepper.checkpoint_interval();
+    if (ImGui::InputInt("Checkpoint every N steps", &checkpoint_interval))
+      stepper.checkpoint_interval(checkpoint_interval);
+    ImGui::Text("Checkpoints: %lu", stepper.checkpoint_count());
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("Search cache"))
+  {
+    ImGui::Text("Searches kept: %lu", plan_cache.size());
+    ImGui::Text("Reused: %lu of %lu", plan_cache.hits(),
+      plan_cache.hits() + plan_cache.misses());
+
+    int capacity = static_cast<int>(plan_cache.capacity());
+    if (ImGui::InputInt("Searches to keep", &capacity))
+      plan_cache.capacity(static_cast<std::size_t>(std::max(capacity, 0)));
+    if (ImGui::Button("Forget kept searches"))
+      plan_cache.clear();
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("Expansion heatmap"))
+  {
+    if (!graph_drawable)
+      ImGui::Text("No graph to draw the heatmap on");
+
+    ImGui::Checkbox("Show expansion heatmap", &show_heatmap);
+    ImGui::Text("Expansions: %lu", heatmap->expansion_count());
+    ImGui::Text("Most expansions of a waypoint or lane: %lu",
+      heatmap->max_count());
+
+    if (const auto span = heatmap->time_span())
+    {
+      ImGui::Text("Expanded arrival times: %.2fs to %.2fs",
+        rmf_traffic::time::to_seconds(span->first - plan_start_timing),
+        rmf_traffic::time::to_seconds(span->second - plan_start_timing));
     }
     ImGui::TreePop();
   }
+
+  if (graph_drawable)
+  {
+    if (show_heatmap)
+      heatmap->apply(*graph_drawable);
+    else if (heatmap_shown)
+      heatmap->remove(*graph_drawable);
+
+    heatmap_shown = show_heatmap;
+  }
   
   ImGui::Separator();
 
   trajectories_to_render.clear();
   /// AStar Node details
-  auto searchqueue = progress.queue();
-  auto& container = get_priority_queue_container(searchqueue);
+  // Read the queue in place. Copying it every frame freezes the debugger once
+  // the queue holds many nodes.
+  const auto& container = get_priority_queue_container(progress.queue());
 
   ImGui::TextColored(ImVec4(0, 1, 0, 1), "AStar Node Count: %lu", container.size());
+
+  static bool sort_by_score = true;
+  ImGui::Checkbox("Sort nodes by score", &sort_by_score);
+  if (sort_by_score && queue_changed)
+  {
+    queue_index.update(container);
+    queue_changed = false;
+  }
   ImGui::NewLine();
 
+  const auto& nodes = sort_by_score ? queue_index.sorted() : container;
   if (ImGui::ListBoxHeader("AStar Nodes"))
   {
-    for (uint i=0; i<container.size(); ++i)
+    // Only the rows that are scrolled into view are formatted
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(nodes.size()));
+    while (clipper.Step())
     {
-      auto& node = container[i];
-      char node_name[32] = { 0 };
-      snprintf(node_name, sizeof(node_name), "Node %d (score: %f)",
-        i, node->current_cost + node->remaining_cost_estimate);
-      if (ImGui::Selectable(node_name, (int)i == selected_node_idx))
-        selected_node_idx = i;
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+      {
+        const auto& node = nodes[i];
+        char node_name[48] = { 0 };
+        snprintf(node_name, sizeof(node_name), "Node %d (score: %f)",
+          i, node->current_cost + node->remaining_cost_estimate);
+        if (ImGui::Selectable(node_name, node == selected_node))
+          selected_node = node;
+      }
     }
     ImGui::ListBoxFooter();
   }
@@ -318,14 +784,18 @@ void do_planner_debug(
 
   ImGui::NewLine();
   ImGui::Separator();
-  if (selected_node_idx != -1 && selected_node_idx < (int)container.size())
+  if (selected_node)
   {
-    ImGui::TextColored(ImVec4(0, 1, 0, 1), "Node #%d Inspection", selected_node_idx);
-    auto selected_node = container[selected_node_idx];
+    // The selection keeps the node alive after it leaves the queue
+    ImGui::TextColored(ImVec4(0, 1, 0, 1), "Node Inspection");
     ImGui::Text("Current Cost: %f", selected_node->current_cost);
     ImGui::Text("Remaining Cost Estimate: %f", selected_node->remaining_cost_estimate);
     if (selected_node->waypoint)
+    {
       ImGui::Text("Waypoint: %lu", *selected_node->waypoint);
+      ImGui::Text("Expansions of waypoint: %lu",
+        heatmap->waypoint_count(*selected_node->waypoint));
+    }
     if (selected_node->start_set_index)
       ImGui::Text("start_set_index: %lu", *selected_node->start_set_index);
 
@@ -396,6 +866,8 @@ void do_planner_debug(
   }
 
   ImGui::End();
+
+  do_planner_profiler(profiler, planner, starts, goal);
 }
 
 bool do_planner_presets(
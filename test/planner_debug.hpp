@@ -21,10 +21,25 @@
 
 #include <rmf_traffic/agv/Planner.hpp>
 #include <rmf_traffic/agv/debug/debug_Planner.hpp>
+#include <rmf_traffic/schedule/Version.hpp>
 
+#include <rmf_utils/optional.hpp>
+
+#include <rmf_planner_viz/draw/Graph.hpp>
 #include <rmf_planner_viz/draw/Trajectory.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <queue>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace rmf_planner_viz {
 namespace draw {
@@ -46,6 +61,177 @@ S& get_priority_queue_container(std::priority_queue<T, S, C>& queue)
   return HackedQueue::Container(queue);
 }
 
+// Same as above for a queue that may not be modified. Lets the debugger read
+// the queue of a Progress in place instead of copying it every frame.
+template <class T, class S, class C>
+const S& get_priority_queue_container(const std::priority_queue<T, S, C>& queue)
+{
+  struct HackedQueue : private std::priority_queue<T, S, C>
+  {
+    static const S& Container(const std::priority_queue<T, S, C>& queue)
+    {
+      return queue.*&HackedQueue::c;
+    }
+  };
+  return HackedQueue::Container(queue);
+}
+
+using SearchQueueContainer = std::decay_t<decltype(get_priority_queue_container(
+  std::declval<const rmf_traffic::agv::Planner::Debug::Progress&>().queue()))>;
+using SearchQueueNodePtr = SearchQueueContainer::value_type;
+
+// The nodes of a search queue sorted by score, lowest first. update() only
+// sorts the nodes that joined the queue since the last update and merges them
+// in, and drops the nodes that left it, so keeping the index current while
+// stepping through a search with a large queue stays cheap.
+class SearchQueueIndex
+{
+public:
+
+  // Bring the index up to date with nodes, the container of the queue
+  void update(const SearchQueueContainer& nodes);
+
+  void clear();
+
+  const std::vector<SearchQueueNodePtr>& sorted() const;
+
+private:
+  std::vector<SearchQueueNodePtr> _sorted;
+
+  // The update in which each indexed node was last seen in the queue
+  std::unordered_map<const void*, std::uint64_t> _seen;
+  std::uint64_t _generation = 0;
+};
+
+// Steps a copy of a Progress on a worker thread, so that long searches do
+// not freeze the window and can be cancelled. A copy of the progress is kept
+// every checkpoint_interval steps, so jumping to a step restarts from the
+// nearest checkpoint at or before it instead of from Debug::begin().
+//
+// The checkpoints belong to one search. Call reset() whenever the progress
+// is begun again.
+class PlannerStepper
+{
+public:
+
+  using Progress = rmf_traffic::agv::Planner::Debug::Progress;
+  using OptionalPlan = rmf_utils::optional<rmf_traffic::agv::Plan>;
+
+  // Published while a job runs, for the window to show
+  struct Status
+  {
+    bool running = false;
+    int steps = 0;
+    std::size_t queue_size = 0;
+
+    // Step count the job stops at, or -1 when it runs until a plan is found
+    int target = -1;
+  };
+
+  struct StepInfo
+  {
+    // The node that the step took off the queue, or nullptr if it was empty
+    SearchQueueNodePtr expanded;
+
+    // Steps taken once it is expanded
+    int steps;
+
+    // Time spent in Progress::step()
+    std::chrono::steady_clock::duration duration;
+
+    // Size of the queue after the step
+    std::size_t queue_size;
+  };
+
+  // Take one step of progress and describe it
+  static StepInfo step(Progress& progress, OptionalPlan& plan, int steps);
+
+  using StepObserver = std::function<void(const StepInfo&)>;
+
+  struct Result
+  {
+    Progress progress;
+    OptionalPlan plan;
+    int steps;
+    bool cancelled;
+  };
+
+  explicit PlannerStepper(int checkpoint_interval = 100);
+
+  PlannerStepper(const PlannerStepper&) = delete;
+  PlannerStepper& operator=(const PlannerStepper&) = delete;
+
+  ~PlannerStepper();
+
+  // Cancel any job, forget every checkpoint and make start the checkpoint
+  // of step 0
+  void reset(const Progress& start);
+
+  // Keep a checkpoint of a step that was taken outside of the stepper, if it
+  // falls on the checkpoint interval
+  void record(const Progress& progress, int steps, const OptionalPlan& plan);
+
+  // Step a copy of progress, which has taken steps steps, until it finds a
+  // plan or its queue runs empty
+  void step_until_plan(const Progress& progress, int steps);
+
+  // Bring the search to exactly target steps, from the nearest checkpoint
+  void jump_to(int target);
+
+  // Watch every step that a job takes. Jobs call the observer from the
+  // worker thread. Any running job is stopped first.
+  void set_step_observer(StepObserver observer);
+
+  // Stop the running job after its current step. Its result still arrives
+  // through take_result(), marked as cancelled.
+  void cancel();
+
+  // Stop the running job and wait for it, dropping its result
+  void stop();
+
+  bool running() const;
+
+  Status status() const;
+
+  // The result of the last job, once it has finished. Each result is only
+  // returned once.
+  rmf_utils::optional<Result> take_result();
+
+  std::size_t checkpoint_count() const;
+
+  int checkpoint_interval() const;
+
+  // Only affects checkpoints taken from now on
+  void checkpoint_interval(int interval);
+
+private:
+
+  struct Checkpoint
+  {
+    Progress progress;
+    OptionalPlan plan;
+  };
+
+  void start(Progress progress, OptionalPlan plan, int steps, int target);
+
+  void run(Progress progress, OptionalPlan plan, int steps, int target);
+
+  void join();
+
+  mutable std::mutex _mutex;
+  std::map<int, Checkpoint> _checkpoints;
+  rmf_utils::optional<Result> _result;
+  int _interval;
+  StepObserver _observer;
+
+  std::thread _thread;
+  std::atomic_bool _cancel{false};
+  std::atomic_bool _running{false};
+  std::atomic_int _steps{0};
+  std::atomic_int _target{-1};
+  std::atomic<std::size_t> _queue_size{0};
+};
+
 void do_planner_debug(
   const rmf_traffic::Profile& profile,
   const std::string& chosen_map,
@@ -57,8 +243,11 @@ void do_planner_debug(
   rmf_traffic::agv::Planner::Debug::Progress& progress,
   const std::chrono::steady_clock::time_point& plan_start_timing, // earliest time the timeline starts from
   bool force_replan,
+  rmf_traffic::schedule::Version schedule_version, // searches are reused while it stays the same
+  std::size_t planner_version, // change it when the planner gets another graph or validator
   bool& show_node_trajectories,
-  std::vector<rmf_planner_viz::draw::Trajectory>& trajectories_to_render);
+  std::vector<rmf_planner_viz::draw::Trajectory>& trajectories_to_render,
+  rmf_planner_viz::draw::Graph* graph_drawable = nullptr); // for the heatmap
 
 bool do_planner_presets(
   std::vector<rmf_traffic::agv::Planner::Start>& starts,
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "planner_profiler.hpp"
+
+#include <imgui.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+// How often the thread that records steps reads the resident size, seconds
+constexpr double ResidentPeriod = 0.01;
+
+// Older samples are dropped from the history past this many
+constexpr std::size_t MaxHistory = 200000;
+
+std::size_t latency_bin(double latency)
+{
+  const double us = latency * 1e6;
+  if (us < 2.0)
+    return 0;
+
+  const auto bin = static_cast<std::size_t>(std::log2(us));
+  return std::min(bin, PlannerProfiler::LatencyBins - 1);
+}
+
+template<typename T>
+void trim(std::vector<T>& history)
+{
+  if (history.size() > MaxHistory)
+    history.erase(history.begin(), history.begin() + MaxHistory / 2);
+}
+
+// Plots the last count samples of the history
+struct PlotSource
+{
+  const PlannerProfiler* profiler;
+  std::size_t first;
+};
+
+float plot_latency(void* data, int i)
+{
+  const auto& source = *static_cast<const PlotSource*>(data);
+  return source.profiler->steps()[source.first + i].latency * 1e6;
+}
+
+float plot_rate(void* data, int i)
+{
+  const auto& source = *static_cast<const PlotSource*>(data);
+  return source.profiler->expansion_rate(source.first + i);
+}
+
+float plot_queue(void* data, int i)
+{
+  const auto& source = *static_cast<const PlotSource*>(data);
+  return source.profiler->steps()[source.first + i].queue_size;
+}
+
+float plot_resident(void* data, int i)
+{
+  const auto& source = *static_cast<const PlotSource*>(data);
+  return source.profiler->steps()[source.first + i].resident_bytes / 1048576.0;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+PlannerProfiler::PlannerProfiler(std::size_t ring_capacity)
+: _start(Clock::now()),
+  _step_ring(ring_capacity),
+  _plan_ring(64)
+{
+  _histogram.fill(0.0f);
+}
+
+//==============================================================================
+PlannerProfiler::~PlannerProfiler()
+{
+  if (_plan_thread.joinable())
+    _plan_thread.join();
+}
+
+//==============================================================================
+void PlannerProfiler::record_step(
+  int step, Clock::duration latency, std::size_t queue_size)
+{
+  const double time = now();
+  if (_resident_time < 0.0 || time - _resident_time > ResidentPeriod)
+  {
+    _resident = resident_bytes();
+    _resident_time = time;
+  }
+
+  const StepSample sample{
+    time, step, std::chrono::duration<double>(latency).count(),
+    queue_size, _resident};
+
+  if (!_step_ring.push(sample))
+    ++_dropped;
+}
+
+//==============================================================================
+bool PlannerProfiler::time_plan(
+  const Planner& planner,
+  const std::vector<Planner::Start>& starts,
+  const Planner::Goal& goal)
+{
+  if (_planning)
+    return false;
+
+  if (_plan_thread.joinable())
+    _plan_thread.join();
+
+  // The copy shares the caches of the planner but keeps the thread safe from
+  // the planner being destroyed before it is done
+  _planning = true;
+  _plan_thread = std::thread(
+    [this, planner, starts, goal]()
+    {
+      const std::size_t resident_before = resident_bytes();
+      const auto t0 = Clock::now();
+      const auto result = planner.plan(starts, goal);
+      const auto t1 = Clock::now();
+
+      const PlanSample sample{
+        now(), std::chrono::duration<double>(t1 - t0).count(),
+        result.success(), resident_before, resident_bytes()};
+
+      if (!_plan_ring.push(sample))
+        ++_dropped;
+
+      _planning = false;
+    });
+
+  return true;
+}
+
+//==============================================================================
+bool PlannerProfiler::planning() const
+{
+  return _planning;
+}
+
+//==============================================================================
+void PlannerProfiler::update()
+{
+  _step_ring.drain([&](const StepSample& sample)
+    {
+      _steps.push_back(sample);
+      _histogram[latency_bin(sample.latency)] += 1.0f;
+    });
+  trim(_steps);
+
+  _plan_ring.drain([&](const PlanSample& sample)
+    {
+      _plans.push_back(sample);
+    });
+  trim(_plans);
+}
+
+//==============================================================================
+void PlannerProfiler::clear()
+{
+  update();
+  _steps.clear();
+  _plans.clear();
+  _histogram.fill(0.0f);
+  _dropped = 0;
+}
+
+//==============================================================================
+auto PlannerProfiler::steps() const -> const std::vector<StepSample>&
+{
+  return _steps;
+}
+
+//==============================================================================
+auto PlannerProfiler::plans() const -> const std::vector<PlanSample>&
+{
+  return _plans;
+}
+
+//==============================================================================
+const std::array<float, PlannerProfiler::LatencyBins>&
+PlannerProfiler::latency_histogram() const
+{
+  return _histogram;
+}
+
+//==============================================================================
+double PlannerProfiler::expansion_rate(
+  std::size_t sample, std::size_t window) const
+{
+  if (_steps.size() <= sample || sample == 0)
+    return 0.0;
+
+  const std::size_t first = sample - std::min(sample, window);
+  const double elapsed = _steps[sample].time - _steps[first].time;
+  if (elapsed <= 0.0)
+    return 0.0;
+
+  return (sample - first) / elapsed;
+}
+
+//==============================================================================
+std::size_t PlannerProfiler::dropped() const
+{
+  return _dropped;
+}
+
+//==============================================================================
+bool PlannerProfiler::write_csv(const std::string& filename) const
+{
+  std::ofstream file(filename);
+  if (!file)
+    return false;
+
+  file << "kind,time_s,step,latency_s,queue_size,resident_bytes,success\n";
+  for (const auto& s : _steps)
+  {
+    file << "step," << s.time << "," << s.step << "," << s.latency << ","
+         << s.queue_size << "," << s.resident_bytes << ",\n";
+  }
+
+  for (const auto& p : _plans)
+  {
+    file << "plan," << p.time << ",," << p.duration << ",,"
+         << p.resident_after << "," << (p.success ? 1 : 0) << "\n";
+  }
+
+  return static_cast<bool>(file);
+}
+
+//==============================================================================
+std::size_t PlannerProfiler::resident_bytes()
+{
+  std::FILE* statm = std::fopen("/proc/self/statm", "r");
+  if (!statm)
+    return 0;
+
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  const int read = std::fscanf(statm, "%lu %lu", &size, &resident);
+  std::fclose(statm);
+  if (read != 2)
+    return 0;
+
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+//==============================================================================
+double PlannerProfiler::now() const
+{
+  return std::chrono::duration<double>(Clock::now() - _start).count();
+}
+
+//==============================================================================
+void do_planner_profiler(
+  PlannerProfiler& profiler,
+  const rmf_traffic::agv::Planner& planner,
+  const std::vector<rmf_traffic::agv::Planner::Start>& starts,
+  const rmf_traffic::agv::Planner::Goal& goal)
+{
+  profiler.update();
+
+  ImGui::SetNextWindowPos(ImVec2(1420, 100), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(480, 600), ImGuiCond_FirstUseEver);
+  ImGui::Begin("Planner Profiler");
+
+  const auto& steps = profiler.steps();
+  ImGui::Text("Steps recorded: %lu", steps.size());
+  if (profiler.dropped() > 0)
+    ImGui::TextColored(ImVec4(1, 0, 0, 1), "Samples dropped: %lu",
+      profiler.dropped());
+
+  static int window = 1000;
+  ImGui::SliderInt("Samples shown", &window, 100, 10000);
+
+  const std::size_t count =
+    std::min(steps.size(), static_cast<std::size_t>(window));
+  PlotSource source{&profiler, steps.size() - count};
+
+  if (!steps.empty())
+  {
+    const auto& last = steps.back();
+    char overlay[64] = { 0 };
+
+    snprintf(overlay, sizeof(overlay), "last %.1f us", last.latency * 1e6);
+    ImGui::PlotLines("Step latency (us)", plot_latency, &source,
+      static_cast<int>(count), 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    snprintf(overlay, sizeof(overlay), "%.0f steps/s",
+      profiler.expansion_rate(steps.size() - 1));
+    ImGui::PlotLines("Expansion rate", plot_rate, &source,
+      static_cast<int>(count), 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    snprintf(overlay, sizeof(overlay), "%lu nodes", last.queue_size);
+    ImGui::PlotLines("Queue size", plot_queue, &source,
+      static_cast<int>(count), 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    snprintf(overlay, sizeof(overlay), "%.1f MB",
+      last.resident_bytes / 1048576.0);
+    ImGui::PlotLines("Resident memory (MB)", plot_resident, &source,
+      static_cast<int>(count), 0, overlay, FLT_MAX, FLT_MAX, ImVec2(0, 80));
+  }
+
+  const auto& histogram = profiler.latency_histogram();
+  ImGui::PlotHistogram("Latency histogram", histogram.data(),
+    static_cast<int>(histogram.size()), 0, "log2(us)", 0.0f, FLT_MAX,
+    ImVec2(0, 80));
+
+  ImGui::Separator();
+
+  if (profiler.planning())
+    ImGui::Text("Timing Planner::plan()..");
+  else if (ImGui::Button("Time Planner::plan()"))
+    profiler.time_plan(planner, starts, goal);
+
+  const auto& plans = profiler.plans();
+  for (std::size_t i = plans.size() - std::min<std::size_t>(plans.size(), 5);
+    i < plans.size(); ++i)
+  {
+    const auto& p = plans[i];
+    ImGui::Text("plan() %s in %.3f s, memory %+.1f MB",
+      p.success ? "succeeded" : "failed", p.duration,
+      (double(p.resident_after) - double(p.resident_before)) / 1048576.0);
+  }
+
+  ImGui::Separator();
+
+  static char csv_file[256] = "planner_profile.csv";
+  static const char* csv_status = "";
+  ImGui::InputText("CSV file", csv_file, sizeof(csv_file));
+  if (ImGui::Button("Export CSV"))
+    csv_status = profiler.write_csv(csv_file) ? "Saved" : "Failed to save";
+  ImGui::SameLine();
+  if (ImGui::Button("Clear"))
+    profiler.clear();
+  ImGui::Text("%s", csv_status);
+
+  ImGui::End();
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
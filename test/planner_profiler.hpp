@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__PLANNER_PROFILER_HPP
+#define RMF_PLANNER_VIZ__DRAW__PLANNER_PROFILER_HPP
+
+#include <rmf_traffic/agv/Planner.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.hpp"
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Timing of Progress::step() and Planner::plan() for the planner debugger.
+//
+// Samples are recorded on the thread that does the work and pushed into lock
+// free rings, so measuring adds no locking to the search. The window thread
+// moves them into the history once per frame with update(). Samples that
+// arrive while the rings are full are dropped and counted.
+class PlannerProfiler
+{
+public:
+
+  using Clock = std::chrono::steady_clock;
+  using Planner = rmf_traffic::agv::Planner;
+
+  struct StepSample
+  {
+    // Seconds since the profiler was made
+    double time;
+    int step;
+    double latency;
+    std::size_t queue_size;
+    std::size_t resident_bytes;
+  };
+
+  struct PlanSample
+  {
+    double time;
+    double duration;
+    bool success;
+    std::size_t resident_before;
+    std::size_t resident_after;
+  };
+
+  // Latency histogram bin i counts steps that took [2^i, 2^(i+1)) us, with the
+  // first and last bins open ended
+  static constexpr std::size_t LatencyBins = 20;
+
+  explicit PlannerProfiler(std::size_t ring_capacity = 1 << 16);
+
+  PlannerProfiler(const PlannerProfiler&) = delete;
+  PlannerProfiler& operator=(const PlannerProfiler&) = delete;
+
+  ~PlannerProfiler();
+
+  // Record a step of a search. Only one thread may record steps at a time.
+  void record_step(int step, Clock::duration latency, std::size_t queue_size);
+
+  // Time Planner::plan() on a copy of the planner, on a thread of its own.
+  // False if a plan is still being timed.
+  bool time_plan(
+    const Planner& planner,
+    const std::vector<Planner::Start>& starts,
+    const Planner::Goal& goal);
+
+  bool planning() const;
+
+  // Move the recorded samples into the history. Window thread only, as are
+  // the functions below.
+  void update();
+
+  void clear();
+
+  const std::vector<StepSample>& steps() const;
+
+  const std::vector<PlanSample>& plans() const;
+
+  const std::array<float, LatencyBins>& latency_histogram() const;
+
+  // Steps per second over the given sample and the ones before it
+  double expansion_rate(std::size_t sample, std::size_t window = 64) const;
+
+  std::size_t dropped() const;
+
+  // Write every sample of the history, steps and plans in one table
+  bool write_csv(const std::string& filename) const;
+
+  // Resident set size of this process, or 0 where /proc/self/statm cannot be
+  // read
+  static std::size_t resident_bytes();
+
+private:
+
+  double now() const;
+
+  Clock::time_point _start;
+
+  SpscRing<StepSample> _step_ring;
+  SpscRing<PlanSample> _plan_ring;
+  std::atomic<std::size_t> _dropped{0};
+
+  // Reading the resident size is a system call, so it is only done this often
+  // and reused in between. Written by the thread that records steps.
+  double _resident_time = -1.0;
+  std::size_t _resident = 0;
+
+  std::thread _plan_thread;
+  std::atomic_bool _planning{false};
+
+  std::vector<StepSample> _steps;
+  std::vector<PlanSample> _plans;
+  std::array<float, LatencyBins> _histogram;
+};
+
+// Window with the plots of a profiler. Calls profiler.update().
+void do_planner_profiler(
+  PlannerProfiler& profiler,
+  const rmf_traffic::agv::Planner& planner,
+  const std::vector<rmf_traffic::agv::Planner::Start>& starts,
+  const rmf_traffic::agv::Planner::Goal& goal);
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__PLANNER_PROFILER_HPP
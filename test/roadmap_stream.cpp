@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "roadmap_stream.hpp"
+
+#include <SFML/Graphics/CircleShape.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+// Vertices that a buffer of a map has room for when it is first created
+constexpr std::size_t InitialCapacity = 4096;
+
+sf::Vector2f to_sf(const Eigen::Vector2d& p)
+{
+  return sf::Vector2f(static_cast<float>(p.x()), static_cast<float>(p.y()));
+}
+
+} // anonymous namespace
+
+//==============================================================================
+RoadmapStream::RoadmapStream(double cell_size)
+: _cell_size(cell_size)
+{
+  // Do nothing
+}
+
+//==============================================================================
+void RoadmapStream::add_segment(
+  const std::string& map,
+  const std::vector<rmf_traffic::Route>& routes,
+  const double planning_time)
+{
+  // Build the vertices before locking so the window thread waits as little
+  // as possible
+  std::vector<Node> nodes;
+  Vertices vertices;
+  const sf::Color edge_color = color(planning_time);
+  for (const auto& route : routes)
+  {
+    const auto& trajectory = route.trajectory();
+    for (std::size_t i = 0; i < trajectory.size(); ++i)
+    {
+      const Eigen::Vector2d p = trajectory[i].position().head<2>();
+      nodes.push_back(Node{p, trajectory[i].time(), 0});
+      vertices.nodes.emplace_back(to_sf(p), sf::Color::White);
+
+      if (i == 0)
+        continue;
+
+      const Eigen::Vector2d q = trajectory[i - 1].position().head<2>();
+      vertices.edges.emplace_back(to_sf(q), edge_color);
+      vertices.edges.emplace_back(to_sf(p), edge_color);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  const std::size_t index = _pending.segments.size();
+  for (auto& node : nodes)
+    node.segment = index;
+
+  _pending.segments.push_back(
+    Segment{map, planning_time, nodes.size(), vertices.edges.size() / 2});
+
+  _pending.nodes.insert(_pending.nodes.end(), nodes.begin(), nodes.end());
+
+  auto& pending = _pending.vertices[map];
+  pending.edges.insert(
+    pending.edges.end(), vertices.edges.begin(), vertices.edges.end());
+  pending.nodes.insert(
+    pending.nodes.end(), vertices.nodes.begin(), vertices.nodes.end());
+}
+
+//==============================================================================
+void RoadmapStream::update()
+{
+  Pending pending;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::swap(pending, _pending);
+  }
+
+  if (pending.segments.empty())
+    return;
+
+  const std::size_t segment_offset = _segments.size();
+  for (auto& node : pending.nodes)
+  {
+    node.segment += segment_offset;
+    _grid[cell_of(node.position.x(), node.position.y())].push_back(
+      _nodes.size());
+    _nodes.push_back(node);
+  }
+
+  _segments.insert(
+    _segments.end(), pending.segments.begin(), pending.segments.end());
+
+  for (const auto& added : pending.vertices)
+  {
+    auto& map = _maps[added.first];
+    auto& vertices = map.vertices;
+    vertices.edges.insert(
+      vertices.edges.end(), added.second.edges.begin(),
+      added.second.edges.end());
+    vertices.nodes.insert(
+      vertices.nodes.end(), added.second.nodes.begin(),
+      added.second.nodes.end());
+    _edge_count += added.second.edges.size() / 2;
+
+    if (_use_vertex_buffers && !upload(map))
+      _use_vertex_buffers = false;
+  }
+}
+
+//==============================================================================
+void RoadmapStream::clear()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending = Pending();
+  }
+
+  _nodes.clear();
+  _segments.clear();
+  _maps.clear();
+  _edge_count = 0;
+  _grid.clear();
+  _selected = rmf_utils::nullopt;
+}
+
+//==============================================================================
+void RoadmapStream::choose_map(const std::string& map)
+{
+  _map = map;
+}
+
+//==============================================================================
+void RoadmapStream::select(rmf_utils::optional<std::size_t> node)
+{
+  _selected = node;
+}
+
+//==============================================================================
+auto RoadmapStream::nodes() const -> const std::vector<Node>&
+{
+  return _nodes;
+}
+
+//==============================================================================
+auto RoadmapStream::segments() const -> const std::vector<Segment>&
+{
+  return _segments;
+}
+
+//==============================================================================
+std::size_t RoadmapStream::edge_count() const
+{
+  return _edge_count;
+}
+
+//==============================================================================
+rmf_utils::optional<std::size_t> RoadmapStream::pick(
+  double x, double y, double radius) const
+{
+  const auto reach = static_cast<std::int64_t>(std::ceil(radius / _cell_size));
+  const auto cx = static_cast<std::int64_t>(std::floor(x / _cell_size));
+  const auto cy = static_cast<std::int64_t>(std::floor(y / _cell_size));
+
+  rmf_utils::optional<std::size_t> closest;
+  double closest_distance = radius;
+  for (std::int64_t i = cx - reach; i <= cx + reach; ++i)
+  {
+    for (std::int64_t j = cy - reach; j <= cy + reach; ++j)
+    {
+      const auto cell = _grid.find(key(i, j));
+      if (cell == _grid.end())
+        continue;
+
+      for (const auto n : cell->second)
+      {
+        const auto& node = _nodes[n];
+        if (_segments[node.segment].map != _map)
+          continue;
+
+        const double distance =
+          (node.position - Eigen::Vector2d(x, y)).norm();
+        if (distance <= closest_distance)
+        {
+          closest = n;
+          closest_distance = distance;
+        }
+      }
+    }
+  }
+
+  return closest;
+}
+
+//==============================================================================
+sf::Color RoadmapStream::color(double planning_time)
+{
+  // Log scale from a millisecond to a second
+  const double t = std::max(planning_time, 1e-6);
+  const double f = std::min(std::max((std::log10(t) + 3.0) / 3.0, 0.0), 1.0);
+
+  // Green to yellow to red
+  const auto channel = [](double v)
+    {
+      return static_cast<sf::Uint8>(std::round(255.0 * v));
+    };
+
+  if (f < 0.5)
+    return sf::Color(channel(2.0 * f), 255, 0);
+
+  return sf::Color(255, channel(2.0 * (1.0 - f)), 0);
+}
+
+//==============================================================================
+void RoadmapStream::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+  const auto it = _maps.find(_map);
+  if (it != _maps.end())
+  {
+    const auto& map = it->second;
+    const auto& vertices = map.vertices;
+    if (_use_vertex_buffers)
+    {
+      target.draw(map.edges, 0, vertices.edges.size(), states);
+      target.draw(map.nodes, 0, vertices.nodes.size(), states);
+    }
+    else
+    {
+      if (!vertices.edges.empty())
+      {
+        target.draw(vertices.edges.data(), vertices.edges.size(), sf::Lines,
+          states);
+      }
+
+      if (!vertices.nodes.empty())
+      {
+        target.draw(vertices.nodes.data(), vertices.nodes.size(), sf::Points,
+          states);
+      }
+    }
+  }
+
+  if (_selected && *_selected < _nodes.size())
+  {
+    const auto& node = _nodes[*_selected];
+    if (_segments[node.segment].map == _map)
+    {
+      const float radius = 0.3f;
+      sf::CircleShape marker(radius);
+      marker.setOrigin(radius, radius);
+      marker.setPosition(to_sf(node.position));
+      marker.setFillColor(sf::Color::Transparent);
+      marker.setOutlineColor(sf::Color::Cyan);
+      marker.setOutlineThickness(0.05f);
+      target.draw(marker, states);
+    }
+  }
+}
+
+//==============================================================================
+bool RoadmapStream::upload(MapBuffers& map)
+{
+  if (!sf::VertexBuffer::isAvailable())
+    return false;
+
+  const auto append = [](
+    sf::VertexBuffer& buffer,
+    const std::vector<sf::Vertex>& vertices,
+    std::size_t& uploaded) -> bool
+    {
+      if (uploaded == vertices.size())
+        return true;
+
+      if (vertices.size() > buffer.getVertexCount())
+      {
+        // Double the capacity so that appending stays linear overall, and
+        // send everything again since a new buffer starts out empty
+        std::size_t capacity = std::max<std::size_t>(
+          buffer.getVertexCount(), InitialCapacity);
+        while (capacity < vertices.size())
+          capacity *= 2;
+
+        if (!buffer.create(capacity))
+          return false;
+
+        uploaded = 0;
+      }
+
+      if (!buffer.update(vertices.data() + uploaded,
+        vertices.size() - uploaded, static_cast<unsigned int>(uploaded)))
+      {
+        return false;
+      }
+
+      uploaded = vertices.size();
+      return true;
+    };
+
+  return append(map.edges, map.vertices.edges, map.uploaded_edges)
+    && append(map.nodes, map.vertices.nodes, map.uploaded_nodes);
+}
+
+//==============================================================================
+std::uint64_t RoadmapStream::cell_of(double x, double y) const
+{
+  return key(
+    static_cast<std::int64_t>(std::floor(x / _cell_size)),
+    static_cast<std::int64_t>(std::floor(y / _cell_size)));
+}
+
+//==============================================================================
+std::uint64_t RoadmapStream::key(std::int64_t cx, std::int64_t cy)
+{
+  // Pack the two cell coordinates into one key
+  return (static_cast<std::uint64_t>(cx) << 32)
+    ^ (static_cast<std::uint64_t>(cy) & 0xffffffff);
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__ROADMAP_STREAM_HPP
+#define RMF_PLANNER_VIZ__DRAW__ROADMAP_STREAM_HPP
+
+#include <rmf_traffic/Route.hpp>
+#include <rmf_traffic/Time.hpp>
+
+#include <rmf_utils/optional.hpp>
+
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <SFML/Graphics/VertexBuffer.hpp>
+
+#include <Eigen/Geometry>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// The routes of a probabilistic road map as they are planned, drawn while
+// the planner is still working on the rest.
+//
+// The planning thread adds the routes of each segment as soon as they are
+// found. They are turned into vertices right away and queued, and the window
+// thread appends the queue to a vertex buffer of each map once per frame.
+// Only the new vertices are sent to the GPU, the buffers double in size when
+// they are full, and each map is drawn with one call for its edges and one for
+// its nodes. Edges are colored by how long their segment took to plan, which
+// makes slow segments stand out.
+//
+// Nodes are kept in a grid of cells for picking.
+class RoadmapStream : public sf::Drawable
+{
+public:
+
+  struct Node
+  {
+    Eigen::Vector2d position;
+    rmf_traffic::Time time;
+    std::size_t segment;
+  };
+
+  struct Segment
+  {
+    std::string map;
+
+    // Seconds spent planning the segment
+    double planning_time;
+
+    std::size_t nodes;
+    std::size_t edges;
+  };
+
+  explicit RoadmapStream(double cell_size = 1.0);
+
+  // Add the routes that were planned for a segment. May be called from any
+  // thread.
+  void add_segment(
+    const std::string& map,
+    const std::vector<rmf_traffic::Route>& routes,
+    double planning_time);
+
+  // Append what was added since the last call and send it to the GPU. Call
+  // from the window thread.
+  void update();
+
+  void clear();
+
+  // Only draw the segments of this map
+  void choose_map(const std::string& map);
+
+  // Draw a marker on the given node
+  void select(rmf_utils::optional<std::size_t> node);
+
+  const std::vector<Node>& nodes() const;
+
+  const std::vector<Segment>& segments() const;
+
+  std::size_t edge_count() const;
+
+  // The node of the chosen map closest to (x, y), if one is within radius
+  rmf_utils::optional<std::size_t> pick(double x, double y, double radius) const;
+
+  // Color of an edge whose segment took the given seconds to plan, from green
+  // at a millisecond to red at a second
+  static sf::Color color(double planning_time);
+
+protected:
+
+  void draw(sf::RenderTarget& target, sf::RenderStates states) const final;
+
+private:
+
+  struct Vertices
+  {
+    std::vector<sf::Vertex> edges;
+    std::vector<sf::Vertex> nodes;
+  };
+
+  // The vertices of one map. The CPU copies fill the GPU buffers again when
+  // they grow, and are drawn directly if vertex buffers cannot be used.
+  struct MapBuffers
+  {
+    Vertices vertices;
+    sf::VertexBuffer edges{sf::Lines, sf::VertexBuffer::Dynamic};
+    sf::VertexBuffer nodes{sf::Points, sf::VertexBuffer::Dynamic};
+    std::size_t uploaded_edges = 0;
+    std::size_t uploaded_nodes = 0;
+  };
+
+  struct Pending
+  {
+    std::vector<Node> nodes;
+    std::vector<Segment> segments;
+    std::map<std::string, Vertices> vertices;
+  };
+
+  // Send the vertices that were appended since the last upload
+  bool upload(MapBuffers& map);
+
+  std::uint64_t cell_of(double x, double y) const;
+
+  static std::uint64_t key(std::int64_t cx, std::int64_t cy);
+
+  double _cell_size;
+
+  // Filled by the planning thread
+  std::mutex _mutex;
+  Pending _pending;
+
+  // Only used by the window thread
+  std::vector<Node> _nodes;
+  std::vector<Segment> _segments;
+  std::map<std::string, MapBuffers> _maps;
+  std::size_t _edge_count = 0;
+  bool _use_vertex_buffers = true;
+  std::unordered_map<std::uint64_t, std::vector<std::size_t>> _grid;
+  std::string _map;
+  rmf_utils::optional<std::size_t> _selected;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__ROADMAP_STREAM_HPP
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "scenario_loading.hpp"
+#include "thread_pool.hpp"
+
+#include <rmf_performance_tests/rmf_performance_tests.hpp>
+
+#include <sys/stat.h>
+
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <ctime>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+namespace {
+
+using Planner = rmf_traffic::agv::Planner;
+
+std::size_t get_wp(const rmf_traffic::agv::Graph& graph, const std::string& name)
+{
+  const auto* wp = graph.find_waypoint(name);
+  if (!wp)
+    throw std::runtime_error("Waypoint [" + name + "] is not in the graph");
+
+  return wp->index();
+}
+
+struct ObstacleJob
+{
+  const Planner* planner;
+  Planner::Start start;
+  std::size_t goal;
+  rmf_utils::optional<std::vector<rmf_traffic::Route>> itinerary;
+};
+
+struct CacheEntry
+{
+  std::time_t modified;
+  std::weak_ptr<const Scenario> scenario;
+};
+
+std::time_t modified_time(const std::string& filename)
+{
+  struct stat info;
+  if (stat(filename.c_str(), &info) != 0)
+    return 0;
+
+  return info.st_mtime;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+bool load_font(sf::Font& font)
+{
+  if (!font.loadFromFile("./build/rmf_planner_viz/fonts/OpenSans-Bold.ttf"))
+  {
+    std::cout <<
+      "Failed to load font. Make sure you run the executable from the colcon directory"
+              << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//==============================================================================
+std::shared_ptr<const Scenario> Scenario::load(const std::string& filename)
+{
+  static std::mutex cache_mutex;
+  static std::map<std::string, CacheEntry> cache;
+
+  const std::time_t modified = modified_time(filename);
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    const auto it = cache.find(filename);
+    if (it != cache.end() && it->second.modified == modified)
+    {
+      if (const auto scenario = it->second.scenario.lock())
+        return scenario;
+    }
+  }
+
+  // Parse without holding the lock so that different files load in parallel
+  Description description;
+  parse(filename, description);
+
+  const std::shared_ptr<const Scenario> scenario(
+    new Scenario(filename, std::move(description)));
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto& entry = cache[filename];
+  if (entry.modified == modified)
+  {
+    // Another thread may have loaded the same file in the meantime
+    if (const auto loaded = entry.scenario.lock())
+      return loaded;
+  }
+
+  entry = CacheEntry{modified, scenario};
+  return scenario;
+}
+
+//==============================================================================
+Scenario::Scenario(std::string filename, Description description)
+: _filename(std::move(filename)),
+  _description(std::move(description))
+{
+  const auto& robots = _description.robots;
+  const auto plan_robot = robots.find(_description.plan.robot);
+  if (plan_robot == robots.end())
+  {
+    throw std::runtime_error("Plan robot [" + _description.plan.robot
+      + "]'s traits and profile missing");
+  }
+
+  std::set<std::string> missing_robots;
+  const auto resolve = [&](const auto& plan) -> Plan
+    {
+      auto robot = robots.find(plan.robot);
+      if (robot == robots.end())
+      {
+        if (missing_robots.insert(plan.robot).second)
+        {
+          std::cout << "Robot [" << plan.robot <<
+            "] is missing traits and profile. Using traits and profile of plan_robot."
+                    << std::endl;
+        }
+
+        robot = plan_robot;
+      }
+
+      if (_planners.find(robot->first) == _planners.end())
+      {
+        _planners.emplace(
+          robot->first, Planner(robot->second, Planner::Options(nullptr)));
+      }
+
+      const auto& graph = robot->second.graph();
+      return Plan{
+        robot->first,
+        get_wp(graph, plan.initial_waypoint),
+        get_wp(graph, plan.goal),
+        plan.initial_orientation,
+        std::chrono::seconds(plan.initial_time)
+      };
+    };
+
+  _plan = resolve(_description.plan);
+
+  _obstacle_plans.reserve(_description.obstacle_plans.size());
+  for (const auto& obstacle : _description.obstacle_plans)
+    _obstacle_plans.push_back(resolve(obstacle));
+
+  for (const auto& obstacle : _description.obstacle_routes)
+  {
+    if (robots.find(obstacle.robot) == robots.end())
+    {
+      throw std::runtime_error("Robot [" + obstacle.robot
+        + "] of an obstacle route is missing traits and profile");
+    }
+  }
+}
+
+//==============================================================================
+const std::string& Scenario::filename() const
+{
+  return _filename;
+}
+
+//==============================================================================
+auto Scenario::description() const -> const Description&
+{
+  return _description;
+}
+
+//==============================================================================
+auto Scenario::plan_robot() const -> const Planner::Configuration&
+{
+  return _planners.at(_plan.robot).get_configuration();
+}
+
+//==============================================================================
+auto Scenario::plan() const -> const Plan&
+{
+  return _plan;
+}
+
+//==============================================================================
+auto Scenario::obstacle_plans() const -> const std::vector<Plan>&
+{
+  return _obstacle_plans;
+}
+
+//==============================================================================
+auto Scenario::planner(const std::string& robot) const -> Planner
+{
+  const auto it = _planners.find(robot);
+  if (it != _planners.end())
+    return it->second;
+
+  // Robots that nothing plans for yet get a planner of their own
+  const auto config = _description.robots.find(robot);
+  if (config == _description.robots.end())
+  {
+    throw std::runtime_error(
+      "Robot [" + robot + "] is missing traits and profile");
+  }
+
+  return Planner(config->second, Planner::Options(nullptr));
+}
+
+//==============================================================================
+auto Scenario::starts(const rmf_traffic::Time start_time) const
+-> std::vector<Planner::Start>
+{
+  // Unlike those of the obstacles, the orientation of the plan has always been
+  // passed to the planner as it is written in the scenario
+  std::vector<Planner::Start> starts;
+  starts.emplace_back(
+    start_time + _plan.initial_time,
+    _plan.initial_waypoint,
+    _plan.initial_orientation);
+
+  return starts;
+}
+
+//==============================================================================
+auto Scenario::goal() const -> Planner::Goal
+{
+  return Planner::Goal(_plan.goal);
+}
+
+//==============================================================================
+std::vector<rmf_traffic::schedule::Participant> Scenario::add_obstacles(
+  const std::shared_ptr<rmf_traffic::schedule::Database>& database,
+  const rmf_traffic::Time start_time,
+  const std::size_t threads) const
+{
+  std::vector<ObstacleJob> jobs;
+  jobs.reserve(_obstacle_plans.size());
+  for (const auto& obstacle : _obstacle_plans)
+  {
+    jobs.push_back(
+      ObstacleJob{
+        &_planners.at(obstacle.robot),
+        Planner::Start(
+          start_time + obstacle.initial_time,
+          obstacle.initial_waypoint,
+          obstacle.initial_orientation * M_PI / 180.0),
+        obstacle.goal,
+        rmf_utils::nullopt
+      });
+  }
+
+  if (!jobs.empty())
+  {
+    ThreadPool pool(threads);
+    pool.parallel_for(0, jobs.size(), 1,
+      [&jobs](std::size_t begin, std::size_t end)
+      {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+          auto& job = jobs[i];
+          const auto result = job.planner->plan(
+            job.start, Planner::Goal(job.goal));
+          if (result)
+            job.itinerary = result->get_itinerary();
+        }
+      });
+  }
+
+  std::vector<rmf_traffic::schedule::Participant> obstacles;
+  obstacles.reserve(jobs.size() + _description.obstacle_routes.size());
+  for (std::size_t i = 0; i < jobs.size(); ++i)
+  {
+    const auto& job = jobs[i];
+    if (!job.itinerary || job.itinerary->empty())
+    {
+      std::cout << "No plan found for obstacle plan " << i << std::endl;
+      continue;
+    }
+
+    // Register through the same library call as the obstacle routes so that
+    // the participant is described the same way as by add_obstacle(planner,
+    // ...), then give it the rest of the itinerary if it spans several maps.
+    const auto& itinerary = *job.itinerary;
+    auto participant = rmf_performance_tests::add_obstacle(
+      database,
+      job.planner->get_configuration().vehicle_traits().profile(),
+      itinerary.front());
+
+    if (itinerary.size() > 1)
+      participant.set(itinerary);
+
+    obstacles.emplace_back(std::move(participant));
+  }
+
+  for (const auto& obstacle : _description.obstacle_routes)
+  {
+    const auto& robot = _description.robots.at(obstacle.robot);
+
+    obstacles.emplace_back(
+      rmf_performance_tests::add_obstacle(
+        database,
+        robot.vehicle_traits().profile(),
+        obstacle.route));
+  }
+
+  return obstacles;
+}
+
+//==============================================================================
+rmf_traffic::schedule::Participant Scenario::make_plan_participant(
+  const std::shared_ptr<rmf_traffic::schedule::Database>& database) const
+{
+  return rmf_traffic::schedule::make_participant(
+    rmf_traffic::schedule::ParticipantDescription{
+      "participant_0",
+      "test_trajectory",
+      rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
+      plan_robot().vehicle_traits().profile()
+    },
+    database);
+}
+
+} // namespace draw
+} // namespace rmf_planner_viz
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__SCENARIO_LOADING_HPP
+#define RMF_PLANNER_VIZ__DRAW__SCENARIO_LOADING_HPP
+
+#include <SFML/Graphics/Font.hpp>
+
+#include <rmf_performance_tests/Scenario.hpp>
+
+#include <rmf_traffic/Time.hpp>
+#include <rmf_traffic/agv/Planner.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Participant.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Load the font that the apps label the graph with. Prints a message and
+// returns false if it is not found.
+bool load_font(sf::Font& font);
+
+// A scenario of rmf_performance_tests that has been checked once when it was
+// loaded: every robot it refers to has traits, and every waypoint name has
+// been resolved to its index in the graph of its robot.
+class Scenario
+{
+public:
+
+  using Description = rmf_performance_tests::scenario::Description;
+  using Planner = rmf_traffic::agv::Planner;
+
+  // A plan of the scenario with its waypoints resolved
+  struct Plan
+  {
+    // The robot whose traits are used. Obstacles whose robot has no traits of
+    // its own use those of the plan robot.
+    std::string robot;
+
+    std::size_t initial_waypoint;
+    std::size_t goal;
+    double initial_orientation;
+    rmf_traffic::Duration initial_time;
+  };
+
+  // Parse and check a scenario file. Throws std::runtime_error if the file
+  // cannot be parsed, if the plan robot has no traits, or if a waypoint is not
+  // in the graph of its robot.
+  //
+  // Scenarios are cached by file name for as long as someone holds on to
+  // them, so loading a file that has not changed since returns the same
+  // scenario, with the same planners.
+  static std::shared_ptr<const Scenario> load(const std::string& filename);
+
+  const std::string& filename() const;
+
+  const Description& description() const;
+
+  // The traits and graph of the robot that the scenario plans for
+  const Planner::Configuration& plan_robot() const;
+
+  const Plan& plan() const;
+
+  const std::vector<Plan>& obstacle_plans() const;
+
+  // A planner for one of the robots of the scenario, without a validator.
+  // Every planner of the same robot shares its caches with the others, so
+  // the heuristics are only computed once, whichever app or thread plans.
+  Planner planner(const std::string& robot) const;
+
+  // Where the plan of the scenario starts and ends
+  std::vector<Planner::Start> starts(rmf_traffic::Time start_time) const;
+  Planner::Goal goal() const;
+
+  // Put the obstacles of the scenario into the database, first the obstacle
+  // plans and then the obstacle routes, each in the order of the scenario.
+  //
+  // Obstacle plans are planned concurrently on the given number of threads,
+  // or on every core when it is 0. Each obstacle gets its participant only
+  // once every plan is done, so the participant ids and the database contents
+  // do not depend on which plan finished first. If planning an obstacle
+  // throws, the exception is rethrown once the other plans are done and
+  // nothing is added to the database. Participants are registered with
+  // rmf_performance_tests::add_obstacle, like every other user of the
+  // scenarios. An obstacle plan that finds no plan is skipped with a message.
+  std::vector<rmf_traffic::schedule::Participant> add_obstacles(
+    const std::shared_ptr<rmf_traffic::schedule::Database>& database,
+    rmf_traffic::Time start_time,
+    std::size_t threads = 0) const;
+
+  // The participant that the plan of the scenario is put into the schedule as
+  rmf_traffic::schedule::Participant make_plan_participant(
+    const std::shared_ptr<rmf_traffic::schedule::Database>& database) const;
+
+private:
+  Scenario(std::string filename, Description description);
+
+  std::string _filename;
+  Description _description;
+  Plan _plan;
+  std::vector<Plan> _obstacle_plans;
+  std::map<std::string, Planner> _planners;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__SCENARIO_LOADING_HPP
@@ -124,7 +124,14 @@ int main(int argc, char* argv[])
     graph_0.add_lane(12, 10);
   }
 
-  rmf_planner_viz::draw::Graph graph_0_drawable(graph_0, 1.0, font);
+  // Reuse the tessellated nav graph across runs on the same nav graph file
+  std::string render_cache;
+  if (argc == 2)
+    render_cache = std::string(argv[1]) + ".render_cache";
+
+  rmf_planner_viz::draw::Graph graph_0_drawable(
+    graph_0, 1.0, font, render_cache);
+  graph_0_drawable.set_prefetch_adjacent_maps(true);
   std::vector<std::string> map_names = graph_0_drawable.get_map_names();
   std::string chosen_map;
   if (graph_0_drawable.current_map())
@@ -137,6 +144,10 @@ int main(int argc, char* argv[])
         rmf_traffic::agv::Planner::Configuration(graph_0, traits),
         rmf_traffic::agv::Planner::Options(nullptr));
 
+  // The planner keeps this graph and validator, so searches of the debugger
+  // stay valid for as long as the app runs
+  const std::size_t planner_version = 0;
+
   /// Setup participants
   auto p0 = rmf_traffic::schedule::make_participant(
         rmf_traffic::schedule::ParticipantDescription{
@@ -247,6 +258,9 @@ int main(int argc, char* argv[])
   
   ImGui::SFML::Init(app_window);
 
+  bool show_all_levels = false;
+  bool stack_levels = false;
+
   sf::Clock deltaClock;
   while (app_window.isOpen())
   {
@@ -257,6 +271,8 @@ int main(int argc, char* argv[])
 
       if (event.type == sf::Event::Closed)
       {
+        // Keep the levels tessellated in this run for the next one
+        graph_0_drawable.update_cache();
         return 0;
       }
 
@@ -326,6 +342,7 @@ int main(int argc, char* argv[])
     ImGui::SFML::Update(app_window, deltaClock.restart());
 
     bool force_replan = false;
+    bool layout_changed = false;
     if (ImGui::BeginMainMenuBar())
     {
       if (ImGui::BeginMenu("UI"))
@@ -347,6 +364,10 @@ int main(int argc, char* argv[])
             chosen_map = map_names[i];
         }
 
+        layout_changed |= ImGui::Checkbox("Show all levels", &show_all_levels);
+        if (show_all_levels)
+          layout_changed |= ImGui::Checkbox("Stack levels", &stack_levels);
+
         ImGui::NewLine();
 
         ImGui::Text("WASD/mousedrag to move camera");
@@ -357,7 +378,30 @@ int main(int argc, char* argv[])
       }
       ImGui::EndMainMenuBar();
     }
-    graph_0_drawable.choose_map(chosen_map);
+    if (layout_changed)
+    {
+      fit.reset();
+      if (show_all_levels)
+      {
+        const auto layout = stack_levels ?
+          rmf_planner_viz::draw::LevelLayout::stack(
+            map_names, graph_0_drawable.bounds()) :
+          rmf_planner_viz::draw::LevelLayout::tiles(
+            map_names, graph_0_drawable.bounds());
+
+        graph_0_drawable.choose_maps(layout);
+        schedule_drawable.choose_maps(layout);
+        fit.add_bounds(layout.bounds());
+      }
+      else
+      {
+        schedule_drawable.choose_map(test_map_name);
+        fit.add_bounds(graph_0_drawable.bounds());
+      }
+    }
+
+    if (!show_all_levels)
+      graph_0_drawable.choose_map(chosen_map);
     
     static bool show_node_trajectories = true;
     static std::vector<rmf_planner_viz::draw::Trajectory> trajectories_to_render;
@@ -368,7 +412,8 @@ int main(int argc, char* argv[])
     rmf_planner_viz::draw::do_planner_debug(
       profile, chosen_map,
       planner_0, starts, goal, graph_0.num_waypoints(), planner_debug, progress, plan_start_timing,
-      force_replan, show_node_trajectories, trajectories_to_render);
+      force_replan, database->latest_version(), planner_version,
+      show_node_trajectories, trajectories_to_render, &graph_0_drawable);
     
     ImGui::EndFrame();
 
@@ -383,8 +428,15 @@ int main(int argc, char* argv[])
     app_window.draw(schedule_drawable, states);
     if (show_node_trajectories)
     {
+      // The planner works on the chosen map, so place its trajectories on
+      // that level when all of them are shown
+      sf::RenderStates trajectory_states = states;
+      const auto* layout = graph_0_drawable.layout();
+      if (layout && layout->transform(chosen_map))
+        trajectory_states.transform *= *layout->transform(chosen_map);
+
       for (const auto& trajectory : trajectories_to_render)
-        app_window.draw(trajectory, states);
+        app_window.draw(trajectory, trajectory_states);
     }
 
     sf::Transform ident;
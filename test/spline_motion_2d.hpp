@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__SPLINE_MOTION_2D_HPP
+#define RMF_PLANNER_VIZ__DRAW__SPLINE_MOTION_2D_HPP
+
+#include <array>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Planar counterpart of to_fcl(knots). It follows the same uniform cubic
+// B-spline over (x, y, yaw) as fcl::SplineMotion, but the spline is turned
+// into power basis coefficients once, so each sample is a Horner evaluation
+// plus one sin/cos pair instead of integrate() and a full Transform3d.
+// Sampling does not modify the motion, so one instance can be shared between
+// threads.
+class SplineMotion2D
+{
+public:
+
+  struct Pose
+  {
+    double x;
+    double y;
+    double cos_yaw;
+    double sin_yaw;
+
+    // Move a point from the body frame into the world frame
+    Eigen::Vector2d apply(double px, double py) const
+    {
+      return Eigen::Vector2d(
+        x + cos_yaw * px - sin_yaw * py,
+        y + sin_yaw * px + cos_yaw * py);
+    }
+  };
+
+  SplineMotion2D()
+  {
+    _c.fill(Eigen::Vector3d::Zero());
+  }
+
+  explicit SplineMotion2D(const std::array<Eigen::Vector3d, 4>& knots)
+  {
+    // Expanding the B-spline basis functions in powers of t gives
+    //   p(t) = c0 + c1*t + c2*t^2 + c3*t^3
+    const auto& k = knots;
+    _c[0] = (k[0] + 4.0 * k[1] + k[2]) / 6.0;
+    _c[1] = (k[2] - k[0]) / 2.0;
+    _c[2] = (k[0] - 2.0 * k[1] + k[2]) / 2.0;
+    _c[3] = (-k[0] + 3.0 * k[1] - 3.0 * k[2] + k[3]) / 6.0;
+  }
+
+  // (x, y, yaw) at t. Like fcl::SplineMotion, t is clamped to 1.
+  Eigen::Vector3d position(double t) const
+  {
+    if (t > 1.0)
+      t = 1.0;
+
+    return ((_c[3] * t + _c[2]) * t + _c[1]) * t + _c[0];
+  }
+
+  Pose pose(double t) const
+  {
+    const Eigen::Vector3d p = position(t);
+
+    // Compilers merge these into a single sincos call
+    return Pose{p[0], p[1], std::cos(p[2]), std::sin(p[2])};
+  }
+
+private:
+  std::array<Eigen::Vector3d, 4> _c;
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__SPLINE_MOTION_2D_HPP
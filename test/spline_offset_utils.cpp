@@ -18,123 +18,263 @@
 #include "spline_offset_utils.hpp"
 #include <SFML/Graphics.hpp>
 
+#include <chrono>
+
 #include <rmf_planner_viz/draw/IMDraw.hpp>
 
 namespace rmf_planner_viz {
 namespace draw {
 
+namespace {
 
-Eigen::Matrix4d make_M_inv() 
+// Control points of the uniform cubic B-spline segment that matches the
+// Hermite segment from x0 to x1 with tangents v0 and v1 over [0, 1]. This is
+// the inverse of the B-spline basis matrix applied to the Hermite
+// coefficients, solved once from
+//   p(0) = (P0 + 4 P1 + P2) / 6,  p'(0) = (P2 - P0) / 2
+//   p(1) = (P1 + 4 P2 + P3) / 6,  p'(1) = (P3 - P1) / 2
+// so no matrices are built or inverted per segment. T is double or a vector.
+template<typename T>
+inline void hermite_to_bspline(
+  const T& x0, const T& x1, const T& v0, const T& v1,
+  T& k0, T& k1, T& k2, T& k3)
 {
-  Eigen::Matrix4d M;
-  M.block<1, 4>(0, 0) << 1.0 / 6.0, 2.0 / 3.0, 1.0 / 6.0, 0.0;
-  M.block<1, 4>(1, 0) << -1.0 / 2.0, 0.0, 1.0 / 2.0, 0.0;
-  M.block<1, 4>(2, 0) << 1.0 / 2.0, -1.0, 1.0 / 2.0, 0.0;
-  M.block<1, 4>(3, 0) << -1.0 / 6.0, 1.0 / 2.0, -1.0 / 2.0, 1.0 / 6.0;
-
-  return M.inverse();
+  // Multiplying by thirds keeps divisions out of the batch loops
+  constexpr double third = 1.0 / 3.0;
+  const T a = 2.0 * x1 - x0;
+  const T b = 2.0 * x0 - x1;
+  k0 = a - third * (7.0 * v0 + 2.0 * v1);
+  k1 = b + third * (2.0 * v0 + v1);
+  k2 = a - third * (v0 + 2.0 * v1);
+  k3 = b + third * (2.0 * v0 + 7.0 * v1);
 }
 
-std::array<Eigen::Vector4d, 3> compute_coefficients(const Eigen::Vector3d& x0,
-                                                    const Eigen::Vector3d& x1,
-                                                    const Eigen::Vector3d& v0,
-                                                    const Eigen::Vector3d& v1) 
+// A chunk of Hermite segments in structure of arrays layout. The segments
+// are gathered into a chunk small enough to stay in the L1 cache, then
+// converted together by a loop with no branches or calls that the compiler
+// can vectorize.
+class HermiteChunk
 {
-  std::array<Eigen::Vector4d, 3> coeffs;
-  for (int i = 0; i < 3; ++i) {
-    // *INDENT-OFF*
-    std::size_t si = static_cast<std::size_t>(i);
-    coeffs[si][0] = x0[i];                                       // = d
-    coeffs[si][1] = v0[i];                                       // = c
-    coeffs[si][2] = -v1[i] - 2 * v0[i] + 3 * x1[i] - 3 * x0[i];  // = b
-    coeffs[si][3] = v1[i] + v0[i] - 2 * x1[i] + 2 * x0[i];       // = a
-    // *INDENT-ON*
+public:
+
+  static constexpr std::size_t Capacity = 64;
+
+  void add(
+    const Eigen::Vector3d& x0, const Eigen::Vector3d& x1,
+    const Eigen::Vector3d& v0, const Eigen::Vector3d& v1)
+  {
+    for (std::size_t c = 0; c < 3; ++c)
+    {
+      _x0[c][_size] = x0[c];
+      _x1[c][_size] = x1[c];
+      _v0[c][_size] = v0[c];
+      _v1[c][_size] = v1[c];
+    }
+    ++_size;
   }
 
-  return coeffs;
-}
+  bool full() const { return _size == Capacity; }
 
-std::array<Eigen::Vector3d, 4> compute_knots(
-  Eigen::Vector3d x0,
-  Eigen::Vector3d x1,
-  Eigen::Vector3d v0,
-  Eigen::Vector3d v1)
-{
-//   printf("x0: %f %f %f x1: %f %f %f\n", x0[0], x0[1], x0[2], x1[0], x1[1], x1[2]);
-//   printf("v0: %f %f %f v1: %f %f %f\n", v0[0], v0[1], v0[2], v1[0], v1[1], v1[2]);
-  const std::array<Eigen::Vector4d, 3> subspline_coeffs =
-      compute_coefficients(x0, x1, v0, v1);
+  // Append the control points of every segment in the chunk to out and empty
+  // the chunk
+  void flush(BSplineControlPoints& out)
+  {
+    convert(0, out.x);
+    convert(1, out.y);
+    convert(2, out.yaw);
+    _size = 0;
+  }
 
-  Eigen::Matrix4d M_inv = make_M_inv();
-  std::array<Eigen::Vector3d, 4> result;
-  for (std::size_t i = 0; i < 3; ++i) {
-    const Eigen::Vector4d p = M_inv * subspline_coeffs[i];
-    //printf("p: %f %f %f %f\n", p[0], p[1], p[2], p[3]);
-    for (int j = 0; j < 4; ++j)
-      result[j][i] = p[j];
+private:
+
+  void convert(std::size_t c, std::vector<double>& out) const
+  {
+    const std::size_t offset = out.size();
+    out.resize(offset + 4 * _size);
+
+    const double* x0 = _x0[c].data();
+    const double* x1 = _x1[c].data();
+    const double* v0 = _v0[c].data();
+    const double* v1 = _v1[c].data();
+    double* k = out.data() + offset;
+    for (std::size_t i = 0; i < _size; ++i)
+    {
+      hermite_to_bspline(x0[i], x1[i], v0[i], v1[i],
+        k[4 * i], k[4 * i + 1], k[4 * i + 2], k[4 * i + 3]);
+    }
   }
 
+  using Array = std::array<std::array<double, Capacity>, 3>;
+  Array _x0;
+  Array _x1;
+  Array _v0;
+  Array _v1;
+  std::size_t _size = 0;
+};
+
+} // anonymous namespace
+
+//==============================================================================
+std::array<Eigen::Vector3d, 4> compute_knots(
+  const Eigen::Vector3d& x0,
+  const Eigen::Vector3d& x1,
+  const Eigen::Vector3d& v0,
+  const Eigen::Vector3d& v1)
+{
+  std::array<Eigen::Vector3d, 4> result;
+  hermite_to_bspline(x0, x1, v0, v1,
+    result[0], result[1], result[2], result[3]);
   return result;
 }
 
+//==============================================================================
 fcl::SplineMotion<double> convert_catmullrom_to_bspline(
-  Eigen::Vector3d p0,
-  Eigen::Vector3d p1,
-  Eigen::Vector3d p2,
-  Eigen::Vector3d p3,
+  const Eigen::Vector3d& p0,
+  const Eigen::Vector3d& p1,
+  const Eigen::Vector3d& p2,
+  const Eigen::Vector3d& p3,
   bool show_control_poly)
 {
   // @reference:
   // https://computergraphics.stackexchange.com/questions/8267/conversion-from-cubic-catmull-rom-spline-to-cubic-b-spline
   // the topright and botleft values of the final matrix are wrong, should be negative
-
-  Eigen::Matrix4d mtx_catmullrom;
-  mtx_catmullrom << 
-    -1.0,  3.0, -3.0,  1.0,
-      2.0, -5.0,  4.0, -1.0,
-    -1.0,  0.0,  1.0,  0.0,
-      0.0,  2.0,  0.0,  0.0;
-  mtx_catmullrom *= 0.5;
-
-  Eigen::Matrix4d mtx_bspline;
-  mtx_bspline << 
-    -1.0,  3.0, -3.0,  1.0,
-      3.0, -6.0,  3.0,  0.0,
-    -3.0,  0.0,  3.0,  0.0,
-      1.0,  4.0,  1.0,  0.0;
-  mtx_bspline /= 6.0;
-  Eigen::Matrix4d mtx_bspline_inv = mtx_bspline.inverse();
-
-  Eigen::Matrix<double, 4, 3> input;
-  input << 
-    p0[0], p0[1], p0[2],
-    p1[0], p1[1], p1[2],
-    p2[0], p2[1], p2[2],
-    p3[0], p3[1], p3[2];
-
-  auto result = mtx_bspline_inv * mtx_catmullrom * input; // 4x3 matrix
-  Eigen::Vector3d bspline_p0(result(0, 0), result(0, 1), result(0, 2));
-  Eigen::Vector3d bspline_p1(result(1, 0), result(1, 1), result(1, 2));
-  Eigen::Vector3d bspline_p2(result(2, 0), result(2, 1), result(2, 2));
-  Eigen::Vector3d bspline_p3(result(3, 0), result(3, 1), result(3, 2));
+  //
+  // A Catmull-Rom segment is the Hermite segment from p1 to p2 with tangents
+  // (p2 - p0) / 2 and (p3 - p1) / 2, which gives the same product.
+  const auto knots = compute_knots(p1, p2, 0.5 * (p2 - p0), 0.5 * (p3 - p1));
 
   if (show_control_poly)
-  {
-    IMDraw::draw_circle(sf::Vector2f(bspline_p0.x(), bspline_p0.y()), 0.0625f, sf::Color(128,128,128));
-    IMDraw::draw_circle(sf::Vector2f(bspline_p1.x(), bspline_p1.y()), 0.0625f, sf::Color(128,128,128));
-    IMDraw::draw_circle(sf::Vector2f(bspline_p2.x(), bspline_p2.y()), 0.0625f, sf::Color(128,128,128));
-    IMDraw::draw_circle(sf::Vector2f(bspline_p3.x(), bspline_p3.y()), 0.0625f, sf::Color(128,128,128));
-
-    IMDraw::draw_line(sf::Vector2f(bspline_p0.x(), bspline_p0.y()), sf::Vector2f(bspline_p1.x(), bspline_p1.y()), sf::Color(128,128,128));
-    IMDraw::draw_line(sf::Vector2f(bspline_p1.x(), bspline_p1.y()), sf::Vector2f(bspline_p2.x(), bspline_p2.y()), sf::Color(128,128,128));
-    IMDraw::draw_line(sf::Vector2f(bspline_p2.x(), bspline_p2.y()), sf::Vector2f(bspline_p3.x(), bspline_p3.y()), sf::Color(128,128,128));
-  }
+    draw_control_polygon(knots);
 
   const Eigen::Vector3d zero = Eigen::Vector3d(0,0,0);
   return fcl::SplineMotion<double>(
-    bspline_p0, bspline_p1, bspline_p2, bspline_p3,
+    knots[0], knots[1], knots[2], knots[3],
     zero, zero, zero, zero);
+}
+
+//==============================================================================
+void BSplineControlPoints::reserve(std::size_t segments)
+{
+  x.reserve(4 * segments);
+  y.reserve(4 * segments);
+  yaw.reserve(4 * segments);
+}
+
+//==============================================================================
+void BSplineControlPoints::clear()
+{
+  x.clear();
+  y.clear();
+  yaw.clear();
+  t0.clear();
+  t1.clear();
+}
 
+//==============================================================================
+std::array<Eigen::Vector3d, 4> BSplineControlPoints::knots(
+  std::size_t segment) const
+{
+  std::array<Eigen::Vector3d, 4> result;
+  for (std::size_t k = 0; k < 4; ++k)
+  {
+    const std::size_t i = 4 * segment + k;
+    result[k] = Eigen::Vector3d(x[i], y[i], yaw[i]);
+  }
+
+  return result;
+}
+
+//==============================================================================
+void convert_trajectory_to_bspline(
+  const rmf_traffic::Trajectory& trajectory,
+  BSplineControlPoints& out,
+  const rmf_traffic::Time* reference)
+{
+  if (trajectory.size() < 2)
+    return;
+
+  const rmf_traffic::Time start =
+    reference ? *reference : *trajectory.start_time();
+  const auto seconds = [&](rmf_traffic::Time t)
+    {
+      return std::chrono::duration<double>(t - start).count();
+    };
+
+  out.reserve(out.size() + trajectory.size() - 1);
+  out.t0.reserve(out.t0.size() + trajectory.size() - 1);
+  out.t1.reserve(out.t1.size() + trajectory.size() - 1);
+
+  HermiteChunk chunk;
+  auto it = trajectory.begin();
+  auto prev = it++;
+  double prev_t = seconds(prev->time());
+  for (; it != trajectory.end(); prev = it++)
+  {
+    const double t = seconds(it->time());
+    const double dt = t - prev_t;
+    if (dt > 0.0)
+    {
+      chunk.add(prev->position(), it->position(),
+        prev->velocity() * dt, it->velocity() * dt);
+      out.t0.push_back(prev_t);
+      out.t1.push_back(t);
+
+      if (chunk.full())
+        chunk.flush(out);
+    }
+
+    prev_t = t;
+  }
+
+  chunk.flush(out);
+}
+
+//==============================================================================
+void convert_catmullrom_to_bspline(
+  const std::vector<Eigen::Vector3d>& points,
+  BSplineControlPoints& out)
+{
+  if (points.size() < 4)
+    return;
+
+  const std::size_t n = points.size() - 3;
+  out.reserve(out.size() + n);
+
+  HermiteChunk chunk;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    chunk.add(points[i + 1], points[i + 2],
+      0.5 * (points[i + 2] - points[i]),
+      0.5 * (points[i + 3] - points[i + 1]));
+
+    if (chunk.full())
+      chunk.flush(out);
+  }
+
+  chunk.flush(out);
+}
+
+//==============================================================================
+void draw_control_polygon(
+  const std::array<Eigen::Vector3d, 4>& knots,
+  const sf::Color& color)
+{
+  for (std::size_t k = 0; k < 4; ++k)
+  {
+    const sf::Vector2f p(knots[k].x(), knots[k].y());
+    IMDraw::draw_circle(p, 0.0625f, color);
+    if (k > 0)
+      IMDraw::draw_line(sf::Vector2f(knots[k-1].x(), knots[k-1].y()), p, color);
+  }
+}
+
+//==============================================================================
+void draw_control_polygon(
+  const BSplineControlPoints& control_points,
+  const sf::Color& color)
+{
+  for (std::size_t i = 0; i < control_points.size(); ++i)
+    draw_control_polygon(control_points.knots(i), color);
 }
 
 } // namespace draw
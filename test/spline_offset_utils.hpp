@@ -20,8 +20,13 @@
 #define RMF_PLANNER_VIZ__DRAW__SPLINEOFFSETUTILS_HPP
 
 #include <array>
+#include <vector>
 #include <eigen3/Eigen/Dense>
 
+#include <SFML/Graphics/Color.hpp>
+
+#include <rmf_traffic/Trajectory.hpp>
+
 #include <fcl/narrowphase/continuous_collision.h>
 #include <fcl/geometry/collision_geometry.h>
 #include <fcl/math/motion/spline_motion.h>
@@ -32,17 +37,67 @@ namespace draw {
 // Lifted functions from so they do not affect the public api. Double check that they sync up
 
 std::array<Eigen::Vector3d, 4> compute_knots(
-  Eigen::Vector3d x0,
-  Eigen::Vector3d x1,
-  Eigen::Vector3d v0,
-  Eigen::Vector3d v1);
+  const Eigen::Vector3d& x0,
+  const Eigen::Vector3d& x1,
+  const Eigen::Vector3d& v0,
+  const Eigen::Vector3d& v1);
 
 fcl::SplineMotion<double> convert_catmullrom_to_bspline(
-  Eigen::Vector3d p0,
-  Eigen::Vector3d p1,
-  Eigen::Vector3d p2,
-  Eigen::Vector3d p3,
-  bool show_control_poly);
+  const Eigen::Vector3d& p0,
+  const Eigen::Vector3d& p1,
+  const Eigen::Vector3d& p2,
+  const Eigen::Vector3d& p3,
+  bool show_control_poly = false);
+
+// Control points of a chain of uniform cubic B-spline segments. Control point
+// k of segment i is (x[4*i + k], y[4*i + k], yaw[4*i + k]), so each coordinate
+// is one contiguous array and the batch conversions below are plain loops
+// over arrays that the compiler can vectorize.
+struct BSplineControlPoints
+{
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> yaw;
+
+  // Start and finish of each segment. Only filled in by
+  // convert_trajectory_to_bspline, in seconds after its reference time.
+  std::vector<double> t0;
+  std::vector<double> t1;
+
+  void reserve(std::size_t segments);
+
+  void clear();
+
+  std::size_t size() const { return x.size() / 4; }
+
+  std::array<Eigen::Vector3d, 4> knots(std::size_t segment) const;
+};
+
+// Convert every segment of a trajectory in one pass and append them to out.
+// Each segment gives the same knots as compute_knots with the waypoint
+// velocities scaled by the duration of the segment. Segments that do not move
+// forward in time are skipped. Segment times are measured from reference, or
+// from the start of the trajectory when no reference is given.
+void convert_trajectory_to_bspline(
+  const rmf_traffic::Trajectory& trajectory,
+  BSplineControlPoints& out,
+  const rmf_traffic::Time* reference = nullptr);
+
+// Convert the Catmull-Rom spline through points and append it to out. Every
+// window of four consecutive points gives one segment between its two middle
+// points, so n points give n - 3 segments.
+void convert_catmullrom_to_bspline(
+  const std::vector<Eigen::Vector3d>& points,
+  BSplineControlPoints& out);
+
+// Debug drawing of the control polygons
+void draw_control_polygon(
+  const std::array<Eigen::Vector3d, 4>& knots,
+  const sf::Color& color = sf::Color(128, 128, 128));
+
+void draw_control_polygon(
+  const BSplineControlPoints& control_points,
+  const sf::Color& color = sf::Color(128, 128, 128));
 
 } // namespace draw
 } // namespace rmf_planner_viz
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__SPSC_RING_HPP
+#define RMF_PLANNER_VIZ__DRAW__SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Lock free ring buffer for one producer thread and one consumer thread.
+// The producer never waits: push() drops the value when the ring is full.
+//
+// Several threads may take turns as the producer, as long as each one is
+// done before the next one starts, for example by joining it.
+template<typename T>
+class SpscRing
+{
+public:
+
+  // capacity is rounded up to a power of two
+  explicit SpscRing(std::size_t capacity)
+  {
+    std::size_t size = 1;
+    while (size < capacity)
+      size *= 2;
+
+    _slots.resize(size);
+    _mask = size - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  std::size_t capacity() const
+  {
+    return _slots.size();
+  }
+
+  // Producer only. False if the ring is full.
+  bool push(const T& value)
+  {
+    const std::size_t head = _head.load(std::memory_order_relaxed);
+    const std::size_t tail = _tail.load(std::memory_order_acquire);
+    if (head - tail == _slots.size())
+      return false;
+
+    _slots[head & _mask] = value;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Call f(value) for every value pushed so far, oldest first,
+  // and return how many there were.
+  template<typename F>
+  std::size_t drain(F f)
+  {
+    const std::size_t tail = _tail.load(std::memory_order_relaxed);
+    const std::size_t head = _head.load(std::memory_order_acquire);
+    for (std::size_t i = tail; i != head; ++i)
+      f(_slots[i & _mask]);
+
+    _tail.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+private:
+  std::vector<T> _slots;
+  std::size_t _mask;
+
+  // Kept on separate cache lines so the two threads do not fight over them
+  alignas(64) std::atomic<std::size_t> _head{0};
+  alignas(64) std::atomic<std::size_t> _tail{0};
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__SPSC_RING_HPP
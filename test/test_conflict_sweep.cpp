@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <SFML/Graphics.hpp>
+#include <imgui.h>
+
+#include <rmf_planner_viz/draw/Fit.hpp>
+#include <rmf_planner_viz/draw/IMDraw.hpp>
+#include <rmf_planner_viz/draw/Schedule.hpp>
+
+#include <rmf_traffic/geometry/Circle.hpp>
+#include <rmf_traffic/schedule/Database.hpp>
+#include <rmf_traffic/schedule/Participant.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "imgui-SFML.h"
+#include "conflict_sweep.hpp"
+
+using namespace rmf_planner_viz::draw;
+
+namespace {
+
+const std::string MapName = "L1";
+
+// Size of the synthetic site, in grid cells
+const int GridCells = 40;
+const double GridSpacing = 3.0;
+
+// Fill the database with robots that wander along the grid lines of a square
+// site, stopping to turn at every grid point
+std::vector<rmf_traffic::schedule::Participant> make_site(
+  std::size_t robots,
+  unsigned int seed,
+  const std::shared_ptr<rmf_traffic::schedule::Database>& database,
+  rmf_traffic::Time start_time)
+{
+  const rmf_traffic::Profile profile{
+    rmf_traffic::geometry::make_final_convex<
+      rmf_traffic::geometry::Circle>(0.5)
+  };
+
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> cell(0, GridCells);
+  std::uniform_int_distribution<int> direction(0, 3);
+  std::uniform_real_distribution<double> delay(0.0, 20.0);
+
+  const int dx[4] = {1, 0, -1, 0};
+  const int dy[4] = {0, 1, 0, -1};
+  const double turn_duration = 1.0;
+  const double move_duration = GridSpacing;
+  const std::size_t legs = 20;
+
+  const auto at = [&](double seconds)
+    {
+      return start_time + std::chrono::duration_cast<rmf_traffic::Duration>(
+        std::chrono::duration<double>(seconds));
+    };
+
+  std::vector<rmf_traffic::schedule::Participant> participants;
+  participants.reserve(robots);
+  for (std::size_t r = 0; r < robots; ++r)
+  {
+    participants.push_back(
+      rmf_traffic::schedule::make_participant(
+        rmf_traffic::schedule::ParticipantDescription{
+          "robot_" + std::to_string(r),
+          "conflict_sweep",
+          rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
+          profile
+        },
+        database));
+
+    int x = cell(rng);
+    int y = cell(rng);
+    double yaw = 0.0;
+    double t = delay(rng);
+
+    const Eigen::Vector3d zero(0, 0, 0);
+    rmf_traffic::Trajectory trajectory;
+    trajectory.insert(
+      at(t), Eigen::Vector3d(x * GridSpacing, y * GridSpacing, yaw), zero);
+
+    for (std::size_t leg = 0; leg < legs; ++leg)
+    {
+      int d = direction(rng);
+      int nx = x + dx[d];
+      int ny = y + dy[d];
+      if (nx < 0 || nx > GridCells || ny < 0 || ny > GridCells)
+      {
+        d = (d + 2) % 4;
+        nx = x + dx[d];
+        ny = y + dy[d];
+      }
+
+      const double heading = d * EIGEN_PI / 2.0;
+      if (std::abs(heading - yaw) > 1e-6)
+      {
+        t += turn_duration;
+        yaw = heading;
+        trajectory.insert(
+          at(t), Eigen::Vector3d(x * GridSpacing, y * GridSpacing, yaw), zero);
+      }
+
+      t += move_duration;
+      x = nx;
+      y = ny;
+      trajectory.insert(
+        at(t), Eigen::Vector3d(x * GridSpacing, y * GridSpacing, yaw), zero);
+    }
+
+    participants.back().set({rmf_traffic::Route(MapName, trajectory)});
+  }
+
+  return participants;
+}
+
+std::size_t count_unresolved(const std::vector<SweepConflict>& conflicts)
+{
+  return static_cast<std::size_t>(std::count_if(
+      conflicts.begin(), conflicts.end(),
+      [](const SweepConflict& c) { return c.unresolved; }));
+}
+
+void print_stats(
+  const ConflictSweepStats& stats,
+  const std::vector<SweepConflict>& conflicts,
+  std::size_t threads)
+{
+  const std::size_t unresolved = count_unresolved(conflicts);
+  std::cout << "routes: " << stats.routes
+            << ", segments: " << stats.segments
+            << ", candidate pairs: " << stats.candidate_pairs
+            << ", conflicts: " << conflicts.size() - unresolved
+            << ", unresolved: " << unresolved
+            << ", checks out of budget: " << stats.ccd_budget_stops << "\n"
+            << "build " << stats.build_ms << " ms, broad phase "
+            << stats.broad_phase_ms << " ms, narrow phase "
+            << stats.narrow_phase_ms << " ms on " << threads << " threads, "
+            << "total "
+            << stats.build_ms + stats.broad_phase_ms + stats.narrow_phase_ms
+            << " ms" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  std::size_t robots = 500;
+  bool headless = false;
+  ConflictSweepOptions options;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--headless")
+      headless = true;
+    else if (arg == "--tree")
+      options.use_aabb_tree = true;
+    else
+      robots = std::stoul(arg);
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  auto database = std::make_shared<rmf_traffic::schedule::Database>();
+  const auto participants = make_site(robots, 42, database, start_time);
+
+  ThreadPool pool;
+  ConflictSweepStats stats;
+  auto conflicts = sweep_conflicts(*database, pool, options, &stats);
+  print_stats(stats, conflicts, pool.size());
+
+  if (headless)
+    return 0;
+
+  sf::Font font;
+  if (!font.loadFromFile("./build/rmf_planner_viz/fonts/OpenSans-Bold.ttf"))
+  {
+    std::cout << "Failed to load font. Make sure you run the executable from the colcon directory" << std::endl;
+    return -1;
+  }
+
+  Schedule schedule_drawable(database, 0.25, MapName, start_time);
+
+  const float site_size = static_cast<float>(GridCells * GridSpacing);
+  Fit fit({Fit::Bounds({-1.0f, -1.0f}, {site_size + 1.0f, site_size + 1.0f})});
+
+  sf::RenderWindow app_window(
+        sf::VideoMode(1250, 1028),
+        "Conflict Sweep",
+        sf::Style::Default);
+
+  app_window.resetGLStates();
+  app_window.setFramerateLimit(60);
+
+  ImGui::SFML::Init(app_window);
+
+  float view_time = 0.0f;
+  int selected = -1;
+
+  sf::Clock deltaClock;
+  while (app_window.isOpen())
+  {
+    sf::Event event;
+    while (app_window.pollEvent(event))
+    {
+      ImGui::SFML::ProcessEvent(event);
+
+      if (event.type == sf::Event::Closed)
+        return 0;
+
+      if (event.type == sf::Event::Resized)
+      {
+        sf::FloatRect visibleArea(0, 0, event.size.width, event.size.height);
+        app_window.setView(sf::View(visibleArea));
+      }
+    }
+
+    ImGui::SFML::Update(app_window, deltaClock.restart());
+
+    ImGui::Begin("Conflict sweep", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Text("Robots: %zu", participants.size());
+    ImGui::Text("Segments: %zu, candidate pairs: %zu",
+      stats.segments, stats.candidate_pairs);
+    ImGui::Text("Checks out of budget: %zu", stats.ccd_budget_stops);
+    ImGui::Text("Build %.2f ms, broad phase %.2f ms, narrow phase %.2f ms",
+      stats.build_ms, stats.broad_phase_ms, stats.narrow_phase_ms);
+    ImGui::Text("Threads: %zu", pool.size());
+    ImGui::Checkbox("AABB tree broad phase", &options.use_aabb_tree);
+
+    if (ImGui::Button("Sweep again"))
+    {
+      conflicts = sweep_conflicts(*database, pool, options, &stats);
+      selected = -1;
+    }
+
+    ImGui::SliderFloat("Time (s)", &view_time, 0.0f, 120.0f);
+    schedule_drawable.timespan(
+      start_time + std::chrono::duration_cast<rmf_traffic::Duration>(
+        std::chrono::duration<double>(view_time)));
+
+    ImGui::Separator();
+    const std::size_t unresolved = count_unresolved(conflicts);
+    ImGui::Text("Conflicts: %zu, unresolved: %zu",
+      conflicts.size() - unresolved, unresolved);
+    ImGui::BeginChild("conflicts", ImVec2(400, 300));
+    for (std::size_t i = 0; i < conflicts.size(); ++i)
+    {
+      const auto& c = conflicts[i];
+      const double t =
+        std::chrono::duration<double>(c.time - start_time).count();
+      const std::string label =
+        std::to_string(c.participant_a) + " x " +
+        std::to_string(c.participant_b) + " at " + std::to_string(t) + " s"
+        + (c.unresolved ? " (unresolved)" : "");
+      if (ImGui::Selectable(label.c_str(), selected == static_cast<int>(i)))
+      {
+        selected = static_cast<int>(i);
+        view_time = static_cast<float>(t);
+      }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+
+    ImGui::EndFrame();
+
+    /*** drawing ***/
+    app_window.clear();
+
+    sf::RenderStates states;
+    fit.apply_transform(states.transform, app_window.getSize());
+    app_window.draw(schedule_drawable, states);
+
+    draw_conflicts(conflicts, MapName);
+    if (selected >= 0)
+      draw_conflicts(
+        {conflicts[selected]}, MapName, sf::Color::Yellow, sf::Color::Yellow);
+    IMDraw::flush_and_render(app_window, states.transform);
+
+    ImGui::SFML::Render(app_window);
+    app_window.display();
+  }
+
+  return 0;
+}
@@ -37,8 +37,13 @@
 #include <fcl/geometry/geometric_shape_to_BVH_model.h>
 
 #include "imgui-SFML.h"
+#include "dynamic_aabb_tree.hpp"
 #include "test_sidecar_utils.hpp"
 
+#include <array>
+#include <limits>
+#include <random>
+
 void draw_fcl_motion(fcl::MotionBase<double>* motion, const sf::Color& color = sf::Color(255, 255, 255, 255))
 {
   const uint steps = 100;
@@ -95,6 +100,181 @@ void draw_robot_on_spline(fcl::MotionBase<double>* motion, double interp,
   }
 }
 
+// Robots that drive around circles of their own, kept in a DynamicAabbTree
+// that is refit every frame. This does not go through fcl at all.
+class TreeDemo
+{
+public:
+
+  struct Circle
+  {
+    Eigen::Vector2d offset;
+    double radius;
+  };
+
+  struct Robot
+  {
+    Eigen::Vector2d center;
+    double orbit;
+    double angular_speed;
+    double phase;
+
+    Eigen::Vector2d position = Eigen::Vector2d::Zero();
+    double yaw = 0.0;
+    int proxy = rmf_planner_viz::draw::DynamicAabbTree::Null;
+    bool contact = false;
+  };
+
+  void reset(std::size_t count, double margin, unsigned int seed = 7)
+  {
+    _tree = rmf_planner_viz::draw::DynamicAabbTree(margin);
+    _robots.clear();
+    _time = 0.0;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> place(-8.0, 8.0);
+    std::uniform_real_distribution<double> orbit(0.5, 3.0);
+    std::uniform_real_distribution<double> speed(0.2, 1.0);
+    std::uniform_real_distribution<double> phase(0.0, 2.0 * EIGEN_PI);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      Robot robot;
+      robot.center = Eigen::Vector2d(place(rng), place(rng));
+      robot.orbit = orbit(rng);
+      robot.angular_speed = (i % 2 ? 1.0 : -1.0) * speed(rng);
+      robot.phase = phase(rng);
+      pose_at(robot, 0.0);
+      robot.proxy = _tree.insert(footprint_box(robot), i);
+      _robots.push_back(robot);
+    }
+  }
+
+  void step(double dt)
+  {
+    _time += dt;
+    reinserts = 0;
+    for (auto& robot : _robots)
+    {
+      const Eigen::Vector2d previous = robot.position;
+      pose_at(robot, _time);
+      if (_tree.update(robot.proxy, footprint_box(robot),
+        robot.position - previous))
+        ++reinserts;
+    }
+
+    candidate_pairs = 0;
+    contacts = 0;
+    for (auto& robot : _robots)
+      robot.contact = false;
+
+    _tree.for_each_overlapping_pair([this](int a, int b)
+      {
+        ++candidate_pairs;
+        Robot& ra = _robots[_tree.user_data(a)];
+        Robot& rb = _robots[_tree.user_data(b)];
+        if (touching(ra, rb))
+        {
+          ra.contact = rb.contact = true;
+          ++contacts;
+        }
+      });
+  }
+
+  void draw(bool draw_tree) const
+  {
+    using namespace rmf_planner_viz::draw;
+
+    if (draw_tree)
+    {
+      _tree.for_each_node([](const Aabb& box, int height, bool leaf)
+        {
+          const sf::Uint8 shade = leaf ? 160 : static_cast<sf::Uint8>(
+            std::max(40, 120 - 10 * height));
+          IMDraw::draw_aabb(
+            sf::Vector2f(box.min.x(), box.min.y()),
+            sf::Vector2f(box.max.x(), box.max.y()),
+            leaf ? sf::Color(shade, shade, 0) : sf::Color(0, shade, shade));
+        });
+    }
+
+    for (const auto& robot : _robots)
+    {
+      const sf::Color color = robot.contact ? sf::Color::Red : sf::Color::White;
+      for (const auto& circle : Footprint)
+      {
+        const Eigen::Vector2d p = world(robot, circle.offset);
+        IMDraw::draw_circle(sf::Vector2f(p.x(), p.y()), circle.radius, color);
+      }
+    }
+  }
+
+  const rmf_planner_viz::draw::DynamicAabbTree& tree() const
+  {
+    return _tree;
+  }
+
+  std::size_t reinserts = 0;
+  std::size_t candidate_pairs = 0;
+  std::size_t contacts = 0;
+
+private:
+
+  static const std::array<Circle, 2> Footprint;
+
+  static void pose_at(Robot& robot, double t)
+  {
+    const double angle = robot.phase + robot.angular_speed * t;
+    robot.position = robot.center
+      + robot.orbit * Eigen::Vector2d(std::cos(angle), std::sin(angle));
+    robot.yaw = angle + (robot.angular_speed > 0.0 ? 0.5 : -0.5) * EIGEN_PI;
+  }
+
+  static Eigen::Vector2d world(const Robot& robot, const Eigen::Vector2d& p)
+  {
+    return robot.position + Eigen::Rotation2Dd(robot.yaw) * p;
+  }
+
+  static rmf_planner_viz::draw::Aabb footprint_box(const Robot& robot)
+  {
+    rmf_planner_viz::draw::Aabb box{
+      Eigen::Vector2d::Constant(std::numeric_limits<double>::max()),
+      Eigen::Vector2d::Constant(std::numeric_limits<double>::lowest())};
+
+    for (const auto& circle : Footprint)
+    {
+      const Eigen::Vector2d p = world(robot, circle.offset);
+      const Eigen::Vector2d r = Eigen::Vector2d::Constant(circle.radius);
+      box = box.merged(rmf_planner_viz::draw::Aabb{p - r, p + r});
+    }
+    return box;
+  }
+
+  static bool touching(const Robot& a, const Robot& b)
+  {
+    for (const auto& ca : Footprint)
+    {
+      for (const auto& cb : Footprint)
+      {
+        const double d =
+          (world(a, ca.offset) - world(b, cb.offset)).norm();
+        if (d <= ca.radius + cb.radius)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  rmf_planner_viz::draw::DynamicAabbTree _tree;
+  std::vector<Robot> _robots;
+  double _time = 0.0;
+};
+
+const std::array<TreeDemo::Circle, 2> TreeDemo::Footprint = {
+  TreeDemo::Circle{Eigen::Vector2d(0.0, 0.0), 0.3},
+  TreeDemo::Circle{Eigen::Vector2d(0.35, 0.0), 0.2}
+};
+
 int main()
 {
   // square window to avoid stretching
@@ -208,6 +388,11 @@ int main()
   fcl::Transform3<double> identity;
   identity.setIdentity();
 
+  TreeDemo tree_demo;
+  int tree_demo_robots = 40;
+  float tree_demo_margin = 0.1f;
+  tree_demo.reset(tree_demo_robots, tree_demo_margin);
+
   sf::Clock deltaClock;
   while (app_window.isOpen())
   {
@@ -226,7 +411,8 @@ int main()
       }
     }
 
-    ImGui::SFML::Update(app_window, deltaClock.restart());
+    const sf::Time frame_time = deltaClock.restart();
+    ImGui::SFML::Update(app_window, frame_time);
     
     ImGui::SetWindowSize(ImVec2(800, 200));
     ImGui::Begin("Sidecar control", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
@@ -324,6 +510,40 @@ int main()
     ImGui::Checkbox("draw axis", &draw_axis);
 
     ImGui::End();
+
+    ImGui::Begin("Dynamic AABB tree", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+    {
+      static bool run_tree_demo = true;
+      static bool paused = false;
+      static bool draw_tree = true;
+      ImGui::Checkbox("Enabled", &run_tree_demo);
+      ImGui::Checkbox("Paused", &paused);
+      ImGui::Checkbox("Draw tree", &draw_tree);
+
+      bool reset = ImGui::SliderInt("Robots", &tree_demo_robots, 1, 500);
+      reset |= ImGui::SliderFloat("Margin", &tree_demo_margin, 0.0f, 1.0f);
+      reset |= ImGui::Button("Reset");
+      if (reset)
+        tree_demo.reset(tree_demo_robots, tree_demo_margin);
+
+      if (run_tree_demo)
+      {
+        if (!paused)
+          tree_demo.step(frame_time.asSeconds());
+
+        const auto& tree = tree_demo.tree();
+        ImGui::Text("Proxies: %zu, height: %d, area ratio: %.2f",
+          tree.size(), tree.height(), tree.area_ratio());
+        ImGui::Text("Reinserted this frame: %zu", tree_demo.reinserts);
+        ImGui::Text("Candidate pairs: %zu, contacts: %zu",
+          tree_demo.candidate_pairs, tree_demo.contacts);
+        ImGui::Text("Valid: %s", tree.validate() ? "yes" : "no");
+
+        tree_demo.draw(draw_tree);
+      }
+    }
+    ImGui::End();
+
     ImGui::EndFrame();
 
     if (draw_axis)
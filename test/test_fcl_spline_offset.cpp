@@ -34,34 +34,7 @@
 
 #include "imgui-SFML.h"
 #include "spline_offset_utils.hpp"
-
-void draw_fcl_splinemotion(const fcl::SplineMotion<double>& motion, const sf::Color& color = sf::Color(255, 255, 255, 255))
-{
-  const uint steps = 100;
-  double interp_per_step = 1.0f / (double)steps;
-  fcl::Transform3d tf, tf2;
-
-  for (uint i=0; i<steps; ++i)
-  {
-    double interp = interp_per_step * (double)i;
-    double interp_next = interp_per_step * (double)(i + 1);
-    
-    motion.integrate(interp);
-    motion.getCurrentTransform(tf);
-
-    tf.linear();
-    auto translate1 = tf.translation();    
-    motion.integrate(interp_next);
-
-    motion.getCurrentTransform(tf2);
-    auto translate2 = tf2.translation();
-    
-    using namespace rmf_planner_viz::draw;
-
-    IMDraw::draw_line(sf::Vector2f(translate1.x(), translate1.y()), sf::Vector2f(translate2.x(), translate2.y()), color);
-  }
-  motion.integrate(0.0); //reset
-}
+#include "offset_trajectory.hpp"
 
 void draw_robot_on_spline(const fcl::SplineMotion<double>& motion, double interp, double radius, const sf::Color& color = sf::Color(255, 255, 255, 255))
 {
@@ -79,84 +52,6 @@ void draw_robot_on_spline(const fcl::SplineMotion<double>& motion, double interp
   rmf_planner_viz::draw::IMDraw::draw_arrow(sf::Vector2f(pt.x(), pt.y()), sf::Vector2f(pt_end.x(), pt_end.y()), color);
 }
 
-void draw_sidecar_motion(const fcl::SplineMotion<double>& original_motion,
-  const fcl::Transform3d& tx_offset, const sf::Color& color = sf::Color(255, 255, 255, 255))
-{
-  const uint steps = 100;
-  double interp_per_step = 1.0f / (double)steps;
-  fcl::Transform3d tf, tf2;
-
-  for (uint i=0; i<steps; ++i)
-  {
-    double interp = interp_per_step * (double)i;
-    double interp_next = interp_per_step * (double)(i + 1);
-    
-    original_motion.integrate(interp);
-    original_motion.getCurrentTransform(tf);
-
-    auto tf_offset = tf * tx_offset;
-    auto translate1 = tf_offset.translation();
-
-    original_motion.integrate(interp_next);
-    original_motion.getCurrentTransform(tf2);
-
-    auto tf2_offset = tf2 * tx_offset;
-    auto translate2 = tf2_offset.translation();
-    
-    using namespace rmf_planner_viz::draw;
-
-    IMDraw::draw_line(sf::Vector2f(translate1.x(), translate1.y()), sf::Vector2f(translate2.x(), translate2.y()), color);
-  }
-  original_motion.integrate(0.0); //reset
-}
-
-void draw_catmull_rom(
-  Eigen::Vector3d p0,
-  Eigen::Vector3d p1,
-  Eigen::Vector3d p2,
-  Eigen::Vector3d p3,
-  const sf::Color& color = sf::Color(255, 255, 255, 255))
-{
-  const uint steps = 100;
-  double t_per_step = 1.0f / (double)steps;
-  
-  for (uint i=0; i<steps; ++i)
-  {
-    auto point_on_catmullrom_spline = [&](double t)
-    {
-      double t_sq = t * t;
-      double t_cube = t * t * t;
-
-      Eigen::Vector3d p = (2.0 * p1) + (-p0 + p2) * t + 
-        (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t_sq +
-        (-p0 + 3.0 * p1 - 3.0 * p2 + p3) * t_cube;
-      p = 0.5 * p;
-      return p;
-    };
-    double t = t_per_step * (double)i;
-    auto start = point_on_catmullrom_spline(t);
-
-    double t_next = t_per_step * (double)(i + 1);
-    auto end = point_on_catmullrom_spline(t_next);
-
-    using namespace rmf_planner_viz::draw;
-
-    IMDraw::draw_line(sf::Vector2f(start.x(), start.y()), sf::Vector2f(end.x(), end.y()), color);
-  }
-}
-
-void draw_offset_sidecar_on_spline(const fcl::SplineMotion<double>& motion, double interp, double radius,
-  const fcl::Transform3d& tx_offset, const sf::Color& color = sf::Color(255, 255, 255, 255))
-{
-  motion.integrate(interp);
-  fcl::Transform3d tf;
-  motion.getCurrentTransform(tf);
-
-  auto sidecar_tx = tf * tx_offset;
-  auto sidecar_pt = sidecar_tx.translation();
-  rmf_planner_viz::draw::IMDraw::draw_circle(sf::Vector2f(sidecar_pt.x(), sidecar_pt.y()), radius, color);
-}
-
 int main()
 {
   // square window to avoid stretching
@@ -243,6 +138,7 @@ int main()
       // ImGui::Text("knots_b[2]: %f %f %f", knots_b[2][0], knots_b[2][1], knots_b[2][2]);
       // ImGui::Text("knots_b[3]: %f %f %f", knots_b[3][0], knots_b[3][1], knots_b[3][2]);
       std::shared_ptr<fcl::SplineMotion<double>> motion_a, motion_b;
+      std::array<Eigen::Vector3d, 4> knots_a, knots_b;
       static int current_preset = 0;
       if (ImGui::Button("Preset #0"))
         current_preset = 0;
@@ -257,11 +153,11 @@ int main()
 
       if (current_preset == 0)
       {
-        auto knots_a =
+        knots_a =
           rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0),
                         Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
-        auto knots_b =
+        knots_b =
             rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(-2, 0, 0), Eigen::Vector3d(-2, 0, EIGEN_PI / 2.0),
                           Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
@@ -270,11 +166,11 @@ int main()
       }
       else if (current_preset == 1)
       {
-        auto knots_a =
+        knots_a =
           rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0),
                         Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
-        auto knots_b =
+        knots_b =
             rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(-5 - 0.15, 0, 0), Eigen::Vector3d(-2 + 0.15, 0, EIGEN_PI / 2.0),
                           Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
@@ -283,11 +179,11 @@ int main()
       }
       else if (current_preset == 2)
       {
-        auto knots_a =
+        knots_a =
           rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0),
                         Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
-        auto knots_b =
+        knots_b =
             rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(-5 - 0.15, 0, 0), Eigen::Vector3d(-2 + 0.15, 0, 3.0 * EIGEN_PI / 2.0),
                           Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
@@ -296,11 +192,11 @@ int main()
       }
       else if (current_preset == 3)
       {
-        auto knots_a =
+        knots_a =
           rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0),
                         Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
 
-        auto knots_b =
+        knots_b =
             rmf_planner_viz::draw::compute_knots(Eigen::Vector3d(-5 - 0.15, 0, 0), Eigen::Vector3d(-2 + 0.15, 0, EIGEN_PI / 2.0),
                           Eigen::Vector3d(0, 16, 0), Eigen::Vector3d(0, -16, 0));
 
@@ -308,12 +204,28 @@ int main()
         motion_b = std::make_shared<fcl::SplineMotion<double>>(to_fcl(knots_b));
       }
       
+      // The paths only change with the preset, so they are sampled once
+      // instead of every frame
+      static int sampled_preset = -1;
+      static OffsetTrajectory path_a, path_b, sidecar_path;
+      static std::array<OffsetTrajectory, 3> approx_paths;
+      const bool preset_changed = sampled_preset != current_preset;
+      if (preset_changed)
+      {
+        fcl::Transform3d identity;
+        identity.setIdentity();
+        path_a = OffsetTrajectory(knots_a, identity);
+        path_b = OffsetTrajectory(knots_b, identity);
+        sidecar_path = OffsetTrajectory(knots_b, shape_b2_offset);
+        sampled_preset = current_preset;
+      }
+
       // Collision using the original spline and apply offset transform to each iteration
       // of the gjk algorithm. (FAILING)
       {
         // draw motions of both splines
-        draw_fcl_splinemotion(*motion_a, sf::Color::Red);
-        draw_fcl_splinemotion(*motion_b, dark_green_color);
+        path_a.draw(sf::Color::Red);
+        path_b.draw(dark_green_color);
 
         // draw robot circle on motion
         static float interp = 0.0f;
@@ -322,7 +234,7 @@ int main()
         draw_robot_on_spline(*motion_a, interp, circle_shape->get_characteristic_length(), sf::Color::Red);
         draw_robot_on_spline(*motion_b, interp, circle_shape->get_characteristic_length(), dark_green_color);
         
-        draw_offset_sidecar_on_spline(*motion_b, interp, circle_shape_ex->get_characteristic_length(), shape_b2_offset, sf::Color::Green);
+        sidecar_path.draw_at(interp, circle_shape_ex->get_characteristic_length(), sf::Color::Green);
       }
       
       // approximated b-spline via sampling points on motion, making a catmull rom and converting to bspline knots
@@ -330,20 +242,12 @@ int main()
         const int steps = 3;
         const int point_count = steps + 1;
         fcl::Vector3d points[point_count];
-        float interp = 0.0f;
 
-        //draw points and multiply in shape_b2_offset
+        //draw points of the sidecar path
         for (uint i=0; i<=steps; ++i)
         {
-          interp = (float)i * (1.0f / (float)steps);
-          motion_b->integrate(interp);
-          fcl::Transform3d tf;
-          motion_b->getCurrentTransform(tf);
-
-          // apply offset
-          auto sidecar_tx = tf * shape_b2_offset;
-          auto sidecar_pt = sidecar_tx.translation();
-          points[i] = sidecar_pt;
+          const auto sidecar_pt = sidecar_path.position((double)i / (double)steps);
+          points[i] = fcl::Vector3d(sidecar_pt.x(), sidecar_pt.y(), 0.0);
 
           IMDraw::draw_circle(sf::Vector2f(sidecar_pt.x(), sidecar_pt.y()), 0.0625f, sf::Color::White);
         }
@@ -351,24 +255,75 @@ int main()
         static bool show_sidecar_motion = true;
         ImGui::Checkbox("Show sampled sidecar motion", &show_sidecar_motion);
         if (show_sidecar_motion)
-          draw_sidecar_motion(*motion_b, shape_b2_offset, sf::Color::Green);
+          sidecar_path.draw(sf::Color::Green);
+
+        auto point_on_catmullrom_spline = [](
+          Eigen::Vector3d p0,
+          Eigen::Vector3d p1,
+          Eigen::Vector3d p2,
+          Eigen::Vector3d p3,
+          double t)
+        {
+          double t_sq = t * t;
+          double t_cube = t * t * t;
 
+          Eigen::Vector3d p = (2.0 * p1) + (-p0 + p2) * t + 
+            (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t_sq +
+            (-p0 + 3.0 * p1 - 3.0 * p2 + p3) * t_cube;
+          p = 0.5 * p;
+          return p;
+        };
+
+        // Make spline segments for the first and last portions too, by
+        // extending the sampled points a little past both ends, and convert
+        // all three segments in one batch
+        const auto first_pt = point_on_catmullrom_spline(points[0], points[1], points[2], points[3], -0.1);
+        const auto last_pt = point_on_catmullrom_spline(points[0], points[1], points[2], points[3], 1.1);
+
+        rmf_planner_viz::draw::BSplineControlPoints sidecar_bspline;
+        convert_catmullrom_to_bspline(
+          {first_pt, points[0], points[1], points[2], points[3], last_pt},
+          sidecar_bspline);
+
+        auto make_motion = [&](std::size_t segment)
+        {
+          const auto knots = sidecar_bspline.knots(segment);
+          const Eigen::Vector3d zero = Eigen::Vector3d(0,0,0);
+          return std::make_shared<fcl::SplineMotion<double>>(
+            knots[0], knots[1], knots[2], knots[3],
+            zero, zero, zero, zero);
+        };
+
+        auto motion_b2_first = make_motion(0);
+        auto motion_b2_approx_middle = make_motion(1);
+        auto motion_b2_last = make_motion(2);
+
+        if (preset_changed)
+        {
+          fcl::Transform3d identity;
+          identity.setIdentity();
+          for (std::size_t i = 0; i < approx_paths.size(); ++i)
+            approx_paths[i] = OffsetTrajectory(sidecar_bspline.knots(i), identity);
+        }
+
+        // The middle segment is the catmull rom through the sampled points
         static bool show_approximated_sidecar_motion = true;
         ImGui::Checkbox("Show sampled sidecar catmull rom", &show_approximated_sidecar_motion);
         if (show_approximated_sidecar_motion)
-          draw_catmull_rom(points[0], points[1], points[2], points[3], sf::Color(128,128,128));
-
-        static bool show_control_poly = false;
-
-        auto motion_b2_approx_middle = std::make_shared<fcl::SplineMotion<double>>(
-          convert_catmullrom_to_bspline(points[0], points[1], points[2], points[3], show_control_poly));
+          approx_paths[1].draw(sf::Color(128,128,128));
 
         static bool show_fcl_sidecar_motion = true;
         ImGui::Checkbox("Show computed fcl sidecar motion", &show_fcl_sidecar_motion);
         if (show_fcl_sidecar_motion)
-          draw_fcl_splinemotion(*motion_b2_approx_middle, sf::Color::White);
+        {
+          for (const auto& path : approx_paths)
+            path.draw(sf::Color::White);
+        }
 
+        static bool show_control_poly = false;
         ImGui::Checkbox("Show control polygon", &show_control_poly);
+        if (show_control_poly)
+          draw_control_polygon(sidecar_bspline.knots(1));
 
         ImGui::Separator();
         
@@ -412,40 +367,6 @@ int main()
           v = 0.5 * v;
           return v;
         };
-        auto point_on_catmullrom_spline = [](
-          Eigen::Vector3d p0,
-          Eigen::Vector3d p1,
-          Eigen::Vector3d p2,
-          Eigen::Vector3d p3,
-          double t)
-        {
-          double t_sq = t * t;
-          double t_cube = t * t * t;
-
-          Eigen::Vector3d p = (2.0 * p1) + (-p0 + p2) * t + 
-            (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t_sq +
-            (-p0 + 3.0 * p1 - 3.0 * p2 + p3) * t_cube;
-          p = 0.5 * p;
-          return p;
-        };
-        
-        // make spline segments for first and last portions, use them for collision
-
-        //auto v_first = compute_derivative_on_catmullrom_spline(points[0], points[1], points[2], points[3], -0.01);
-        //auto first_pt = points[0] + multiplier * v_first;
-        auto first_pt = point_on_catmullrom_spline(points[0], points[1], points[2], points[3], -0.1);
-        auto motion_b2_first = std::make_shared<fcl::SplineMotion<double>>(
-          convert_catmullrom_to_bspline(first_pt, points[0], points[1], points[2], false));
-        if (show_fcl_sidecar_motion)
-          draw_fcl_splinemotion(*motion_b2_first, sf::Color::White);
-
-        //auto v_last = compute_derivative_on_catmullrom_spline(points[0], points[1], points[2], points[3], 1.01);
-        //auto last_pt = points[3] + multiplier * v_last;
-        auto last_pt = point_on_catmullrom_spline(points[0], points[1], points[2], points[3], 1.1);
-        auto motion_b2_last = std::make_shared<fcl::SplineMotion<double>>(
-          convert_catmullrom_to_bspline(points[1], points[2], points[3], last_pt, false));
-        if (show_fcl_sidecar_motion)
-          draw_fcl_splinemotion(*motion_b2_last, sf::Color::White);
 
         result = fcl_collide(motion_a, motion_b2_first);
         if (result.is_collide)
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <SFML/Graphics.hpp>
+#include <imgui.h>
+
+#include <rmf_planner_viz/draw/ColorPicker.hpp>
+#include <rmf_planner_viz/draw/Graph.hpp>
+#include <rmf_planner_viz/draw/Schedule.hpp>
+#include <rmf_planner_viz/draw/Trajectory.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#include "imgui-SFML.h"
+#include "planner_comparison.hpp"
+#include "scenario_loading.hpp"
+
+// Runs the rmf_traffic planner, Posq and the probabilistic road map on the
+// plan of a scenario and overlays what each of them found.
+
+using Comparison = rmf_planner_viz::draw::PlannerComparison;
+
+int main(int argc, char* argv[])
+{
+  sf::Font font;
+  if (!rmf_planner_viz::draw::load_font(font))
+    return -1;
+
+  if (argc < 2)
+  {
+    std::cout << "Please provide scenario file name" << std::endl;
+    return 0;
+  }
+
+  std::shared_ptr<const rmf_planner_viz::draw::Scenario> scenario;
+  try
+  {
+    scenario = rmf_planner_viz::draw::Scenario::load(argv[1]);
+  }
+  catch (std::runtime_error& e)
+  {
+    std::cout << e.what() << std::endl;
+    return 0;
+  }
+
+  const auto& plan_robot = scenario->plan_robot();
+  const auto& profile = plan_robot.vehicle_traits().profile();
+
+  const auto start_time = rmf_traffic::Time(rmf_traffic::Duration(0));
+
+  const auto database = std::make_shared<rmf_traffic::schedule::Database>();
+  const auto obstacles = scenario->add_obstacles(database, start_time);
+
+  // Only identifies the compared plans, which are never put in the schedule
+  const auto plan_participant = scenario->make_plan_participant(database);
+
+  std::vector<rmf_traffic::agv::Planner::Start> starts =
+    scenario->starts(start_time);
+  rmf_traffic::agv::Planner::Goal goal = scenario->goal();
+
+  rmf_planner_viz::draw::Graph graph_0_drawable(
+    plan_robot.graph(), 1.0, font);
+  std::string chosen_map = plan_robot.graph().get_waypoint(
+    starts.front().waypoint()).get_map_name();
+  graph_0_drawable.choose_map(chosen_map);
+
+  rmf_planner_viz::draw::Schedule schedule_drawable(
+    database, 0.25, chosen_map, start_time);
+
+  rmf_planner_viz::draw::Fit fit({graph_0_drawable.bounds()}, 0.02);
+
+  Comparison comparison(scenario, database, plan_participant.id());
+  std::vector<Comparison::Result> results;
+
+  const Comparison::Kind kinds[Comparison::KindCount] = {
+    Comparison::Kind::Graph,
+    Comparison::Kind::Posq,
+    Comparison::Kind::ProbabilisticRoadMap
+  };
+  bool selected[Comparison::KindCount] = {true, true, true};
+
+  // Every planner keeps its color whether or not the others are compared
+  const auto color_of = [](Comparison::Kind kind)
+    {
+      return rmf_planner_viz::draw::ColorPicker::choose(
+        static_cast<std::size_t>(kind));
+    };
+
+  const auto compare = [&]()
+    {
+      std::vector<Comparison::Kind> chosen;
+      for (std::size_t i = 0; i < Comparison::KindCount; ++i)
+      {
+        if (selected[i])
+          chosen.push_back(kinds[i]);
+      }
+
+      if (!chosen.empty())
+        comparison.start(chosen, starts, goal);
+    };
+  compare();
+
+  sf::RenderWindow app_window(
+    sf::VideoMode(1250, 1028),
+    "Planner Comparison",
+    sf::Style::Default);
+
+  app_window.resetGLStates();
+
+  ImGui::SFML::Init(app_window);
+
+  float timeline = 0.0f;
+  sf::Clock deltaClock;
+  while (app_window.isOpen())
+  {
+    sf::Event event;
+    while (app_window.pollEvent(event))
+    {
+      ImGui::SFML::ProcessEvent(event);
+
+      if (event.type == sf::Event::Closed)
+      {
+        comparison.stop();
+        return 0;
+      }
+
+      if (event.type == sf::Event::Resized)
+      {
+        sf::FloatRect visibleArea(0, 0, event.size.width, event.size.height);
+        app_window.setView(sf::View(visibleArea));
+      }
+    }
+
+    ImGui::SFML::Update(app_window, deltaClock.restart());
+
+    if (auto finished = comparison.take_results())
+      results = std::move(*finished);
+
+    ImGui::SetNextWindowPos(ImVec2(800, 100), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Planner Comparison", nullptr,
+      ImGuiWindowFlags_AlwaysAutoResize);
+
+    for (std::size_t i = 0; i < Comparison::KindCount; ++i)
+    {
+      const auto color = color_of(kinds[i]);
+      ImGui::PushStyleColor(ImGuiCol_Text,
+        ImVec4(color.r / 255.f, color.g / 255.f, color.b / 255.f, 1.f));
+      ImGui::Checkbox(Comparison::name(kinds[i]), &selected[i]);
+      ImGui::PopStyleColor();
+    }
+
+    const auto num_waypoints =
+      static_cast<int>(plan_robot.graph().num_waypoints());
+    int start_wp = static_cast<int>(starts.front().waypoint());
+    if (ImGui::InputInt("Start waypoint", &start_wp))
+    {
+      starts.front().waypoint(
+        static_cast<std::size_t>(std::min(std::max(start_wp, 0),
+        num_waypoints - 1)));
+    }
+
+    int goal_wp = static_cast<int>(goal.waypoint());
+    if (ImGui::InputInt("Goal waypoint", &goal_wp))
+    {
+      goal.waypoint(
+        static_cast<std::size_t>(std::min(std::max(goal_wp, 0),
+        num_waypoints - 1)));
+    }
+
+    if (comparison.running())
+      ImGui::Text("Planning..");
+    else if (ImGui::Button("Compare"))
+      compare();
+
+    ImGui::Separator();
+
+    ImGui::Columns(6, "results");
+    ImGui::Text("Planner");
+    ImGui::NextColumn();
+    ImGui::Text("Time (s)");
+    ImGui::NextColumn();
+    ImGui::Text("Length (m)");
+    ImGui::NextColumn();
+    ImGui::Text("Duration (s)");
+    ImGui::NextColumn();
+    ImGui::Text("Conflicts");
+    ImGui::NextColumn();
+    ImGui::Text("Routes");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    double max_duration = 0.0;
+    for (const auto& result : results)
+    {
+      const auto color = color_of(result.kind);
+      ImGui::TextColored(
+        ImVec4(color.r / 255.f, color.g / 255.f, color.b / 255.f, 1.f),
+        "%s", Comparison::name(result.kind));
+      ImGui::NextColumn();
+      ImGui::Text("%.3f", result.planning_time);
+      ImGui::NextColumn();
+      if (result.success)
+      {
+        ImGui::Text("%.2f", result.length);
+        ImGui::NextColumn();
+        ImGui::Text("%.2f", result.duration);
+        ImGui::NextColumn();
+        ImGui::Text("%zu", result.conflicts);
+        ImGui::NextColumn();
+        ImGui::Text("%zu", result.itinerary.size());
+        ImGui::NextColumn();
+      }
+      else
+      {
+        ImGui::Text("%s", result.error.c_str());
+        ImGui::NextColumn();
+        ImGui::NextColumn();
+        ImGui::NextColumn();
+        ImGui::NextColumn();
+      }
+
+      max_duration = std::max(max_duration, result.duration);
+    }
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    timeline = std::min(timeline, static_cast<float>(max_duration));
+    ImGui::SliderFloat("Timeline", &timeline, 0.0f,
+      static_cast<float>(max_duration));
+
+    ImGui::End();
+    ImGui::EndFrame();
+
+    const auto now = rmf_traffic::time::apply_offset(
+      starts.front().time(), timeline);
+
+    std::vector<rmf_planner_viz::draw::Trajectory> trajectories;
+    for (const auto& result : results)
+    {
+      for (const auto& route : result.itinerary)
+      {
+        if (route.map() != chosen_map || route.trajectory().size() < 2)
+          continue;
+
+        trajectories.emplace_back(
+          route.trajectory(), profile, now, rmf_utils::nullopt,
+          color_of(result.kind), Eigen::Vector2d(0.0, 0.0), 0.5f);
+      }
+    }
+
+    /*** drawing ***/
+    app_window.clear();
+
+    schedule_drawable.timespan(now);
+
+    sf::RenderStates states;
+    fit.apply_transform(states.transform, app_window.getSize());
+    app_window.draw(graph_0_drawable, states);
+    app_window.draw(schedule_drawable, states);
+    for (const auto& trajectory : trajectories)
+      app_window.draw(trajectory, states);
+
+    ImGui::SFML::Render(app_window);
+    app_window.display();
+  }
+}
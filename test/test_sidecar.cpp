@@ -39,6 +39,7 @@
 #include "imgui-SFML.h"
 #include "test_sidecar_utils.hpp"
 #include "spline_offset_utils.hpp"
+#include "batch_ccd.hpp"
 
 //#define PROFILING_USE_RDTSC 1
 #ifdef PROFILING_USE_RDTSC
@@ -209,6 +210,9 @@ int main()
       static std::shared_ptr<fcl::MotionBase<double>> motion_a, motion_b;
       static std::vector<ModelSpaceShape> a_shapes;
       static std::vector<ModelSpaceShape> b_shapes;
+      static CcdPairBatch batch;
+      static std::vector<CircleFootprint> footprints;
+      static SweptBounds a_bounds, b_bounds;
       PRESET_TYPE preset_type = PRESET_SPLINEMOTION;
       static int current_preset = 0;
 
@@ -273,6 +277,13 @@ int main()
           motion_a = std::make_shared<fcl::SplineMotion<double>>(to_fcl(knots_a));
           motion_b = std::make_shared<fcl::SplineMotion<double>>(to_fcl(knots_b));
 
+          batch = CcdPairBatch();
+          batch.add(knots_a, 0, knots_b, 1);
+          footprints = {CircleFootprint(a_shapes), CircleFootprint(b_shapes)};
+
+          a_bounds = compute_swept_bounds(knots_a, a_shapes);
+          b_bounds = compute_swept_bounds(knots_b, b_shapes);
+
           preset_type = preset._type;
         }
         preset_changed = false;
@@ -294,9 +305,36 @@ int main()
       static bool draw_toi_shapes = true;
       ImGui::Checkbox("Draw TOI shapes", &draw_toi_shapes);
 
+      static bool draw_swept_bounds = false;
+      ImGui::Checkbox("Draw swept bounds", &draw_swept_bounds);
+      if (swept_bounds_overlap(a_bounds, b_bounds, tolerance))
+        ImGui::Text("Swept bounds overlap, stepping needed");
+      else
+        ImGui::Text("Swept bounds apart, no collision possible");
+
+      if (draw_swept_bounds)
+      {
+        auto to_sf = [](const Eigen::Vector2d& p)
+          {
+            return sf::Vector2f((float)p.x(), (float)p.y());
+          };
+        IMDraw::draw_aabb(to_sf(a_bounds.min), to_sf(a_bounds.max), sf::Color::Red);
+        IMDraw::draw_aabb(to_sf(b_bounds.min), to_sf(b_bounds.max), sf::Color::Green);
+      }
+
       sf::Color toi_green_color(3, 125, 88);
       sf::Color toi_red_color(178, 34, 34);
 
+      static int max_evaluations = 120;
+      static int max_root_iterations = 25;
+      ImGui::SliderInt("Evaluation budget", &max_evaluations, 2, 200);
+      ImGui::SliderInt("Root finder iterations", &max_root_iterations, 1, 50);
+
+      CcdOptions ccd_options;
+      ccd_options.tolerance = tolerance;
+      ccd_options.max_evaluations = (uint)max_evaluations;
+      ccd_options.max_root_iterations = (uint)max_root_iterations;
+
       // collision
       if (preset_type == PRESET_SPLINEMOTION)
       {
@@ -308,19 +346,17 @@ int main()
         auto start = std::chrono::high_resolution_clock::now();
 #endif
 
-        double toi = 0.0;
-        uint dist_checks = 0;
-        bool collide = collide_seperable_circles(
+        const CcdResult ccd = collide_seperable_circles(
           *(fcl::SplineMotion<double>*)motion_a.get(),
           *(fcl::SplineMotion<double>*)motion_b.get(),
-          a_shapes, b_shapes,
-          toi, dist_checks, 120, (double)tolerance);
+          a_shapes, b_shapes, ccd_options);
+        const double toi = ccd.impact_time;
 #ifdef PROFILING_USE_RDTSC
         uint64_t end = __rdtsc();
 #else
         auto end = std::chrono::high_resolution_clock::now();
 #endif
-        if (collide)
+        if (ccd.collide)
         {
           ImGui::Text("Collide! TOI: %f", toi);
           if (draw_toi_shapes)
@@ -342,7 +378,29 @@ int main()
         double val = dur.count();
         ImGui::Text("Time taken (ms): %.10g", val);
 #endif
-        ImGui::Text("Distance checks: %d", dist_checks);
+        ImGui::Text("Stopped on: %s, safe until t = %f",
+          to_string(ccd.stop), ccd.safe_time);
+        ImGui::Text("Distance checks: %u in %u steps, root finder limit hit %u times",
+          ccd.evaluations, ccd.iterations, ccd.root_limit_hits);
+
+        // batched version of the same check
+        CcdBatchResult batch_result;
+        auto batch_start = std::chrono::high_resolution_clock::now();
+        collide_seperable_circles_batch(
+          batch, footprints, batch_result, ccd_options);
+        auto batch_end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> batch_dur =
+          batch_end - batch_start;
+
+        ImGui::Separator();
+        ImGui::Text("Batch (AVX2: %s)", batch_ccd_uses_avx2() ? "on" : "off");
+        if (batch_result.collide[0])
+          ImGui::Text("Collide! TOI: %f", batch_result.impact_time[0]);
+        else
+          ImGui::Text("No collision");
+        ImGui::Text("Time taken (ms): %.10g", batch_dur.count());
+        ImGui::Text("Stopped on: %s", to_string(batch_result.stop[0]));
+        ImGui::Text("Distance checks: %u", batch_result.dist_checks[0]);
       }
 
       // reset the motions
@@ -23,7 +23,13 @@
 
 #include <fcl/math/motion/interp_motion.h>
 
+#include <algorithm>
+
+#include <rmf_traffic/geometry/Box.hpp>
+#include <rmf_traffic/geometry/Circle.hpp>
+
 #include "imgui-SFML.h"
+#include "footprint_compiler.hpp"
 #include "spline_offset_utils.hpp"
 
 //#define DO_LOGGING 1
@@ -31,69 +37,120 @@
 namespace rmf_planner_viz {
 namespace draw {
 
+namespace {
+
+// Samples the poses of two fcl motions. integrate() changes the motions, so
+// this must not be shared between threads.
+class FclSplineSampler
+{
+public:
+  using Pose = fcl::Transform3d;
+
+  FclSplineSampler(
+    fcl::SplineMotion<double>& motion_a,
+    fcl::SplineMotion<double>& motion_b)
+    : _motion_a(motion_a), _motion_b(motion_b)
+  { }
+
+  void operator()(double t, Pose& a_tx, Pose& b_tx) const
+  {
+    _motion_a.integrate(t);
+    _motion_b.integrate(t);
+
+    _motion_a.getCurrentTransform(a_tx);
+    _motion_b.getCurrentTransform(b_tx);
+  }
+
+private:
+  fcl::SplineMotion<double>& _motion_a;
+  fcl::SplineMotion<double>& _motion_b;
+};
+
+Eigen::Vector3d shape_center(
+  const fcl::Transform3d& tx, const ModelSpaceShape& shape)
+{
+  return (tx * shape._transform).translation();
+}
+
+// Samples the poses of two planar motions without changing them
+class Spline2DSampler
+{
+public:
+  using Pose = SplineMotion2D::Pose;
+
+  Spline2DSampler(
+    const SplineMotion2D& motion_a,
+    const SplineMotion2D& motion_b)
+    : _motion_a(motion_a), _motion_b(motion_b)
+  { }
+
+  void operator()(double t, Pose& a_tx, Pose& b_tx) const
+  {
+    a_tx = _motion_a.pose(t);
+    b_tx = _motion_b.pose(t);
+  }
+
+private:
+  const SplineMotion2D& _motion_a;
+  const SplineMotion2D& _motion_b;
+};
+
+Eigen::Vector3d shape_center(
+  const SplineMotion2D::Pose& pose, const ModelSpaceShape& shape)
+{
+  const auto offset = shape._transform.translation();
+  const Eigen::Vector2d p = pose.apply(offset.x(), offset.y());
+  return Eigen::Vector3d(p.x(), p.y(), 0.0);
+}
+
+// Radius sum of the shapes at i of a and at j of b, taken from the table of
+// sums with the shapes of a as rows if one is given
+double radius_sum(
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const double* radius_sums,
+  std::size_t i, std::size_t j)
+{
+  if (radius_sums)
+    return radius_sums[i * b_shapes.size() + j];
+
+  return a_shapes[i]._radius + b_shapes[j]._radius;
+}
+
+} // anonymous namespace
+
+template<typename Sampler>
 static double max_splinemotion_advancement(double current_t,
-  fcl::SplineMotion<double>& motion_a, 
-  fcl::SplineMotion<double>& motion_b,
+  const Sampler& sample,
   const std::vector<ModelSpaceShape>& a_shapes,
   const std::vector<ModelSpaceShape>& b_shapes,
+  const double* radius_sums,
   const Eigen::Vector3d& d_normalized, double max_dist,
-  uint& dist_checks, double tolerance)
+  const CcdOptions& options, uint evaluation_limit, CcdResult& result)
 {
-  assert(tolerance >= 0.0);
-  
-  double lower_t_limit = current_t;
-  double upper_t_limit = 1.0;
-  uint bilateral_adv_iter = 0;
-  
-  double s1 = max_dist, s2 = max_dist;
-  double sample_t = 0.0;
-  for (;;)
-  {
-#ifdef DO_LOGGING
-    if (bilateral_adv_iter < 3)
-      printf("#1: (%f,%f) #2: (%f,%f)\n", lower_t_limit, s1, upper_t_limit, s2);
-#endif
-    
-    // alternate between bisection and false position methods
-    if (bilateral_adv_iter & 1/* && ((s1 < 0.0 && s2 > 0.0) || (s1 > 0.0 && s2 < 0.0))*/)
-    {
-      // use false position method
-      // solve for t where (t, tolerance) for a line with 
-      // endpoints (lower_t_limit, s1) and (upper_t_limit, s2)
-      // where s2 is negative and s1 is positive
-      double inv_m = (upper_t_limit - lower_t_limit) / (s2 - s1);
-      sample_t = lower_t_limit + (tolerance - s1) * inv_m;
-    }
-    else // bisection method
-      sample_t = lower_t_limit + 0.5 * (upper_t_limit - lower_t_limit);
-#ifdef DO_LOGGING
-    printf("iteration: %d picked t: %f\n", bilateral_adv_iter, sample_t);
-#endif
-
-    // integrate
-    motion_a.integrate(sample_t);
-    motion_b.integrate(sample_t);
+  assert(options.tolerance >= 0.0);
 
-    fcl::Transform3d a_tx, b_tx;
-    motion_a.getCurrentTransform(a_tx);
-    motion_b.getCurrentTransform(b_tx);
+  // closest distance between all the shapes in direction d
+  auto separation = [&](double t)
+  {
+    typename Sampler::Pose a_tx, b_tx;
+    sample(t, a_tx, b_tx);
 
     double s = DBL_MAX;
-    // compute closest distance between all 4 shapes in direction d
-    for (const auto& a_shape : a_shapes)
+    for (std::size_t i = 0; i < a_shapes.size(); ++i)
     {
-      auto a_shape_tx = a_tx * a_shape._transform;
-      for (const auto& b_shape : b_shapes)
+      const Eigen::Vector3d a_center = shape_center(a_tx, a_shapes[i]);
+      for (std::size_t j = 0; j < b_shapes.size(); ++j)
       {
-        auto b_shape_tx = b_tx * b_shape._transform;
-        Eigen::Vector3d b_to_a = a_shape_tx.translation() - b_shape_tx.translation();
+        Eigen::Vector3d b_to_a = a_center - shape_center(b_tx, b_shapes[j]);
         
         double b_to_a_dist = b_to_a.norm();
         double dist_between_shapes_along_d = 0.0;
         if (b_to_a_dist > 1e-04)
         {
           auto b_to_a_norm = b_to_a / b_to_a_dist;
-          double dist_along_b_to_a = b_to_a_dist - (a_shape._radius + b_shape._radius);
+          double dist_along_b_to_a = b_to_a_dist
+            - radius_sum(a_shapes, b_shapes, radius_sums, i, j);
           auto v = dist_along_b_to_a * b_to_a_norm;
           dist_between_shapes_along_d = v.dot(d_normalized);
         }
@@ -105,70 +162,48 @@ static double max_splinemotion_advancement(double current_t,
     }
 
 #ifdef DO_LOGGING
-    printf("dist_output: %f\n", s);
-#endif
-    if (abs(s) < tolerance)
-    {
-#ifdef DO_LOGGING
-      printf("minimal dist %f within tolerance range %f\n", s, tolerance);
-#endif
-      break;
-    }
-
-    // our window is very small and we're hopping around, so we stop.
-    // Also, this is what box2d does.
-    if (bilateral_adv_iter >= 25) 
-    {
-#ifdef DO_LOGGING
-      printf("range too small\n");
+    printf("t: %f dist_output: %f\n", t, s);
 #endif
-      break;
-    }
-    
-    if (s < 0.0)
-    {
-      upper_t_limit = sample_t;
-      s2 = s;
-    }
-    else if (s > 0.0)
-    {
-      lower_t_limit = sample_t;
-      s1 = s;
-    }
-    ++bilateral_adv_iter;
-  }
-  dist_checks += bilateral_adv_iter;
+    return s;
+  };
 
-  return sample_t;
+  return advancement_root(
+    current_t, max_dist, separation, options, evaluation_limit, result);
 }
 
-bool collide_seperable_circles(
-  fcl::SplineMotion<double>& motion_a, 
-  fcl::SplineMotion<double>& motion_b,
+template<typename Sampler>
+static CcdResult collide_seperable_circles_impl(
+  const Sampler& sample,
   const std::vector<ModelSpaceShape>& a_shapes,
   const std::vector<ModelSpaceShape>& b_shapes,
-  double& impact_time, uint& dist_checks, uint safety_maximum_checks, double tolerance)
+  const double* radius_sums,
+  const CcdOptions& options)
 {
+  CcdResult result;
   if (a_shapes.empty() || b_shapes.empty())
-    return false;
+  {
+    result.safe_time = 1.0;
+    return result;
+  }
 
-  auto calc_min_dist = [](
-    const fcl::Transform3d& a_tx,
-    const fcl::Transform3d& b_tx,
+  using Pose = typename Sampler::Pose;
+  auto calc_min_dist = [radius_sums](
+    const Pose& a_tx,
+    const Pose& b_tx,
     const std::vector<ModelSpaceShape>& a_shapes,
     const std::vector<ModelSpaceShape>& b_shapes,
     Eigen::Vector3d& d, double& min_dist)
   {
     min_dist = DBL_MAX;
-    for (const auto& a_shape : a_shapes)
+    for (std::size_t i = 0; i < a_shapes.size(); ++i)
     {
-      auto a_shape_tx = a_tx * a_shape._transform;
+      const Eigen::Vector3d a_center = shape_center(a_tx, a_shapes[i]);
 
-      for (const auto& b_shape : b_shapes)
+      for (std::size_t j = 0; j < b_shapes.size(); ++j)
       {
-        auto b_shape_tx = b_tx * b_shape._transform;
-        Eigen::Vector3d b_to_a = a_shape_tx.translation() - b_shape_tx.translation();
-        double dist = b_to_a.norm() - (a_shape._radius + b_shape._radius);
+        Eigen::Vector3d b_to_a = a_center - shape_center(b_tx, b_shapes[j]);
+        double dist = b_to_a.norm()
+          - radius_sum(a_shapes, b_shapes, radius_sums, i, j);
         if (dist < min_dist)
         {
           min_dist = dist;
@@ -178,67 +213,169 @@ bool collide_seperable_circles(
     }
   };
 
-  fcl::Transform3d a_start_tf, b_start_tf;
-  fcl::Transform3d a_tf, b_tf;
+  Pose a_start_tf, b_start_tf;
+  Pose a_tf, b_tf;
 
-  motion_a.integrate(0.0);
-  motion_b.integrate(0.0);
-  motion_a.getCurrentTransform(a_start_tf);
-  motion_b.getCurrentTransform(b_start_tf);
+  sample(0.0, a_start_tf, b_start_tf);
 
   double dist_along_d_to_cover = 0.0;
   Eigen::Vector3d d(0,0,0);
   calc_min_dist(a_start_tf, b_start_tf, a_shapes, b_shapes,
     d, dist_along_d_to_cover);
+  ++result.evaluations;
   
   double t = 0.0;
-  uint iter = 0;
-  while (dist_along_d_to_cover > tolerance && t < 1.0)
+  while (dist_along_d_to_cover > options.tolerance && t < 1.0)
   {
+    // Each step needs at least one evaluation for its root finder and one
+    // for the pose it lands on
+    if (result.evaluations + 2 > options.max_evaluations)
+    {
+      result.stop = CcdStop::Budget;
+      result.safe_time = t;
+      return result;
+    }
+
     Eigen::Vector3d d_normalized = d.normalized();
 #ifdef DO_LOGGING
-    printf("======= iter:%d\n", iter);
+    printf("======= iter:%d\n", result.iterations);
     std::cout << "d_norm: \n" << d_normalized << std::endl;
 #endif
 
-    t = max_splinemotion_advancement(t, motion_a, motion_b, a_shapes, b_shapes, 
-      d_normalized, dist_along_d_to_cover, dist_checks, tolerance);
+    t = max_splinemotion_advancement(t, sample, a_shapes, b_shapes,
+      radius_sums, d_normalized, dist_along_d_to_cover,
+      options, options.max_evaluations - 1, result);
 #ifdef DO_LOGGING
     printf("max_splinemotion_advancement returns t: %f\n", t);
 #endif
 
-    motion_a.integrate(t);
-    motion_b.integrate(t);
-
-    motion_a.getCurrentTransform(a_tf);
-    motion_b.getCurrentTransform(b_tf);
+    sample(t, a_tf, b_tf);
 
     calc_min_dist(a_tf, b_tf, a_shapes, b_shapes,
       d, dist_along_d_to_cover);
     
-    ++dist_checks;
-    ++iter;
-
-    //infinite loop prevention. you should increase safety_maximum_checks if you still want a solution
-    if (dist_checks > safety_maximum_checks)
-      break;
+    ++result.evaluations;
+    ++result.iterations;
   }
-  
-  if (dist_checks > safety_maximum_checks)
-    return false;
 
   if (t >= 0.0 && t < 1.0)
   {
-    impact_time = t;
+    result.collide = true;
+    result.impact_time = t;
+    result.safe_time = t;
+    result.stop = CcdStop::Contact;
 #ifdef DO_LOGGING
     printf("time of impact: %f\n", t);
 #endif
-    return true;
+    return result;
   }
 #ifdef DO_LOGGING
   printf("no collide\n");
 #endif
-  return false;
+  result.safe_time = 1.0;
+  return result;
+}
+
+const char* to_string(CcdStop stop)
+{
+  switch (stop)
+  {
+    case CcdStop::Contact: return "contact";
+    case CcdStop::Separated: return "separated";
+    case CcdStop::Budget: return "budget";
+  }
+  return "unknown";
+}
+
+CcdResult collide_seperable_circles(
+  fcl::SplineMotion<double>& motion_a,
+  fcl::SplineMotion<double>& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const CcdOptions& options)
+{
+  return collide_seperable_circles_impl(
+    FclSplineSampler(motion_a, motion_b), a_shapes, b_shapes, nullptr,
+    options);
+}
+
+CcdResult collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const CcdOptions& options)
+{
+  return collide_seperable_circles_impl(
+    Spline2DSampler(motion_a, motion_b), a_shapes, b_shapes, nullptr,
+    options);
+}
+
+CcdResult collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const std::vector<double>& radius_sums,
+  const CcdOptions& options)
+{
+  assert(radius_sums.size() == a_shapes.size() * b_shapes.size());
+  return collide_seperable_circles_impl(
+    Spline2DSampler(motion_a, motion_b), a_shapes, b_shapes,
+    radius_sums.data(), options);
+}
+
+namespace {
+
+bool report(const CcdResult& result,
+  double& impact_time, uint& dist_checks, uint* iterations)
+{
+  dist_checks += result.evaluations;
+  if (iterations)
+    *iterations = result.iterations;
+
+  if (result.collide)
+    impact_time = result.impact_time;
+
+  return result.collide;
+}
+
+CcdOptions make_options(uint safety_maximum_checks, double tolerance)
+{
+  CcdOptions options;
+  options.tolerance = tolerance;
+  options.max_evaluations = safety_maximum_checks;
+  return options;
+}
+
+} // anonymous namespace
+
+bool collide_seperable_circles(
+  fcl::SplineMotion<double>& motion_a, 
+  fcl::SplineMotion<double>& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  double& impact_time, uint& dist_checks, uint safety_maximum_checks, double tolerance,
+  uint* iterations)
+{
+  return report(
+    collide_seperable_circles(motion_a, motion_b, a_shapes, b_shapes,
+      make_options(safety_maximum_checks, tolerance)),
+    impact_time, dist_checks, iterations);
+}
+
+bool collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  double& impact_time, uint& dist_checks, uint safety_maximum_checks, double tolerance,
+  uint* iterations)
+{
+  return report(
+    collide_seperable_circles(motion_a, motion_b, a_shapes, b_shapes,
+      make_options(safety_maximum_checks, tolerance)),
+    impact_time, dist_checks, iterations);
 }
 
 fcl::SplineMotion<double> to_fcl(const std::array<Eigen::Vector3d, 4>& knots)
@@ -256,6 +393,51 @@ fcl::SplineMotion<double> to_fcl(const std::array<Eigen::Vector3d, 4>& knots)
                             Rd[3]);
 }
 
+double shapes_extent(const std::vector<ModelSpaceShape>& shapes)
+{
+  double extent = 0.0;
+  for (const auto& shape : shapes)
+  {
+    const double reach = shape._transform.translation().head<2>().norm()
+      + shape._radius;
+    extent = std::max(extent, reach);
+  }
+  return extent;
+}
+
+SweptBounds compute_swept_bounds(
+  const std::array<Eigen::Vector3d, 4>& knots, double extent)
+{
+  SweptBounds bounds;
+  bounds.min = knots[0].head<2>();
+  bounds.max = knots[0].head<2>();
+  for (std::size_t i = 1; i < 4; ++i)
+  {
+    bounds.min = bounds.min.cwiseMin(knots[i].head<2>());
+    bounds.max = bounds.max.cwiseMax(knots[i].head<2>());
+  }
+
+  bounds.min.array() -= extent;
+  bounds.max.array() += extent;
+  return bounds;
+}
+
+SweptBounds compute_swept_bounds(
+  const std::array<Eigen::Vector3d, 4>& knots,
+  const std::vector<ModelSpaceShape>& shapes)
+{
+  return compute_swept_bounds(knots, shapes_extent(shapes));
+}
+
+bool swept_bounds_overlap(
+  const SweptBounds& a, const SweptBounds& b, double tolerance)
+{
+  return a.min.x() <= b.max.x() + tolerance
+    && b.min.x() <= a.max.x() + tolerance
+    && a.min.y() <= b.max.y() + tolerance
+    && b.min.y() <= a.max.y() + tolerance;
+}
+
 std::vector<Preset> setup_presets()
 {
   std::vector<Preset> presets;
@@ -458,6 +640,31 @@ std::vector<Preset> setup_presets()
     presets.push_back(p);
   }
 
+  /*** shapes compiled from rmf_traffic profiles ***/
+  {
+    FootprintCompiler compiler;
+    const rmf_traffic::Profile box_profile{
+      rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Box>(1.2, 0.6)};
+    const rmf_traffic::Profile circle_profile{
+      rmf_traffic::geometry::make_final_convex<
+        rmf_traffic::geometry::Circle>(0.4)};
+
+    Preset p;
+    p._description = "Box profile turning vs Circle profile";
+    p._type = PRESET_SPLINEMOTION;
+
+    p.a_shapes = compiler.compile(box_profile)->footprint.shapes;
+    p.b_shapes = compiler.compile(circle_profile)->footprint.shapes;
+
+    p.a_end = Eigen::Vector3d(0, 0, EIGEN_PI / 2.0);
+
+    p.b_start = Eigen::Vector3d(-3, 0.7, 0);
+    p.b_end = Eigen::Vector3d(0, 0.7, 0);
+
+    presets.push_back(p);
+  }
+
   return presets;
 }
 
@@ -26,6 +26,10 @@
 #include <rmf_planner_viz/draw/IMDraw.hpp>
 #include <float.h>
 
+#include <cmath>
+
+#include "spline_motion_2d.hpp"
+
 namespace rmf_planner_viz {
 namespace draw {
 
@@ -40,17 +44,209 @@ struct ModelSpaceShape
   double _radius;
 };
 
+struct CcdOptions
+{
+  // Gap at which the shapes count as touching
+  double tolerance = 0.001;
+
+  // The root finder of an advancement step stops once it has narrowed the
+  // crossing down to an interval of t this wide
+  double time_tolerance = 1e-6;
+
+  // Distance evaluations allowed for the root finder of one advancement step
+  uint max_root_iterations = 25;
+
+  // Distance evaluations allowed for the whole check. This is a hard limit,
+  // so it bounds the cost of a check.
+  uint max_evaluations = 120;
+};
+
+enum class CcdStop
+{
+  // The shapes came within tolerance of each other at impact_time
+  Contact,
+
+  // The motions reached their end without contact
+  Separated,
+
+  // max_evaluations ran out first. The motions are free of contact up to
+  // safe_time and nothing is known after it.
+  Budget
+};
+
+const char* to_string(CcdStop stop);
+
+struct CcdResult
+{
+  bool collide = false;
+  double impact_time = 0.0;
+  double safe_time = 0.0;
+  CcdStop stop = CcdStop::Separated;
+
+  // Distance evaluations, including the ones of the root finder
+  uint evaluations = 0;
+
+  // Advancement steps taken
+  uint iterations = 0;
+
+  // Advancement steps whose root finder used up max_root_iterations
+  uint root_limit_hits = 0;
+};
+
+// Root finder of one advancement step, shared by the scalar and batched
+// checks. separation(t) is the distance between the shapes along the
+// direction of closest approach at current_t, where it is max_dist. Returns
+// the time to advance to, where the separation is between 0 and tolerance.
+//
+// The root is bisected until a sample with negative separation brackets
+// it, and then found with Illinois steps, which fall back to bisection
+// whenever they would leave the bracket. Stops at the first of: a separation
+// within tolerance, a bracket narrower than time_tolerance,
+// max_root_iterations, or result.evaluations reaching evaluation_limit.
+template<typename Separation>
+double advancement_root(
+  double current_t,
+  double max_dist,
+  const Separation& separation,
+  const CcdOptions& options,
+  uint evaluation_limit,
+  CcdResult& result)
+{
+  const double target = 0.5 * options.tolerance;
+  double lo = current_t;
+  double f_lo = max_dist - target;
+  double hi = 1.0;
+  double f_hi = 0.0;
+  bool bracketed = false;
+
+  // Which end the last sample replaced, for the Illinois weighting
+  int last_side = 0;
+
+  for (uint i = 0; ; ++i)
+  {
+    if (hi - lo <= options.time_tolerance)
+      return hi;
+
+    if (result.evaluations >= evaluation_limit)
+      return lo;
+
+    if (i >= options.max_root_iterations)
+    {
+      ++result.root_limit_hits;
+      return lo > current_t ? lo : hi;
+    }
+
+    double t = 0.5 * (lo + hi);
+    if (bracketed)
+    {
+      const double false_position = lo + f_lo * (hi - lo) / (f_lo - f_hi);
+      if (false_position > lo && false_position < hi)
+        t = false_position;
+    }
+
+    const double f = separation(t) - target;
+    ++result.evaluations;
+
+    if (std::abs(f) < target)
+      return t;
+
+    if (f < 0.0)
+    {
+      if (last_side < 0)
+        f_lo *= 0.5;
+
+      hi = t;
+      f_hi = f;
+      bracketed = true;
+      last_side = -1;
+    }
+    else
+    {
+      if (last_side > 0 && bracketed)
+        f_hi *= 0.5;
+
+      lo = t;
+      f_lo = f;
+      last_side = 1;
+    }
+  }
+}
+
 // this uses spline motions
+CcdResult collide_seperable_circles(
+  fcl::SplineMotion<double>& motion_a,
+  fcl::SplineMotion<double>& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const CcdOptions& options);
+
+// Same as above for planar motions, which are much cheaper to sample and are
+// not modified, so this can run on several threads with shared motions
+CcdResult collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const CcdOptions& options);
+
+// Same as above with the radius sum of every pair of shapes given, with the
+// shapes of a as rows, so that they are not added up again at every step
+CcdResult collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  const std::vector<double>& radius_sums,
+  const CcdOptions& options);
+
+// Shorthands for the above with only the tolerance and evaluation budget
+// given. The evaluations are added to dist_checks. If iterations is given, it
+// receives the number of advancement steps taken. A check that runs out of
+// budget reports no collision.
 bool collide_seperable_circles(
   fcl::SplineMotion<double>& motion_a, 
   fcl::SplineMotion<double>& motion_b,
   const std::vector<ModelSpaceShape>& a_shapes,
   const std::vector<ModelSpaceShape>& b_shapes,
   double& impact_time, uint& dist_checks, 
-  uint safety_maximum_checks = 120, double tolerance = 0.001);
+  uint safety_maximum_checks = 120, double tolerance = 0.001,
+  uint* iterations = nullptr);
+
+bool collide_seperable_circles(
+  const SplineMotion2D& motion_a,
+  const SplineMotion2D& motion_b,
+  const std::vector<ModelSpaceShape>& a_shapes,
+  const std::vector<ModelSpaceShape>& b_shapes,
+  double& impact_time, uint& dist_checks,
+  uint safety_maximum_checks = 120, double tolerance = 0.001,
+  uint* iterations = nullptr);
 
 fcl::SplineMotion<double> to_fcl(const std::array<Eigen::Vector3d, 4>& knots);
 
+// Broad phase for the above. The spline of to_fcl(knots) stays inside the
+// convex hull of its knots, so the box around the knots grown by the reach of
+// the furthest circle bounds everything the shapes touch over the motion.
+struct SweptBounds
+{
+  Eigen::Vector2d min;
+  Eigen::Vector2d max;
+};
+
+// Distance from the robot origin to the far side of its furthest circle
+double shapes_extent(const std::vector<ModelSpaceShape>& shapes);
+
+SweptBounds compute_swept_bounds(
+  const std::array<Eigen::Vector3d, 4>& knots, double extent);
+
+SweptBounds compute_swept_bounds(
+  const std::array<Eigen::Vector3d, 4>& knots,
+  const std::vector<ModelSpaceShape>& shapes);
+
+// False if the bounds are further than tolerance apart, in which case
+// collide_seperable_circles cannot report a collision for the two motions
+bool swept_bounds_overlap(
+  const SweptBounds& a, const SweptBounds& b, double tolerance = 0.0);
+
 // Presets
 enum PRESET_TYPE
 {
@@ -15,8 +15,11 @@
  *
 */
 
+#include <imgui.h>
+
 #include <SFML/Graphics.hpp>
 
+#include <rmf_planner_viz/draw/Fit.hpp>
 #include <rmf_planner_viz/draw/Graph.hpp>
 #include <rmf_planner_viz/draw/Schedule.hpp>
 
@@ -28,22 +31,23 @@
 
 #include <Eigen/Geometry>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <string>
+#include <thread>
 
 #include "imgui-SFML.h"
+#include "roadmap_stream.hpp"
+#include "scenario_loading.hpp"
 
 const std::size_t NotObstacleID = std::numeric_limits<std::size_t>::max();
 
 int main(int argc, char* argv[])
 {
   sf::Font font;
-  if (!font.loadFromFile("./build/rmf_planner_viz/fonts/OpenSans-Bold.ttf"))
-  {
-    std::cout <<
-      "Failed to load font. Make sure you run the executable from the colcon directory"
-              << std::endl;
+  if (!rmf_planner_viz::draw::load_font(font))
     return -1;
-  }
 
   if (argc < 2)
   {
@@ -51,11 +55,10 @@ int main(int argc, char* argv[])
     return 0;
   }
 
-
-  rmf_performance_tests::scenario::Description scenario;
+  std::shared_ptr<const rmf_planner_viz::draw::Scenario> scenario;
   try
   {
-    parse(argv[1], scenario);
+    scenario = rmf_planner_viz::draw::Scenario::load(argv[1]);
   }
   catch (std::runtime_error& e)
   {
@@ -65,110 +68,34 @@ int main(int argc, char* argv[])
 
   using namespace std::chrono_literals;
 
-  const auto& plan_robot = scenario.robots.find(scenario.plan.robot);
-  if (plan_robot == scenario.robots.end())
-  {
-    std::cout << "Plan robot [" << scenario.plan.robot <<
-      "]'s traits and profile missing" << std::endl;
-    return 0;
-  }
-
-  const auto get_wp =
-    [&](const rmf_traffic::agv::Graph& graph, const std::string& name)
-    {
-      return graph.find_waypoint(name)->index();
-    };
+  const auto& plan_robot = scenario->plan_robot();
 
   const auto start_time = rmf_traffic::Time(rmf_traffic::Duration(0));
 
   const auto database = std::make_shared<rmf_traffic::schedule::Database>();
 
-  std::vector<rmf_traffic::schedule::Participant> obstacles;
-
-  for (const auto& obstacle : scenario.obstacle_plans)
-  {
-    const auto& robot = scenario.robots.find(obstacle.robot);
-
-    if (robot == scenario.robots.end())
-    {
-      std::cout << "Robot [" << obstacle.robot <<
-        "] is missing traits and profile. Using traits and profile of plan_robot."
-                << std::endl;
-
-      rmf_traffic::agv::Planner planner = rmf_traffic::agv::Planner{
-        plan_robot->second,
-        {nullptr}
-      };
-
-      obstacles.emplace_back(
-        rmf_performance_tests::add_obstacle(
-          planner, database,
-          {
-            start_time + std::chrono::seconds(obstacle.initial_time),
-            get_wp(plan_robot->second.graph(), obstacle.initial_waypoint),
-            obstacle.initial_orientation * M_PI / 180.0
-          },
-          get_wp(plan_robot->second.graph(), obstacle.goal)
-        )
-      );
-    }
-    else
-    {
-      rmf_traffic::agv::Planner planner = rmf_traffic::agv::Planner{
-        robot->second,
-        {nullptr}
-      };
-
-      obstacles.emplace_back(
-        rmf_performance_tests::add_obstacle(
-          planner, database,
-          {
-            start_time + std::chrono::seconds(obstacle.initial_time),
-            get_wp(robot->second.graph(), obstacle.initial_waypoint),
-            obstacle.initial_orientation * M_PI / 180.0
-          },
-          get_wp(robot->second.graph(), obstacle.goal)
-        )
-      );
-    }
-  }
+  const auto obstacles = scenario->add_obstacles(database, start_time);
 
   std::vector<rmf_freespace_planner::rmf_probabilistic_road_map::ProbabilisticRoadMap::Obstacle>
   static_obstacles;
-  for (const auto& obstacle : scenario.obstacle_routes)
+  for (const auto& obstacle : scenario->description().obstacle_routes)
   {
-    const auto& robot = scenario.robots.at(obstacle.robot);
-
-    obstacles.emplace_back(
-      rmf_performance_tests::add_obstacle(
-        database,
-        robot.vehicle_traits().profile(),
-        obstacle.route));
+    const auto& robot = scenario->description().robots.at(obstacle.robot);
 
     static_obstacles.push_back(
       {obstacle.route.trajectory().at(0).position().head<2>(),
         robot.vehicle_traits().profile().footprint()->get_characteristic_length()});
   }
 
-  const auto& plan = scenario.plan;
-
-  auto plan_participant = rmf_traffic::schedule::make_participant(
-    rmf_traffic::schedule::ParticipantDescription{
-      "participant_0",
-      "test_trajectory",
-      rmf_traffic::schedule::ParticipantDescription::Rx::Responsive,
-      plan_robot->second.vehicle_traits().profile()
-    },
-    database);
+  auto plan_participant = scenario->make_plan_participant(database);
 
   const auto obstacle_validator =
     rmf_traffic::agv::ScheduleRouteValidator::make(
     database, plan_participant.id(),
-    plan_robot->second.vehicle_traits().profile());
+    plan_robot.vehicle_traits().profile());
 
-  rmf_traffic::agv::Planner planner_0(
-    plan_robot->second,
-    rmf_traffic::agv::Planner::Options(nullptr));
+  rmf_traffic::agv::Planner planner_0 =
+    scenario->planner(scenario->plan().robot);
 
   using namespace std::chrono_literals;
 
@@ -177,69 +104,89 @@ int main(int argc, char* argv[])
   // set plans for the participants
   using namespace std::chrono_literals;
 
-  std::vector<rmf_traffic::agv::Planner::Start> starts;
-  starts.emplace_back(start_time + std::chrono::seconds(
-      plan.initial_time),
-    get_wp(plan_robot->second.graph(), plan.initial_waypoint),
-    plan.initial_orientation);
+  std::vector<rmf_traffic::agv::Planner::Start> starts =
+    scenario->starts(start_time);
 
-  rmf_traffic::agv::Planner::Goal goal(get_wp(
-      plan_robot->second.graph(), plan.goal));
+  rmf_traffic::agv::Planner::Goal goal = scenario->goal();
 
   const auto& planner_plan = planner_0.plan(starts, goal);
 
   const auto& routes = planner_plan->get_itinerary();
 
-  const auto& start_timing = std::chrono::steady_clock::now();
+  // Each segment is planned on a worker thread and streamed into the view as
+  // soon as it is done, so the window opens while the road map is still being
+  // built
+  rmf_planner_viz::draw::RoadmapStream roadmap_stream;
   std::vector<rmf_traffic::Route> planned_routes;
-  for (const auto& route : routes)
-  {
-    for (std::size_t i = 0; i < route.trajectory().size() - 1; ++i)
+  std::atomic_bool planning(true);
+  std::atomic_bool stop_planning(false);
+
+  // Why the planning thread gave up, if it did. Only read once it is done.
+  std::string planning_error;
+
+  const auto& start_timing = std::chrono::steady_clock::now();
+  std::thread planning_thread(
+    [&]()
     {
-      if ((route.trajectory()[i].position() -
-        route.trajectory()[i + 1].position()).norm() < 1)
+      try
       {
-        continue;
+        for (const auto& route : routes)
+        {
+          for (std::size_t i = 0; i < route.trajectory().size() - 1; ++i)
+          {
+            if (stop_planning)
+              break;
+
+            if ((route.trajectory()[i].position() -
+              route.trajectory()[i + 1].position()).norm() < 1)
+            {
+              continue;
+            }
+            if (route.trajectory()[i].position().x() ==
+              route.trajectory()[i + 1].position().x() &&
+              route.trajectory()[i].position().y() ==
+              route.trajectory()[i + 1].position().y())
+            {
+              continue;
+            }
+
+            rmf_freespace_planner::rmf_probabilistic_road_map::ProbabilisticRoadMap
+              probabilistic_road_map(
+              obstacle_validator,
+              3,
+              1000.0,
+              database,
+              std::unordered_set<rmf_traffic::schedule::ParticipantId>(
+                {plan_participant.id()}));
+
+            const auto segment_start = std::chrono::steady_clock::now();
+            auto result = probabilistic_road_map.plan(
+              {route.trajectory()[i].position(), route.trajectory()[i].time()},
+              {route.trajectory()[i + 1].position()},
+              plan_robot.vehicle_traits(),
+              static_obstacles,
+              route.map());
+
+            roadmap_stream.add_segment(
+              route.map(), result,
+              std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - segment_start).count());
+
+            planned_routes.insert(
+              planned_routes.end(), result.begin(), result.end());
+          }
+        }
       }
-      if (route.trajectory()[i].position().x() ==
-        route.trajectory()[i + 1].position().x() &&
-        route.trajectory()[i].position().y() ==
-        route.trajectory()[i + 1].position().y())
+      catch (const std::exception& e)
       {
-        continue;
+        planning_error = e.what();
       }
 
-      rmf_freespace_planner::rmf_probabilistic_road_map::ProbabilisticRoadMap
-        probabilistic_road_map(
-        obstacle_validator,
-        3,
-        1000.0,
-        database,
-        std::unordered_set<rmf_traffic::schedule::ParticipantId>(
-          {plan_participant.id()}));
-
-      auto result = probabilistic_road_map.plan(
-        {route.trajectory()[i].position(), route.trajectory()[i].time()},
-        {route.trajectory()[i + 1].position()},
-        plan_robot->second.vehicle_traits(),
-        static_obstacles,
-        route.map());
-      planned_routes.insert(planned_routes.end(), result.begin(), result.end());
-    }
-  }
-
-  plan_participant.set(planned_routes);
-
-  auto end_timing = std::chrono::steady_clock::now();
-
-  std::cout << "-------------------------" << std::endl;
-  std::cout << "Time taken for PRM " <<
-    std::chrono::duration_cast<std::chrono::milliseconds>(
-      end_timing - start_timing).count() / 1000.0 << "s" << std::endl;
-  std::cout << "-------------------------" << std::endl;
+      planning = false;
+    });
 
   rmf_planner_viz::draw::Graph graph_0_drawable(
-    plan_robot->second.graph(), 0.5, font);
+    plan_robot.graph(), 0.5, font);
   std::vector<std::string> map_names = graph_0_drawable.get_map_names();
   std::string chosen_map = argv[2];
 //  if (graph_0_drawable.current_map())
@@ -255,7 +202,17 @@ int main(int argc, char* argv[])
 
   app_window.resetGLStates();
 
-  const auto bounds = schedule_drawable.bounds();
+  // The plan only reaches the schedule once the road map is done, so the
+  // graph plan that it refines is fitted in its place
+  auto bounds = schedule_drawable.bounds();
+  for (const auto& route : routes)
+  {
+    if (route.map() != chosen_map)
+      continue;
+
+    for (const auto& waypoint : route.trajectory())
+      bounds.add_point(waypoint.position().head<2>().cast<float>());
+  }
 
   rmf_planner_viz::draw::Fit fit({bounds}, 0.02);
   std::cout << "initial bounds:\n"
@@ -268,6 +225,9 @@ int main(int argc, char* argv[])
   current_time += std::chrono::milliseconds(std::stoi(argv[3]));
   sf::Clock deltaClock;
 
+  double planning_time = 0.0;
+  rmf_utils::optional<std::size_t> selected_node;
+
   while (app_window.isOpen())
   {
     current_time += std::chrono::milliseconds(std::stoi(argv[4]));
@@ -278,9 +238,22 @@ int main(int argc, char* argv[])
 
       if (event.type == sf::Event::Closed)
       {
+        stop_planning = true;
+        planning_thread.join();
         return 0;
       }
 
+      if (event.type == sf::Event::MouseButtonPressed
+        && !ImGui::GetIO().WantCaptureMouse)
+      {
+        const sf::Vector2f p =
+          fit.compute_transform(app_window.getSize()).getInverse()
+          * sf::Vector2f(event.mouseButton.x, event.mouseButton.y);
+
+        selected_node = roadmap_stream.pick(p.x, p.y, 1.0);
+        roadmap_stream.select(selected_node);
+      }
+
       if (event.type == sf::Event::Resized)
       {
         sf::FloatRect visibleArea(0, 0, event.size.width, event.size.height);
@@ -290,7 +263,80 @@ int main(int argc, char* argv[])
 
     ImGui::SFML::Update(app_window, deltaClock.restart());
 
+    roadmap_stream.update();
+    if (!planning && planning_thread.joinable())
+    {
+      planning_thread.join();
+      planning_time = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_timing).count();
+
+      plan_participant.set(planned_routes);
+
+      std::cout << "-------------------------" << std::endl;
+      std::cout << "Time taken for PRM " << planning_time << "s" << std::endl;
+      std::cout << "-------------------------" << std::endl;
+      if (!planning_error.empty())
+        std::cout << "PRM failed: " << planning_error << std::endl;
+    }
+
     graph_0_drawable.choose_map(chosen_map);
+    roadmap_stream.choose_map(chosen_map);
+
+    ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Road map");
+
+    const double elapsed = planning_thread.joinable() ?
+      std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_timing).count() :
+      planning_time;
+    const auto& nodes = roadmap_stream.nodes();
+    const auto& segments = roadmap_stream.segments();
+
+    if (planning_thread.joinable())
+      ImGui::Text("Planning.. %.2f s", elapsed);
+    else if (!planning_error.empty())
+      ImGui::TextColored(ImVec4(1, 0, 0, 1),
+        "Planning failed after %.2f s: %s", elapsed, planning_error.c_str());
+    else
+      ImGui::Text("Planned in %.2f s", elapsed);
+    ImGui::Text("Segments: %lu", segments.size());
+    ImGui::Text("Nodes: %lu", nodes.size());
+    ImGui::Text("Edges: %lu", roadmap_stream.edge_count());
+    if (elapsed > 0.0)
+      ImGui::Text("Nodes per second: %.0f", nodes.size() / elapsed);
+
+    const auto slowest = std::max_element(segments.begin(), segments.end(),
+        [](const auto& a, const auto& b)
+        {
+          return a.planning_time < b.planning_time;
+        });
+    if (slowest != segments.end())
+    {
+      ImGui::Text("Slowest segment: %lu in %.3f s",
+        static_cast<std::size_t>(slowest - segments.begin()),
+        slowest->planning_time);
+    }
+
+    ImGui::Separator();
+
+    if (selected_node)
+    {
+      const auto& node = nodes[*selected_node];
+      const auto& segment = segments[node.segment];
+      ImGui::Text("Node %lu", *selected_node);
+      ImGui::Text("Position: (%.2f, %.2f)",
+        node.position.x(), node.position.y());
+      ImGui::Text("Time: %.2f s",
+        rmf_traffic::time::to_seconds(node.time - start_time));
+      ImGui::Text("Segment %lu on [%s], planned in %.3f s",
+        node.segment, segment.map.c_str(), segment.planning_time);
+    }
+    else
+    {
+      ImGui::Text("Click a node to inspect it");
+    }
+
+    ImGui::End();
 
     app_window.clear();
 
@@ -299,6 +345,7 @@ int main(int argc, char* argv[])
     sf::RenderStates states;
     fit.apply_transform(states.transform, app_window.getSize());
     app_window.draw(graph_0_drawable, states);
+    app_window.draw(roadmap_stream, states);
     app_window.draw(schedule_drawable, states);
 
     ImGui::SFML::Render();
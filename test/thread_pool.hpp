@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2020 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef RMF_PLANNER_VIZ__DRAW__THREAD_POOL_HPP
+#define RMF_PLANNER_VIZ__DRAW__THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rmf_planner_viz {
+namespace draw {
+
+// Work stealing thread pool. Every worker has its own task queue, takes new
+// work from the back of it and steals from the front of the others once it
+// runs dry, so uneven tasks still keep every thread busy. Threads that call
+// wait() run tasks too.
+//
+// A task that throws does not stop the others. The first exception is kept
+// and rethrown by the next wait() or parallel_for() once every task is done.
+class ThreadPool
+{
+public:
+
+  using Task = std::function<void()>;
+
+  explicit ThreadPool(std::size_t threads = 0)
+  {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t i = 0; i < threads; ++i)
+      _queues.emplace_back(new Queue);
+
+    for (std::size_t i = 0; i < threads; ++i)
+      _threads.emplace_back([this, i]() { work(i); });
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool()
+  {
+    // Nobody is left to hear about a failed task
+    try
+    {
+      wait();
+    }
+    catch (...)
+    {
+      // Do nothing
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+
+    for (auto& thread : _threads)
+      thread.join();
+  }
+
+  std::size_t size() const
+  {
+    return _threads.size();
+  }
+
+  void submit(Task task)
+  {
+    // Count the task before it can be taken, so the counters never drop
+    // below zero
+    ++_unfinished;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_queued;
+    }
+
+    const std::size_t q = _next++ % _queues.size();
+    {
+      std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+      _queues[q]->tasks.push_back(std::move(task));
+    }
+    _wake.notify_one();
+  }
+
+  // Block until every submitted task has finished, then rethrow the first
+  // exception that a task threw since the last wait
+  void wait()
+  {
+    Task task;
+    while (_unfinished.load() > 0)
+    {
+      if (take(_next.load() % _queues.size(), task))
+      {
+        run(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done.wait(lock, [this]()
+        {
+          return _unfinished.load() == 0 || _queued > 0;
+        });
+    }
+
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::swap(error, _error);
+    }
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // Call f(chunk_begin, chunk_end) over [begin, end) in chunks of at most
+  // grain elements, and return once all of them are done
+  template<typename F>
+  void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F f)
+  {
+    grain = std::max<std::size_t>(grain, 1);
+    for (std::size_t i = begin; i < end; i += grain)
+    {
+      const std::size_t chunk_end = std::min(end, i + grain);
+      submit([f, i, chunk_end]() { f(i, chunk_end); });
+    }
+    wait();
+  }
+
+private:
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Take from the back of our own queue first, then steal from the front of
+  // the others
+  bool take(std::size_t own, Task& task)
+  {
+    {
+      Queue& q = *_queues[own];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty())
+      {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        claimed();
+        return true;
+      }
+    }
+
+    for (std::size_t k = 1; k < _queues.size(); ++k)
+    {
+      Queue& q = *_queues[(own + k) % _queues.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty())
+      {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        claimed();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void claimed()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_queued;
+  }
+
+  void run(Task& task)
+  {
+    try
+    {
+      task();
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_error)
+        _error = std::current_exception();
+    }
+
+    task = nullptr;
+    if (--_unfinished == 0)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done.notify_all();
+    }
+  }
+
+  void work(std::size_t index)
+  {
+    Task task;
+    for (;;)
+    {
+      if (take(index, task))
+      {
+        run(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this]() { return _stop || _queued > 0; });
+      if (_stop && _queued == 0)
+        return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  std::size_t _queued = 0;
+  bool _stop = false;
+  std::exception_ptr _error;
+
+  std::atomic<std::size_t> _next{0};
+  std::atomic<std::size_t> _unfinished{0};
+};
+
+} // namespace draw
+} // namespace rmf_planner_viz
+
+#endif // RMF_PLANNER_VIZ__DRAW__THREAD_POOL_HPP